@@ -0,0 +1,334 @@
+/*
+ * Copyright (C) 2018-2020 Oleg Kapitonov
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * --------------------------------------------------------------------------
+ */
+
+
+// Headless profiler: converts a directory of response files
+// into *.tapf profiles, several files at a time,
+// and writes a JSON report with warnings and quality figures
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QThreadPool>
+#include <QRunnable>
+#include <QSemaphore>
+#include <QMutex>
+#include <QDir>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QStringList>
+#include <QThread>
+
+#include <stdio.h>
+
+#include "processor.h"
+#include "profiler.h"
+#include "fft_plan_cache.h"
+#include "math_functions.h"
+
+// Working memory of one job relative to the response file size,
+// and fixed part for Processor, convolvers and FFT buffers, in MB
+#define BATCH_MEMORY_PER_FILE_BYTE 8
+#define BATCH_MEMORY_PER_JOB 64
+
+struct stBatchResult
+{
+  QString responseFileName;
+  QString profileFileName;
+  bool success;
+  QStringList warnings;
+  QStringList errors;
+  stProfilerQuality quality;
+};
+
+static QMutex outputMutex;
+
+static QJsonObject result_to_json(const stBatchResult &result)
+{
+  QJsonObject object;
+
+  object["response"] = result.responseFileName;
+  object["profile"] = result.profileFileName;
+  object["success"] = result.success;
+  object["warnings"] = QJsonArray::fromStringList(result.warnings);
+  object["errors"] = QJsonArray::fromStringList(result.errors);
+
+  if (result.success)
+  {
+    QJsonObject quality;
+    quality["bad_points"] = result.quality.badPointsCount;
+    quality["gain"] = result.quality.desiredGain;
+    quality["autoeq_residual_db"] = result.quality.autoEqResidualDb;
+
+    object["quality"] = quality;
+  }
+
+  return object;
+}
+
+// The same conversion as the Minimum Phase
+// button of the cabinet editor
+static void convert_cabinet_to_minimum_phase(Processor *processor)
+{
+  QVector<float> leftImpulse = processor->getLeftImpulse();
+  QVector<float> rightImpulse = processor->getRightImpulse();
+
+  int leftLength = minimum_phase_impulse_response(leftImpulse.data(),
+                                                  leftImpulse.size(), -60.0);
+  int rightLength = minimum_phase_impulse_response(rightImpulse.data(),
+                                                   rightImpulse.size(), -60.0);
+
+  // Both channels are processed by one stereo convolver
+  // and must have the same length
+  int newLength = qMax(leftLength, rightLength);
+
+  leftImpulse.resize(newLength);
+  rightImpulse.resize(newLength);
+
+  processor->setCabinetImpulse(leftImpulse, rightImpulse);
+}
+
+class BatchProfilerJob : public QRunnable
+{
+public:
+  QString responseFileName;
+  QString profileFileName;
+  ProfilerPresetType presetType;
+  int sampleRate;
+  bool minimumPhase;
+
+  QSemaphore *memorySemaphore;
+  int memoryCost;
+
+  stBatchResult *result;
+
+  void run() override
+  {
+    // Wait until enough of the memory budget is free
+    memorySemaphore->acquire(memoryCost);
+
+    result->responseFileName = responseFileName;
+    result->profileFileName = profileFileName;
+    result->success = false;
+
+    {
+      Processor processor(sampleRate);
+      processor.loadProfile(":/profiles/British Crunch.tapf");
+
+      Profiler profiler(&processor, nullptr);
+
+      // Jobs have no event loop, collect messages directly
+      QObject::connect(&profiler, &Profiler::warningMessageNeeded,
+                       [this](QString message) {result->warnings.append(message);});
+      QObject::connect(&profiler, &Profiler::errorMessageNeeded,
+                       [this](QString message) {result->errors.append(message);});
+
+      if (!profiler.loadResponseFile(responseFileName))
+      {
+        result->errors.append(QString("Unable to open response file"));
+      }
+      else if (profiler.analyze(presetType))
+      {
+        result->quality = profiler.getQuality();
+
+        if (minimumPhase)
+        {
+          convert_cabinet_to_minimum_phase(&processor);
+        }
+
+        if (processor.saveProfile(profileFileName))
+        {
+          result->success = true;
+        }
+        else
+        {
+          result->errors.append(QString("Unable to write profile file"));
+        }
+      }
+    }
+
+    memorySemaphore->release(memoryCost);
+
+    // One JSON object per line, as soon as the file is done
+    QMutexLocker locker(&outputMutex);
+
+    QByteArray line = QJsonDocument(result_to_json(*result)).toJson(QJsonDocument::Compact);
+    fprintf(stdout, "%s\n", line.constData());
+    fflush(stdout);
+  }
+};
+
+int main(int argc, char *argv[])
+{
+  QCoreApplication a(argc, argv);
+
+  QCoreApplication::setOrganizationName("Oleg Kapitonov");
+  QCoreApplication::setApplicationName("tubeAmp Designer");
+
+  QCommandLineParser parser;
+  parser.setApplicationDescription("Creates *.tapf profiles from response files");
+  parser.addHelpOption();
+  parser.addPositionalArgument("directory", "Directory with response *.wav files");
+
+  QCommandLineOption presetOption(QStringList() << "p" << "preset",
+    "Profile preset: clean, classic or mastergain (default classic)", "preset", "classic");
+  QCommandLineOption outputOption(QStringList() << "o" << "output",
+    "Directory for *.tapf files (default: input directory)", "directory");
+  QCommandLineOption jobsOption(QStringList() << "j" << "jobs",
+    "Number of files profiled at the same time", "jobs",
+    QString::number(QThread::idealThreadCount()));
+  QCommandLineOption memoryOption(QStringList() << "m" << "memory",
+    "Memory budget for all jobs in MB (default 2048)", "MB", "2048");
+  QCommandLineOption rateOption(QStringList() << "r" << "rate",
+    "Sample rate of the profiles (default 48000)", "rate", "48000");
+  QCommandLineOption reportOption(QStringList() << "report",
+    "JSON report file (default: report.json in output directory)", "file");
+  QCommandLineOption minimumPhaseOption(QStringList() << "minimum-phase",
+    "Convert cabinet impulse responses to minimum phase");
+
+  parser.addOption(presetOption);
+  parser.addOption(outputOption);
+  parser.addOption(jobsOption);
+  parser.addOption(memoryOption);
+  parser.addOption(rateOption);
+  parser.addOption(reportOption);
+  parser.addOption(minimumPhaseOption);
+
+  parser.process(a);
+
+  if (parser.positionalArguments().size() != 1)
+  {
+    parser.showHelp(2);
+  }
+
+  ProfilerPresetType presetType;
+  QString preset = parser.value(presetOption);
+
+  if (preset == "clean")
+  {
+    presetType = CRYSTALCLEAN_PRESET;
+  }
+  else if (preset == "classic")
+  {
+    presetType = CLASSIC_PRESET;
+  }
+  else if (preset == "mastergain")
+  {
+    presetType = MASTERGAIN_PRESET;
+  }
+  else
+  {
+    fprintf(stderr, "Unknown preset: %s\n", preset.toUtf8().constData());
+    return 2;
+  }
+
+  QDir inputDir(parser.positionalArguments().at(0));
+  if (!inputDir.exists())
+  {
+    fprintf(stderr, "Directory does not exist: %s\n",
+            inputDir.path().toUtf8().constData());
+    return 2;
+  }
+
+  QDir outputDir(parser.isSet(outputOption) ? parser.value(outputOption) : inputDir.path());
+  outputDir.mkpath(".");
+
+  QString reportFileName = parser.isSet(reportOption) ?
+    parser.value(reportOption) : outputDir.filePath("report.json");
+
+  int jobs = qMax(1, parser.value(jobsOption).toInt());
+  int memoryBudget = qMax(1, parser.value(memoryOption).toInt());
+  int sampleRate = parser.value(rateOption).toInt();
+
+  if (sampleRate <= 0)
+  {
+    fprintf(stderr, "Wrong sample rate\n");
+    return 2;
+  }
+
+  QFileInfoList responseFiles = inputDir.entryInfoList(QStringList() << "*.wav" << "*.WAV",
+                                                       QDir::Files, QDir::Name);
+
+  fft_plan_cache_load_wisdom();
+
+  QVector<stBatchResult> results(responseFiles.size());
+  QSemaphore memorySemaphore(memoryBudget);
+
+  QThreadPool pool;
+  pool.setMaxThreadCount(jobs);
+
+  for (int i = 0; i < responseFiles.size(); i++)
+  {
+    BatchProfilerJob *job = new BatchProfilerJob();
+
+    job->responseFileName = responseFiles[i].absoluteFilePath();
+    job->profileFileName = outputDir.filePath(responseFiles[i].completeBaseName() + ".tapf");
+    job->presetType = presetType;
+    job->sampleRate = sampleRate;
+    job->minimumPhase = parser.isSet(minimumPhaseOption);
+    job->memorySemaphore = &memorySemaphore;
+    job->result = &results[i];
+
+    // Jobs larger than the whole budget run alone
+    qint64 cost = responseFiles[i].size() * BATCH_MEMORY_PER_FILE_BYTE / (1024 * 1024) +
+      BATCH_MEMORY_PER_JOB;
+    job->memoryCost = qMin(cost, (qint64)memoryBudget);
+
+    pool.start(job);
+  }
+
+  pool.waitForDone();
+
+  fft_plan_cache_save_wisdom();
+  fft_plan_cache_clear();
+
+  // Report in file order regardless of completion order
+  QJsonArray reportFiles;
+  int failedCount = 0;
+
+  for (const stBatchResult &result : results)
+  {
+    reportFiles.append(result_to_json(result));
+
+    if (!result.success)
+    {
+      failedCount++;
+    }
+  }
+
+  QJsonObject report;
+  report["preset"] = preset;
+  report["sample_rate"] = sampleRate;
+  report["minimum_phase"] = parser.isSet(minimumPhaseOption);
+  report["files"] = reportFiles;
+  report["failed"] = failedCount;
+
+  QFile reportFile(reportFileName);
+  if (reportFile.open(QIODevice::WriteOnly))
+  {
+    reportFile.write(QJsonDocument(report).toJson());
+  }
+  else
+  {
+    fprintf(stderr, "Unable to write report: %s\n", reportFileName.toUtf8().constData());
+  }
+
+  return (failedCount == 0) ? 0 : 1;
+}
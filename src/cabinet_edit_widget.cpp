@@ -25,6 +25,7 @@
 #include <QLabel>
 #include <QFont>
 #include <QFileDialog>
+#include <QSettings>
 
 #include <cmath>
 
@@ -82,6 +83,14 @@ CabinetEditWidget::CabinetEditWidget(QWidget *parent, Processor *prc, Player *pl
 
   connect(autoEqButton, &QPushButton::clicked, this, &CabinetEditWidget::autoEqButtonClicked);
 
+  minimumPhaseButton = new QPushButton(tr("Minimum Phase"), equalizerButtonsBar);
+  minimumPhaseButton->setToolTip(tr("Convert cabinet impulse response to minimum phase\n"
+    "and cut its inaudible tail"));
+  equalizerButtonsHBox->addWidget(minimumPhaseButton);
+
+  connect(minimumPhaseButton, &QPushButton::clicked, this,
+    &CabinetEditWidget::minimumPhaseButtonClicked);
+
   equalizerButtonsHBox->addSpacing(40);
 
   disableButton = new QPushButton(equalizerButtonsBar);
@@ -100,6 +109,34 @@ CabinetEditWidget::CabinetEditWidget(QWidget *parent, Processor *prc, Player *pl
 
   connect(disableButton, &QPushButton::clicked, this, &CabinetEditWidget::disableButtonClicked);
 
+  QWidget *multirateBar = new QWidget(this);
+  vbox->addWidget(multirateBar);
+  multirateBar->setSizePolicy(QSizePolicy::Fixed, QSizePolicy::Fixed);
+
+  QHBoxLayout *multirateHBox = new QHBoxLayout(multirateBar);
+
+  multirateCheckBox = new QCheckBox(tr("Low-rate tail"), multirateBar);
+  multirateCheckBox->setToolTip(tr("Convolve the late part of cabinet impulse response\n"
+    "at decimated sample rate to reduce CPU load"));
+  multirateCheckBox->setChecked(processor->isCabinetMultirateEnabled());
+  multirateHBox->addWidget(multirateCheckBox);
+
+  QLabel *multirateHeadLabel = new QLabel(tr("Full-rate head"), multirateBar);
+  multirateHBox->addWidget(multirateHeadLabel);
+
+  multirateHeadSpinBox = new QSpinBox(multirateBar);
+  multirateHeadSpinBox->setRange(5, 200);
+  multirateHeadSpinBox->setSuffix(tr(" ms"));
+  multirateHeadSpinBox->setValue(processor->getCabinetMultirateHeadLength());
+  multirateHBox->addWidget(multirateHeadSpinBox);
+
+  multirateErrorLabel = new QLabel(multirateBar);
+  multirateHBox->addWidget(multirateErrorLabel);
+
+  connect(multirateCheckBox, &QCheckBox::toggled, this, &CabinetEditWidget::multirateChanged);
+  connect(multirateHeadSpinBox, &QSpinBox::editingFinished,
+    this, &CabinetEditWidget::multirateChanged);
+
   equalizer = new EqualizerWidget(this);
   vbox->addWidget(equalizer);
 
@@ -157,6 +194,8 @@ void CabinetEditWidget::recalculate()
 
   QVector<float> frequencyResponse = processor->getCabinetSumFrequencyResponse(freqs);
 
+  updateMultirateErrorLabel();
+
   equalizer->fLogValuesFr.resize(frequencyResponse.size());
   equalizer->dbValuesFr.resize(frequencyResponse.size());
 
@@ -170,6 +209,38 @@ void CabinetEditWidget::recalculate()
   equalizer->update(0,0,width(),height());
 }
 
+void CabinetEditWidget::multirateChanged()
+{
+  processor->setCabinetMultirate(multirateCheckBox->isChecked(),
+                                 multirateHeadSpinBox->value());
+
+  QSettings settings;
+  settings.setValue("cabinet/multirate", multirateCheckBox->isChecked());
+  settings.setValue("cabinet/multirateHeadLength", multirateHeadSpinBox->value());
+
+  updateMultirateErrorLabel();
+}
+
+void CabinetEditWidget::updateMultirateErrorLabel()
+{
+  double errorDb = processor->getCabinetMultirateErrorDb();
+
+  multirateHeadSpinBox->setEnabled(multirateCheckBox->isChecked());
+
+  if (!multirateCheckBox->isChecked())
+  {
+    multirateErrorLabel->clear();
+  }
+  else if (std::isinf(errorDb))
+  {
+    multirateErrorLabel->setText(tr("Full rate at this sample rate"));
+  }
+  else
+  {
+    multirateErrorLabel->setText(tr("Error: %1 dB").arg(errorDb, 0, 'f', 1));
+  }
+}
+
 void CabinetEditWidget::responseChanged()
 {
   processor->correctionEqualizerFLogValues = equalizer->fLogValuesEq;
@@ -214,7 +285,7 @@ void CabinetEditWidget::autoEqButtonClicked()
 {
   msg->setProgressValue(0);
 
-  if (player->refDataL.size() != 0)
+  if ((player->refDataL.size() != 0) && (player->diData.size() != 0))
   {
     msg->setMessage(tr("Analyzing..."));
     msg->setTitle(tr("Please Wait!"));
@@ -229,6 +300,46 @@ void CabinetEditWidget::autoEqButtonClicked()
   }
 }
 
+void CabinetEditWidget::minimumPhaseButtonClicked()
+{
+  QVector<float> leftImpulse = processor->getLeftImpulse();
+  QVector<float> rightImpulse = processor->getRightImpulse();
+
+  int oldLength = leftImpulse.size();
+  int oldPeakPosition = find_peak_position(leftImpulse.data(), leftImpulse.size());
+
+  int leftLength = minimum_phase_impulse_response(leftImpulse.data(),
+                                                  leftImpulse.size(), -60.0);
+  int rightLength = minimum_phase_impulse_response(rightImpulse.data(),
+                                                   rightImpulse.size(), -60.0);
+
+  // Both channels are processed by one stereo convolver
+  // and must have the same length
+  int newLength = qMax(leftLength, rightLength);
+
+  leftImpulse.resize(newLength);
+  rightImpulse.resize(newLength);
+
+  int newPeakPosition = find_peak_position(leftImpulse.data(), leftImpulse.size());
+
+  processor->setCabinetImpulse(leftImpulse, rightImpulse);
+  recalculate();
+
+  // Convolver CPU load is approximately
+  // proportional to the impulse response length
+  float samplesInMs = processor->getSamplingRate() / 1000.0;
+
+  QMessageBox::information(this, tr("Minimum Phase"),
+    QString(tr("Impulse response length: %1 ms -> %2 ms\n"
+               "Impulse response peak: %3 ms -> %4 ms\n"
+               "Cabinet convolver CPU load reduced by ~%5%"))
+      .arg(oldLength / samplesInMs, 0, 'f', 1)
+      .arg(newLength / samplesInMs, 0, 'f', 1)
+      .arg(oldPeakPosition / samplesInMs, 0, 'f', 2)
+      .arg(newPeakPosition / samplesInMs, 0, 'f', 2)
+      .arg(100.0 * (1.0 - (double)newLength / oldLength), 0, 'f', 0));
+}
+
 void CabinetEditWidget::autoEqThreadFinished()
 {
   msg->setProgressValue(100);
@@ -371,7 +482,7 @@ void AutoEqThread::run()
     diData[i] = player->diData[i];
   }
 
-  QVector<double> refData(player->refDataL.size());
+  QVector<float> refData(player->refDataL.size());
 
   for (int i = 0; i < refData.size(); i++)
   {
@@ -382,15 +493,7 @@ void AutoEqThread::run()
   QVector<float> floatProcessedDataR(diData.size());
 
   QSharedPointer<Processor> backProcessor
-    = QSharedPointer<Processor>(new Processor(processor->getSamplingRate()));
-
-  backProcessor->loadProfile(processor->getProfileFileName());
-
-  backProcessor->setControls(processor->getControls());
-  backProcessor->setProfile(processor->getProfile());
-
-  backProcessor->setPreampImpulse(processor->getPreampImpulse());
-  backProcessor->setCabinetImpulse(processor->getLeftImpulse(), processor->getRightImpulse());
+    = QSharedPointer<Processor>(processor->clone());
 
   QVector<double> w(processor->preampCorrectionEqualizerFLogValues.size());
   QVector<double> A(processor->preampCorrectionEqualizerFLogValues.size());
@@ -410,7 +513,7 @@ void AutoEqThread::run()
 
   emit progressChanged(30);
 
-  QVector<double> processedData(floatProcessedDataL.size());
+  QVector<float> processedData(floatProcessedDataL.size());
 
   for (int i = 0; i < floatProcessedDataL.size(); i++)
   {
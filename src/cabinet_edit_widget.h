@@ -23,6 +23,9 @@
 #include <QtWidgets/QWidget>
 #include <QPushButton>
 #include <QMessageBox>
+#include <QCheckBox>
+#include <QSpinBox>
+#include <QLabel>
 
 #include "block_edit_widget.h"
 #include "processor.h"
@@ -63,8 +66,13 @@ private:
   QPushButton *resetButton;
   QPushButton *applyButton;
   QPushButton *autoEqButton;
+  QPushButton *minimumPhaseButton;
   QPushButton *disableButton;
 
+  QCheckBox *multirateCheckBox;
+  QSpinBox *multirateHeadSpinBox;
+  QLabel *multirateErrorLabel;
+
   Processor *processor;
   Player *player;
   EqualizerWidget *equalizer;
@@ -78,14 +86,18 @@ private:
   virtual void recalculate();
   virtual void resetControls();
 
+  void updateMultirateErrorLabel();
+
 public slots:
   void responseChanged();
   void applyButtonClicked();
   void resetButtonClicked();
   void autoEqButtonClicked();
+  void minimumPhaseButtonClicked();
   void saveButtonClicked();
   void loadButtonClicked();
   void disableButtonClicked();
+  void multirateChanged();
 
   void autoEqThreadFinished();
 
@@ -89,6 +89,9 @@ CentralWidget::CentralWidget(QWidget *parent, Processor *prc, Player *plr) :
   connect(player, &Player::peakRMSValueCalculated, tubeAmpPanel,
     &TubeAmpPanel::peakRMSValueChanged);
 
+  connect(player, &Player::loudnessCalculated, tubeAmpPanel,
+    &TubeAmpPanel::loudnessValueChanged);
+
   centralArea->installEventFilter(this);
 }
 
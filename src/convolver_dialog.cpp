@@ -21,12 +21,68 @@
 #include <QHBoxLayout>
 #include <QLabel>
 #include <QFileDialog>
+#include <QMessageBox>
+#include <QTemporaryFile>
+#include <QDir>
 
 #include <sndfile.h>
 #include <cmath>
 
+#include <zita-resampler/resampler.h>
+
 #include "convolver_dialog.h"
 #include "math_functions.h"
+#include "fft_plan_cache.h"
+#include "spectral_kernels.h"
+
+// Loads sound file, first channel goes to dataL,
+// mean of other channels goes to dataR
+static bool load_stereo_file(QString fileName,
+                             QVector<float> &dataL,
+                             QVector<float> &dataR,
+                             int *sampleRate)
+{
+  SF_INFO sfinfo;
+  sfinfo.format = 0;
+
+  SNDFILE *sndFile = sf_open(fileName.toUtf8().constData(), SFM_READ, &sfinfo);
+  if (sndFile == NULL)
+  {
+    return false;
+  }
+
+  *sampleRate = sfinfo.samplerate;
+
+  QVector<float> tempBuffer(sfinfo.frames * sfinfo.channels);
+  sf_readf_float(sndFile, tempBuffer.data(), sfinfo.frames);
+
+  sf_close(sndFile);
+
+  dataL.resize(sfinfo.frames);
+  dataR.resize(sfinfo.frames);
+
+  for (int i = 0; i < sfinfo.frames * sfinfo.channels; i += sfinfo.channels)
+  {
+    float sumFrame = 0.0;
+    if (sfinfo.channels > 1)
+    {
+      for (int j = 1; j < sfinfo.channels; j++)
+      {
+        sumFrame += tempBuffer[i + j];
+      }
+      sumFrame /= sfinfo.channels - 1;
+      dataL[i / sfinfo.channels] = tempBuffer[i];
+      dataR[i / sfinfo.channels] = sumFrame;
+    }
+    else
+    {
+      dataL[i] = tempBuffer[i];
+      dataR[i] = tempBuffer[i];
+    }
+  }
+
+  return true;
+}
 
 ConvolverDialog::ConvolverDialog(Processor *prc, QWidget *parent) : QDialog(parent)
 {
@@ -121,6 +177,22 @@ ConvolverDialog::ConvolverDialog(Processor *prc, QWidget *parent) : QDialog(pare
 
   connect(closeButton, &QPushButton::clicked, this,
     &ConvolverDialog::closeButtonClicked);
+
+  convolverThread = new ConvolverThread(this);
+
+  connect(convolverThread, &QThread::finished, this,
+    &ConvolverDialog::convolverThreadFinished);
+  connect(convolverThread, &ConvolverThread::progressChanged,
+    this, &ConvolverDialog::convolverThreadProgressChanged);
+
+  msg = new MessageWidget(this);
+}
+
+// Thread is deleted with the dialog,
+// convolution in progress is finished first
+ConvolverDialog::~ConvolverDialog()
+{
+  convolverThread->wait();
 }
 
 void ConvolverDialog::inputFilenameButtonClicked()
@@ -168,52 +240,31 @@ void ConvolverDialog::processButtonClicked()
   QString outputFileName = outputFilenameEdit->text();
   QString IRFileName = IRFilenameEdit->text();
 
+  // File to file convolution runs in background
+  // and does not load the whole input file
+  if (inputFileRadioButton->isChecked() && outputFileRadioButton->isChecked())
+  {
+    convolverThread->inputFileName = inputFileName;
+    convolverThread->outputFileName = outputFileName;
+    convolverThread->IRFileName = IRFileName;
+
+    msg->setProgressValue(0);
+    msg->setMessage(tr("Convolving..."));
+    msg->setTitle(tr("Please Wait!"));
+    msg->open();
+
+    convolverThread->start();
+    return;
+  }
+
   QVector<float> inputL;
   QVector<float> inputR;
 
   int inputSampleRate;
 
-  SF_INFO sfinfo;
-  SNDFILE *sndFile;
-
   if (inputFileRadioButton->isChecked())
   {
-    sfinfo.format = 0;
-
-    sndFile = sf_open(inputFileName.toUtf8().constData(), SFM_READ, &sfinfo);
-    if (sndFile != NULL)
-    {
-      inputSampleRate = sfinfo.samplerate;
-
-      QVector<float> tempBuffer(sfinfo.frames * sfinfo.channels);
-      sf_readf_float(sndFile, tempBuffer.data(), sfinfo.frames);
-
-      sf_close(sndFile);
-
-      inputL.resize(sfinfo.frames);
-      inputR.resize(sfinfo.frames);
-
-      for (int i = 0; i < sfinfo.frames * sfinfo.channels; i += sfinfo.channels)
-      {
-        float sumFrame = 0.0;
-        if (sfinfo.channels > 1)
-        {
-          for (int j = 1; j < sfinfo.channels; j++)
-          {
-            sumFrame += tempBuffer[i + j];
-          }
-          sumFrame /= sfinfo.channels - 1;
-          inputL[i / sfinfo.channels] = tempBuffer[i];
-          inputR[i / sfinfo.channels] = sumFrame;
-        }
-        else
-        {
-          inputL[i] = tempBuffer[i];
-          inputR[i] = tempBuffer[i];
-        }
-      }
-    }
-    else
+    if (!load_stereo_file(inputFileName, inputL, inputR, &inputSampleRate))
     {
       return;
     }
@@ -225,47 +276,12 @@ void ConvolverDialog::processButtonClicked()
     inputSampleRate = processor->getSamplingRate();
   }
 
-  sfinfo.format = 0;
-
   QVector<float> IRL;
   QVector<float> IRR;
 
   int IRSampleRate;
 
-  sndFile = sf_open(IRFileName.toUtf8().constData(), SFM_READ, &sfinfo);
-  if (sndFile != NULL)
-  {
-    IRSampleRate = sfinfo.samplerate;
-
-    QVector<float> tempBuffer(sfinfo.frames * sfinfo.channels);
-    sf_readf_float(sndFile, tempBuffer.data(), sfinfo.frames);
-
-    sf_close(sndFile);
-
-    IRL.resize(sfinfo.frames);
-    IRR.resize(sfinfo.frames);
-
-    for (int i = 0; i < sfinfo.frames * sfinfo.channels; i += sfinfo.channels)
-    {
-      float sumFrame = 0.0;
-      if (sfinfo.channels > 1)
-      {
-        for (int j = 1; j < sfinfo.channels; j++)
-        {
-          sumFrame += tempBuffer[i + j];
-        }
-        sumFrame /= sfinfo.channels - 1;
-        IRL[i / sfinfo.channels] = tempBuffer[i];
-        IRR[i / sfinfo.channels] = sumFrame;
-      }
-      else
-      {
-        IRL[i] = tempBuffer[i];
-        IRR[i] = tempBuffer[i];
-      }
-    }
-  }
-  else
+  if (!load_stereo_file(IRFileName, IRL, IRR, &IRSampleRate))
   {
     return;
   }
@@ -293,11 +309,13 @@ void ConvolverDialog::processButtonClicked()
     loadedCabinetImpulseEnergy += pow(inputL[i], 2);
   }
 
+  // Input files may be minutes long,
+  // single precision is enough here
   fft_convolver(inputL.data(), inputL.size(),
-    IRL.data(), IRL.size());
+    IRL.data(), IRL.size(), FFT_PRECISION_FLOAT);
 
   fft_convolver(inputR.data(), inputR.size(),
-    IRR.data(), IRR.size());
+    IRR.data(), IRR.size(), FFT_PRECISION_FLOAT);
 
   float cabinetImpulseEnergy = 0.0;
 
@@ -317,6 +335,8 @@ void ConvolverDialog::processButtonClicked()
 
   if (outputFileRadioButton->isChecked())
   {
+    SF_INFO sfinfo;
+
     sfinfo.format = SF_FORMAT_WAV | SF_FORMAT_PCM_16;
     sfinfo.frames = inputL.size();
     sfinfo.samplerate = outputSampleRate;
@@ -347,6 +367,23 @@ void ConvolverDialog::processButtonClicked()
   }
 }
 
+void ConvolverDialog::convolverThreadFinished()
+{
+  msg->setProgressValue(100);
+  msg->close();
+
+  if (!convolverThread->success)
+  {
+    QMessageBox::critical(this, tr("Error!"),
+      tr("Unable to process files!"));
+  }
+}
+
+void ConvolverDialog::convolverThreadProgressChanged(int progress)
+{
+  msg->setProgressValue(progress);
+}
+
 void ConvolverDialog::closeButtonClicked()
 {
   close();
@@ -397,3 +434,415 @@ void ConvolverDialog::checkSignals()
     processButton->setEnabled(false);
   }
 }
+
+// One channel of overlap-add convolver.
+// Each block of blockSize input samples is convolved
+// with impulse response by FFT of fftSize,
+// tail of the result is added to the following blocks
+struct OverlapAddChannel
+{
+  int fftSize;
+  int blockSize;
+
+  QVector<s_fftwf_complex> IRSpectrum;
+  QVector<s_fftwf_complex> spectrum;
+  QVector<float> buffer;
+  QVector<float> overlap;
+};
+
+static void overlap_add_init(OverlapAddChannel *channel, QVector<float> IR)
+{
+  // FFT size is at least twice IR length,
+  // so each FFT produces at least IR length of output
+  channel->fftSize = 4096;
+  while (channel->fftSize < IR.size() * 2)
+  {
+    channel->fftSize *= 2;
+  }
+
+  channel->blockSize = channel->fftSize - IR.size() + 1;
+
+  channel->buffer.fill(0.0, channel->fftSize);
+  channel->overlap.fill(0.0, channel->fftSize);
+  channel->spectrum.resize(channel->fftSize / 2 + 1);
+  channel->IRSpectrum.resize(channel->fftSize / 2 + 1);
+
+  for (int i = 0; i < IR.size(); i++)
+  {
+    channel->buffer[i] = IR[i] / channel->fftSize;
+  }
+
+  fft_r2c(channel->fftSize, channel->buffer.data(),
+    (float (*)[2])channel->IRSpectrum.data());
+}
+
+// Convolves n_count <= blockSize samples of input,
+// writes n_count samples to output
+static void overlap_add_process(OverlapAddChannel *channel,
+                                const float input[],
+                                float output[],
+                                int n_count)
+{
+  float *buffer = channel->buffer.data();
+  float *overlap = channel->overlap.data();
+
+  for (int i = 0; i < n_count; i++)
+  {
+    buffer[i] = input[i];
+  }
+
+  for (int i = n_count; i < channel->fftSize; i++)
+  {
+    buffer[i] = 0.0;
+  }
+
+  fft_r2c(channel->fftSize, buffer, (float (*)[2])channel->spectrum.data());
+
+  spectrum_mul(channel->spectrum.data(), channel->IRSpectrum.data(),
+    channel->spectrum.data(), channel->spectrum.size());
+
+  fft_c2r(channel->fftSize, (float (*)[2])channel->spectrum.data(), buffer);
+
+  for (int i = 0; i < channel->fftSize; i++)
+  {
+    overlap[i] += buffer[i];
+  }
+
+  for (int i = 0; i < n_count; i++)
+  {
+    output[i] = overlap[i];
+  }
+
+  // Shift remaining tail to the beginning
+  for (int i = n_count; i < channel->fftSize; i++)
+  {
+    overlap[i - n_count] = overlap[i];
+  }
+
+  for (int i = channel->fftSize - n_count; i < channel->fftSize; i++)
+  {
+    overlap[i] = 0.0;
+  }
+}
+
+ConvolverThread::ConvolverThread(QObject *parent) : QThread(parent)
+{
+}
+
+void ConvolverThread::run()
+{
+  success = false;
+
+  QVector<float> IRL;
+  QVector<float> IRR;
+
+  int IRSampleRate;
+
+  if (!load_stereo_file(IRFileName, IRL, IRR, &IRSampleRate))
+  {
+    return;
+  }
+
+  SF_INFO inputInfo;
+  inputInfo.format = 0;
+
+  SNDFILE *inputFile = sf_open(inputFileName.toUtf8().constData(),
+    SFM_READ, &inputInfo);
+
+  if (inputFile == NULL)
+  {
+    return;
+  }
+
+  int inputSampleRate = inputInfo.samplerate;
+
+  int outputSampleRate;
+
+  if (inputSampleRate >= IRSampleRate)
+  {
+    outputSampleRate = inputSampleRate;
+  }
+  else
+  {
+    outputSampleRate = IRSampleRate;
+  }
+
+  IRL = resample_vector(IRL, IRSampleRate, outputSampleRate);
+  IRR = resample_vector(IRR, IRSampleRate, outputSampleRate);
+
+  OverlapAddChannel channelL;
+  OverlapAddChannel channelR;
+
+  overlap_add_init(&channelL, IRL);
+  overlap_add_init(&channelR, IRR);
+
+  int blockSize = channelL.blockSize;
+
+  // Convolved signal is written to temporary file first,
+  // final gain is known only after the whole file is processed
+  QTemporaryFile tempFile(QDir::tempPath() + "/tAD_convolver_XXXXXX.w64");
+  if (!tempFile.open())
+  {
+    sf_close(inputFile);
+    return;
+  }
+
+  QByteArray tempFileName = tempFile.fileName().toUtf8();
+
+  SF_INFO tempInfo;
+  tempInfo.format = SF_FORMAT_W64 | SF_FORMAT_FLOAT;
+  tempInfo.samplerate = outputSampleRate;
+  tempInfo.channels = 2;
+
+  SNDFILE *convolvedFile = sf_open(tempFileName.constData(), SFM_WRITE, &tempInfo);
+
+  if (convolvedFile == NULL)
+  {
+    sf_close(inputFile);
+    return;
+  }
+
+  // Resampler works on interleaved stereo frames
+  double ratio = (double)outputSampleRate / inputSampleRate;
+  bool needResampling = (inputSampleRate != outputSampleRate);
+
+  Resampler resampler;
+  if (needResampling)
+  {
+    resampler.setup(inputSampleRate, outputSampleRate, 2, 48);
+  }
+
+  sf_count_t outputFrames = inputInfo.frames;
+  if (needResampling)
+  {
+    outputFrames = inputInfo.frames * ratio;
+  }
+
+  int readBlockSize = 16384;
+
+  QVector<float> readBuffer(readBlockSize * inputInfo.channels);
+  QVector<float> stereoBuffer(readBlockSize * 2);
+  QVector<float> resampledBuffer(readBlockSize * 2);
+
+  // Resampled stereo frames waiting for convolution
+  QVector<float> pendingL;
+  QVector<float> pendingR;
+
+  pendingL.reserve(blockSize + readBlockSize * ratio + 1024);
+  pendingR.reserve(blockSize + readBlockSize * ratio + 1024);
+
+  // Passes input frames (zeros if data is nullptr)
+  // through the resampler to pending buffers
+  auto resample = [&](float *data, int count)
+  {
+    resampler.inp_count = count;
+    resampler.inp_data = data;
+
+    while (resampler.inp_count > 0)
+    {
+      resampler.out_count = resampledBuffer.size() / 2;
+      resampler.out_data = resampledBuffer.data();
+      resampler.process();
+
+      int resampledCount = resampledBuffer.size() / 2 - resampler.out_count;
+
+      for (int i = 0; i < resampledCount; i++)
+      {
+        pendingL.append(resampledBuffer[i * 2] / ratio);
+        pendingR.append(resampledBuffer[i * 2 + 1] / ratio);
+      }
+    }
+  };
+
+  // Padding before signal, the same as in resample_vector()
+  if (needResampling)
+  {
+    resample(nullptr, resampler.inpsize() / 2 - 1);
+  }
+
+  QVector<float> outputL(blockSize);
+  QVector<float> outputR(blockSize);
+  QVector<float> writeBuffer(blockSize * 2);
+
+  sf_count_t framesRead = 0;
+  sf_count_t framesWritten = 0;
+
+  double inputEnergy = 0.0;
+  double outputEnergy = 0.0;
+
+  int lastProgress = -1;
+
+  bool inputFinished = false;
+
+  while (framesWritten < outputFrames)
+  {
+    // Read and resample next part of input
+    if (!inputFinished)
+    {
+      sf_count_t count = sf_readf_float(inputFile, readBuffer.data(), readBlockSize);
+      framesRead += count;
+
+      for (int i = 0; i < count; i++)
+      {
+        float *frame = readBuffer.data() + i * inputInfo.channels;
+
+        if (inputInfo.channels > 1)
+        {
+          float sumFrame = 0.0;
+          for (int j = 1; j < inputInfo.channels; j++)
+          {
+            sumFrame += frame[j];
+          }
+          stereoBuffer[i * 2] = frame[0];
+          stereoBuffer[i * 2 + 1] = sumFrame / (inputInfo.channels - 1);
+        }
+        else
+        {
+          stereoBuffer[i * 2] = frame[0];
+          stereoBuffer[i * 2 + 1] = frame[0];
+        }
+      }
+
+      if (count < readBlockSize)
+      {
+        inputFinished = true;
+      }
+
+      if (needResampling)
+      {
+        resample(stereoBuffer.data(), count);
+
+        // Padding after signal
+        if (inputFinished)
+        {
+          resample(nullptr, resampler.inpsize() - 1);
+        }
+      }
+      else
+      {
+        for (int i = 0; i < count; i++)
+        {
+          pendingL.append(stereoBuffer[i * 2]);
+          pendingR.append(stereoBuffer[i * 2 + 1]);
+        }
+      }
+    }
+
+    // Convolve all complete blocks,
+    // the rest of input after the end of file
+    while ((pendingL.size() >= blockSize) ||
+           (inputFinished && (framesWritten < outputFrames)))
+    {
+      int n_count = qMin(blockSize, pendingL.size());
+      n_count = qMin((sf_count_t)n_count, outputFrames - framesWritten);
+
+      if (n_count <= 0)
+      {
+        break;
+      }
+
+      for (int i = 0; i < n_count; i++)
+      {
+        inputEnergy += pendingL[i] * pendingL[i];
+      }
+
+      // Channels are processed in parallel on the shared thread pool
+      parallel_for(2, [&](int channel)
+      {
+        if (channel == 0)
+        {
+          overlap_add_process(&channelL, pendingL.constData(), outputL.data(), n_count);
+        }
+        else
+        {
+          overlap_add_process(&channelR, pendingR.constData(), outputR.data(), n_count);
+        }
+      });
+
+      for (int i = 0; i < n_count; i++)
+      {
+        outputEnergy += outputL[i] * outputL[i];
+
+        writeBuffer[i * 2] = outputL[i];
+        writeBuffer[i * 2 + 1] = outputR[i];
+      }
+
+      sf_writef_float(convolvedFile, writeBuffer.data(), n_count);
+      framesWritten += n_count;
+
+      pendingL.remove(0, n_count);
+      pendingR.remove(0, n_count);
+    }
+
+    if (inputFinished && pendingL.isEmpty())
+    {
+      break;
+    }
+
+    int progress = 90 * framesRead / qMax((sf_count_t)1, inputInfo.frames);
+    if (progress != lastProgress)
+    {
+      lastProgress = progress;
+      emit progressChanged(progress);
+    }
+  }
+
+  sf_close(inputFile);
+  sf_close(convolvedFile);
+
+  // Output signal has the same energy as input signal
+  float gain = 1.0;
+  if (outputEnergy > 0.0)
+  {
+    gain = sqrt(inputEnergy) / sqrt(outputEnergy);
+  }
+
+  SF_INFO outputInfo;
+  outputInfo.format = SF_FORMAT_WAV | SF_FORMAT_PCM_16;
+  outputInfo.samplerate = outputSampleRate;
+  outputInfo.channels = 2;
+  outputInfo.sections = 1;
+  outputInfo.seekable = 1;
+
+  SNDFILE *outputFile = sf_open(outputFileName.toUtf8().constData(),
+    SFM_WRITE, &outputInfo);
+
+  if (outputFile == NULL)
+  {
+    return;
+  }
+
+  tempInfo.format = 0;
+  convolvedFile = sf_open(tempFileName.constData(), SFM_READ, &tempInfo);
+
+  if (convolvedFile == NULL)
+  {
+    sf_close(outputFile);
+    return;
+  }
+
+  sf_count_t framesCopied = 0;
+  while (framesCopied < framesWritten)
+  {
+    sf_count_t count = sf_readf_float(convolvedFile, writeBuffer.data(), blockSize);
+    if (count <= 0)
+    {
+      break;
+    }
+
+    for (int i = 0; i < count * 2; i++)
+    {
+      writeBuffer[i] *= gain;
+    }
+
+    sf_writef_float(outputFile, writeBuffer.data(), count);
+    framesCopied += count;
+
+    emit progressChanged(90 + 10 * framesCopied / framesWritten);
+  }
+
+  sf_close(outputFile);
+  sf_close(convolvedFile);
+
+  success = true;
+}
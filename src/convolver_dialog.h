@@ -25,8 +25,32 @@
 #include <QLineEdit>
 #include <QRadioButton>
 #include <QButtonGroup>
+#include <QThread>
 
 #include "processor.h"
+#include "message_widget.h"
+
+// Convolves input file with impulse response
+// block by block (overlap-add), so memory usage
+// does not depend on input file length
+class ConvolverThread : public QThread
+{
+  Q_OBJECT
+
+  void run() override;
+
+public:
+  ConvolverThread(QObject *parent = nullptr);
+
+  QString inputFileName;
+  QString outputFileName;
+  QString IRFileName;
+
+  bool success;
+
+signals:
+  void progressChanged(int progress);
+};
 
 class ConvolverDialog : public QDialog
 {
@@ -34,6 +58,7 @@ class ConvolverDialog : public QDialog
 
 public:
   ConvolverDialog(Processor *prc, QWidget *parent = nullptr);
+  ~ConvolverDialog();
 
 private:
   Processor *processor;
@@ -52,6 +77,9 @@ private:
   QRadioButton *outputCabinetRadioButton;
   QRadioButton *outputFileRadioButton;
 
+  ConvolverThread *convolverThread;
+  MessageWidget *msg;
+
   void checkSignals();
 
 public slots:
@@ -63,6 +91,9 @@ public slots:
 
   void outputGroupClicked(QAbstractButton *button);
   void inputGroupClicked(QAbstractButton *button);
+
+  void convolverThreadFinished();
+  void convolverThreadProgressChanged(int progress);
 };
 
 #endif // CONVOLVERDIALOG_H
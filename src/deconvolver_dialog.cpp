@@ -21,13 +21,57 @@
 #include <QHBoxLayout>
 #include <QLabel>
 #include <QFileDialog>
+#include <QMessageBox>
 
 #include <sndfile.h>
 #include <cmath>
+#include <algorithm>
 
 #include "deconvolver_dialog.h"
 #include "math_functions.h"
 
+// Exponential sweep written by "Create test signal",
+// it sweeps up to the Nyquist frequency of the file
+#define TEST_SWEEP_LENGTH_SEC 10.0
+#define TEST_SWEEP_START_FREQUENCY 20.0
+#define TEST_SWEEP_AMPLITUDE 0.5
+// Silence after each repeated sweep, holds the response tail
+#define TEST_SWEEP_GAP_SEC 1.0
+// Max misalignment of repeated takes in the response
+#define TAKE_ALIGN_MAX_LAG_SEC 0.05
+
+enum DeconvolutionMethod {DECONVOLUTION_DIVISION, DECONVOLUTION_INVERSE_SWEEP};
+
+// Checks that signal consists of n_takes identical repetitions
+static bool is_repeated_signal(const QVector<float> &signal, int n_takes, int period)
+{
+  if ((n_takes < 2) || ((qint64)n_takes * period > signal.size() + period / 100))
+  {
+    return false;
+  }
+
+  float peak = 0.0;
+  for (int i = 0; i < period; i++)
+  {
+    peak = qMax(peak, qAbs(signal[i]));
+  }
+
+  // Repetitions are compared away from the edges
+  // where resampling filter differs
+  for (int take = 1; take < n_takes; take++)
+  {
+    for (int i = period / 100; i < period - period / 100; i++)
+    {
+      if (qAbs(signal[take * period + i] - signal[i]) > 0.01 * peak)
+      {
+        return false;
+      }
+    }
+  }
+
+  return true;
+}
+
 DeconvolverDialog::DeconvolverDialog(Processor *prc, QWidget *parent) : QDialog(parent)
 {
   processor = prc;
@@ -36,11 +80,28 @@ DeconvolverDialog::DeconvolverDialog(Processor *prc, QWidget *parent) : QDialog(
 
   QGridLayout *lay = new QGridLayout(this);
 
-  QPushButton *saveTestSignalButton = new QPushButton(tr("Create test signal .wav"), this);
-  lay->addWidget(saveTestSignalButton, 0, 0, 1, 2);
+  QWidget *testSignalContainer = new QWidget(this);
+  lay->addWidget(testSignalContainer, 0, 0, 1, 2);
+
+  QHBoxLayout *testSignalLay = new QHBoxLayout(testSignalContainer);
+  testSignalLay->setContentsMargins(0, 0, 0, 0);
+
+  QPushButton *saveTestSignalButton = new QPushButton(tr("Create test signal .wav"),
+                                                      testSignalContainer);
+  testSignalLay->addWidget(saveTestSignalButton, 1);
   connect(saveTestSignalButton, &QPushButton::clicked, this,
     &DeconvolverDialog::saveTestSignalButtonClicked);
 
+  // Repeated sweeps are averaged by the deconvolver,
+  // each doubling of takes lowers noise by 3 dB
+  QLabel *takesLabel = new QLabel(tr("Sweeps"), testSignalContainer);
+  testSignalLay->addWidget(takesLabel);
+
+  takesSpinBox = new QSpinBox(testSignalContainer);
+  takesSpinBox->setRange(1, 16);
+  takesSpinBox->setValue(1);
+  testSignalLay->addWidget(takesSpinBox);
+
   QLabel *testLabel = new QLabel(tr("Test Signal"), this);
   lay->addWidget(testLabel, 1, 0, 1, 2);
   testLabel->setAlignment(Qt::AlignCenter);
@@ -94,8 +155,42 @@ DeconvolverDialog::DeconvolverDialog(Processor *prc, QWidget *parent) : QDialog(
   connect(IRFilenameButton, &QPushButton::clicked,
     this, &DeconvolverDialog::IRFilenameButtonClicked);
 
+  methodComboBox = new QComboBox(this);
+  methodComboBox->addItem(tr("Spectrum division (any test signal)"),
+                          DECONVOLUTION_DIVISION);
+  methodComboBox->addItem(tr("Inverse sweep (created test signal only)"),
+                          DECONVOLUTION_INVERSE_SWEEP);
+  lay->addWidget(methodComboBox, 9, 0, 1, 2);
+
+  QWidget *regularizationContainer = new QWidget(this);
+  lay->addWidget(regularizationContainer, 10, 0, 1, 2);
+
+  QHBoxLayout *regularizationLay = new QHBoxLayout(regularizationContainer);
+  regularizationLay->setContentsMargins(0, 0, 0, 0);
+
+  QLabel *regularizationLabel = new QLabel(tr("Regularization"), regularizationContainer);
+  regularizationLay->addWidget(regularizationLabel);
+
+  // Test signal level below which its spectrum is not inverted,
+  // higher values give less noise but narrower band
+  regularizationSpinBox = new QDoubleSpinBox(regularizationContainer);
+  regularizationSpinBox->setRange(-120.0, 0.0);
+  regularizationSpinBox->setSingleStep(5.0);
+  regularizationSpinBox->setDecimals(0);
+  regularizationSpinBox->setSuffix(tr(" dB"));
+  regularizationSpinBox->setValue(-60.0);
+  regularizationLay->addWidget(regularizationSpinBox);
+  regularizationLay->addStretch();
+
+  connect(methodComboBox, QOverload<int>::of(&QComboBox::currentIndexChanged),
+    this, &DeconvolverDialog::methodChanged);
+  methodComboBox->setCurrentIndex(1);
+
+  minimumPhaseCheckBox = new QCheckBox(tr("Convert to minimum phase"), this);
+  lay->addWidget(minimumPhaseCheckBox, 11, 0, 1, 2);
+
   QWidget *buttonsContainer = new QWidget(this);
-  lay->addWidget(buttonsContainer, 9, 0, 1, 2);
+  lay->addWidget(buttonsContainer, 12, 0, 1, 2);
 
   QHBoxLayout *containerLay = new QHBoxLayout(buttonsContainer);
   processButton = new QPushButton(tr("Process"), buttonsContainer);
@@ -268,30 +363,103 @@ void DeconvolverDialog::processButtonClicked()
   responseL = resample_vector(responseL, responseSampleRate, IRSampleRate);
   responseR = resample_vector(responseR, responseSampleRate, IRSampleRate);
 
+  // Response to repeated sweeps is averaged into one take,
+  // test signal is reduced to its first take
+  int takePeriod = (TEST_SWEEP_LENGTH_SEC + TEST_SWEEP_GAP_SEC) * IRSampleRate;
+  int takesNum = qRound((double)testL.size() / takePeriod);
+
+  bool isTakesAveraged = is_repeated_signal(testL, takesNum, takePeriod);
+
+  if (isTakesAveraged)
+  {
+    testL.resize(takePeriod);
+    testR.resize(takePeriod);
+
+    parallel_for(2, [&](int channel)
+    {
+      QVector<float> &response = (channel == 0) ? responseL : responseR;
+
+      response = average_aligned_takes(response.data(),
+                                       response.size(),
+                                       takesNum,
+                                       takePeriod,
+                                       TAKE_ALIGN_MAX_LAG_SEC * IRSampleRate);
+    });
+  }
+
   QVector<float> IRL(responseL.size());
   QVector<float> IRR(responseR.size());
 
-  fft_deconvolver(testL.data(),
-                  testL.size(),
-                  responseL.data(),
-                  responseL.size(),
-                  IRL.data(),
-                  IRL.size(),
-                  20.0 / processor->getSamplingRate(),
-                  20000.0 / processor->getSamplingRate(),
-                  -60.0
-                 );
-
-  fft_deconvolver(testR.data(),
-                  testR.size(),
-                  responseR.data(),
-                  responseR.size(),
-                  IRR.data(),
-                  IRR.size(),
-                  20.0 / processor->getSamplingRate(),
-                  20000.0 / processor->getSamplingRate(),
-                  -60.0
-                 );
+  int method = methodComboBox->currentData().toInt();
+
+  // Inverse filter is built for the sweep written by this dialog,
+  // other test signals can't be processed this way
+  if ((method == DECONVOLUTION_INVERSE_SWEEP) && !isTakesAveraged &&
+      (qAbs(testL.size() - TEST_SWEEP_LENGTH_SEC * IRSampleRate) > IRSampleRate / 100))
+  {
+    QMessageBox::warning(this, tr("Warning"),
+      tr("Test signal is not the sweep created by this dialog.\n"
+         "Use spectrum division for other test signals."));
+    return;
+  }
+
+  float regularization = regularizationSpinBox->value();
+
+  // Channels are deconvolved in parallel
+  parallel_for(2, [&](int channel)
+  {
+    QVector<float> &test = (channel == 0) ? testL : testR;
+    QVector<float> &response = (channel == 0) ? responseL : responseR;
+    QVector<float> &IR = (channel == 0) ? IRL : IRR;
+
+    if (method == DECONVOLUTION_INVERSE_SWEEP)
+    {
+      sweep_deconvolver(TEST_SWEEP_LENGTH_SEC,
+                        IRSampleRate,
+                        TEST_SWEEP_START_FREQUENCY,
+                        testSampleRate / 2.0,
+                        TEST_SWEEP_AMPLITUDE,
+                        response.data(),
+                        response.size(),
+                        IR.data(),
+                        IR.size());
+    }
+    else
+    {
+      fft_deconvolver(test.data(),
+                      test.size(),
+                      response.data(),
+                      response.size(),
+                      IR.data(),
+                      IR.size(),
+                      20.0 / IRSampleRate,
+                      20000.0 / IRSampleRate,
+                      regularization
+                     );
+    }
+  });
+
+  if (minimumPhaseCheckBox->isChecked())
+  {
+    int oldLength = IRL.size();
+
+    int lengthL = minimum_phase_impulse_response(IRL.data(), IRL.size(), -60.0);
+    int lengthR = minimum_phase_impulse_response(IRR.data(), IRR.size(), -60.0);
+
+    int newLength = qMax(lengthL, lengthR);
+
+    IRL.resize(newLength);
+    IRR.resize(newLength);
+
+    float samplesInMs = IRSampleRate / 1000.0;
+
+    QMessageBox::information(this, tr("Minimum Phase"),
+      QString(tr("Impulse response length: %1 ms -> %2 ms\n"
+                 "Convolver CPU load reduced by ~%3%"))
+        .arg(oldLength / samplesInMs, 0, 'f', 1)
+        .arg(newLength / samplesInMs, 0, 'f', 1)
+        .arg(100.0 * (1.0 - (double)newLength / oldLength), 0, 'f', 0));
+  }
 
   float cabinetImpulseEnergy = 0.0;
 
@@ -364,6 +532,13 @@ void DeconvolverDialog::IRGroupClicked(QAbstractButton *button)
   checkSignals();
 }
 
+void DeconvolverDialog::methodChanged(int index)
+{
+  // Inverse sweep needs no regularization inside the sweep band
+  regularizationSpinBox->setEnabled(
+    methodComboBox->itemData(index).toInt() == DECONVOLUTION_DIVISION);
+}
+
 void DeconvolverDialog::checkSignals()
 {
   if (!(testFilenameEdit->text().isEmpty() ||
@@ -385,11 +560,33 @@ void DeconvolverDialog::saveTestSignalButtonClicked()
 
   if (!testFileName.isEmpty())
   {
-    QVector<float> testSignal(10.0 * processor->getSamplingRate());
+    int sweepLength = TEST_SWEEP_LENGTH_SEC * processor->getSamplingRate();
+
+    QVector<float> sweep(sweepLength);
 
-    generate_logarithmic_sweep(10.0, processor->getSamplingRate(), 20.0,
+    generate_logarithmic_sweep(TEST_SWEEP_LENGTH_SEC, processor->getSamplingRate(),
+                               TEST_SWEEP_START_FREQUENCY,
                                (float)processor->getSamplingRate() / 2.0,
-                               0.5, testSignal.data());
+                               TEST_SWEEP_AMPLITUDE, sweep.data());
+
+    QVector<float> testSignal = sweep;
+
+    // Repeated sweeps are separated by silence
+    // long enough for the response to decay
+    int takesNum = takesSpinBox->value();
+    if (takesNum > 1)
+    {
+      int takePeriod = (TEST_SWEEP_LENGTH_SEC + TEST_SWEEP_GAP_SEC) *
+        processor->getSamplingRate();
+
+      testSignal.fill(0.0, takesNum * takePeriod);
+
+      for (int take = 0; take < takesNum; take++)
+      {
+        std::copy(sweep.constBegin(), sweep.constEnd(),
+                  testSignal.begin() + take * takePeriod);
+      }
+    }
 
     SF_INFO sfinfo;
 
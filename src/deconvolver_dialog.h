@@ -25,6 +25,10 @@
 #include <QLineEdit>
 #include <QRadioButton>
 #include <QButtonGroup>
+#include <QCheckBox>
+#include <QComboBox>
+#include <QDoubleSpinBox>
+#include <QSpinBox>
 
 #include "processor.h"
 
@@ -50,6 +54,11 @@ private:
   QRadioButton *IRCabinetRadioButton;
   QRadioButton *IRFileRadioButton;
 
+  QSpinBox *takesSpinBox;
+  QComboBox *methodComboBox;
+  QDoubleSpinBox *regularizationSpinBox;
+  QCheckBox *minimumPhaseCheckBox;
+
   void checkSignals();
 
 public slots:
@@ -61,6 +70,7 @@ public slots:
   void saveTestSignalButtonClicked();
 
   void IRGroupClicked(QAbstractButton *button);
+  void methodChanged(int index);
 };
 
 #endif // DECONVOLVERDIALOG_H
@@ -0,0 +1,260 @@
+/*
+ * Copyright (C) 2018-2020 Oleg Kapitonov
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * --------------------------------------------------------------------------
+ */
+
+#include <QMutex>
+#include <QHash>
+#include <QDir>
+#include <QFile>
+#include <QStandardPaths>
+
+#include "fft_plan_cache.h"
+
+struct PlanKey
+{
+  int n_count;
+  FFT_DIRECTION direction;
+  FFT_PRECISION precision;
+  // FFTW_UNALIGNED plans are used when buffers
+  // do not have SIMD alignment (e.g. QVector data)
+  bool aligned;
+};
+
+inline bool operator==(const PlanKey &a, const PlanKey &b)
+{
+  return (a.n_count == b.n_count) && (a.direction == b.direction) &&
+    (a.precision == b.precision) && (a.aligned == b.aligned);
+}
+
+inline uint qHash(const PlanKey &key, uint seed = 0)
+{
+  return qHash(((quint64)key.n_count << 3) | (key.direction << 2) |
+    (key.precision << 1) | (key.aligned ? 1 : 0), seed);
+}
+
+// FFTW planner is not thread-safe, so the mutex
+// guards both the cache and all planner calls
+static QMutex planCacheMutex;
+static QHash<PlanKey, void *> planCache;
+
+// Wrappers around double and single precision FFTW API
+template <FFT_PRECISION precision> struct FFTWApi;
+
+template <> struct FFTWApi<FFT_PRECISION_DOUBLE>
+{
+  typedef double Real;
+  typedef fftw_complex Complex;
+  typedef fftw_plan Plan;
+
+  static Plan plan(int n_count, FFT_DIRECTION direction, unsigned flags)
+  {
+    // Planner may overwrite arrays, so plan on scratch buffers
+    Real *real = fftw_alloc_real(n_count);
+    Complex *complex = fftw_alloc_complex(n_count / 2 + 1);
+
+    Plan p;
+    if (direction == FFT_DIRECTION_FORWARD)
+    {
+      p = fftw_plan_dft_r2c_1d(n_count, real, complex, flags);
+    }
+    else
+    {
+      p = fftw_plan_dft_c2r_1d(n_count, complex, real, flags);
+    }
+
+    fftw_free(real);
+    fftw_free(complex);
+
+    return p;
+  }
+
+  static void destroy(Plan p) {fftw_destroy_plan(p);}
+  static bool isAligned(Real *data) {return fftw_alignment_of(data) == 0;}
+  static void r2c(Plan p, Real in[], Complex out[]) {fftw_execute_dft_r2c(p, in, out);}
+  static void c2r(Plan p, Complex in[], Real out[]) {fftw_execute_dft_c2r(p, in, out);}
+};
+
+template <> struct FFTWApi<FFT_PRECISION_FLOAT>
+{
+  typedef float Real;
+  typedef fftwf_complex Complex;
+  typedef fftwf_plan Plan;
+
+  static Plan plan(int n_count, FFT_DIRECTION direction, unsigned flags)
+  {
+    Real *real = fftwf_alloc_real(n_count);
+    Complex *complex = fftwf_alloc_complex(n_count / 2 + 1);
+
+    Plan p;
+    if (direction == FFT_DIRECTION_FORWARD)
+    {
+      p = fftwf_plan_dft_r2c_1d(n_count, real, complex, flags);
+    }
+    else
+    {
+      p = fftwf_plan_dft_c2r_1d(n_count, complex, real, flags);
+    }
+
+    fftwf_free(real);
+    fftwf_free(complex);
+
+    return p;
+  }
+
+  static void destroy(Plan p) {fftwf_destroy_plan(p);}
+  static bool isAligned(Real *data) {return fftwf_alignment_of(data) == 0;}
+  static void r2c(Plan p, Real in[], Complex out[]) {fftwf_execute_dft_r2c(p, in, out);}
+  static void c2r(Plan p, Complex in[], Real out[]) {fftwf_execute_dft_c2r(p, in, out);}
+};
+
+static bool is_cached_size(int n_count)
+{
+  return (n_count <= FFT_PLAN_CACHE_MAX_SIZE) && ((n_count & (n_count - 1)) == 0);
+}
+
+// Returns plan for the key, creates it if needed.
+// Plans of sizes that are not cached
+// must be passed to release_plan()
+template <FFT_PRECISION precision>
+static typename FFTWApi<precision>::Plan acquire_plan(const PlanKey &key)
+{
+  typedef FFTWApi<precision> Api;
+
+  QMutexLocker locker(&planCacheMutex);
+
+  unsigned flags = key.aligned ? 0 : FFTW_UNALIGNED;
+
+  if (!is_cached_size(key.n_count))
+  {
+    return Api::plan(key.n_count, key.direction, flags | FFTW_ESTIMATE);
+  }
+
+  void *p = planCache.value(key, nullptr);
+  if (p == nullptr)
+  {
+    p = Api::plan(key.n_count, key.direction, flags | FFTW_MEASURE);
+    planCache.insert(key, p);
+  }
+
+  return static_cast<typename Api::Plan>(p);
+}
+
+template <FFT_PRECISION precision>
+static void release_plan(const PlanKey &key, typename FFTWApi<precision>::Plan p)
+{
+  if (!is_cached_size(key.n_count))
+  {
+    QMutexLocker locker(&planCacheMutex);
+    FFTWApi<precision>::destroy(p);
+  }
+}
+
+template <FFT_PRECISION precision>
+static void execute_r2c(int n_count,
+                        typename FFTWApi<precision>::Real in[],
+                        typename FFTWApi<precision>::Complex out[])
+{
+  typedef FFTWApi<precision> Api;
+
+  PlanKey key = {n_count, FFT_DIRECTION_FORWARD, precision,
+    Api::isAligned(in) && Api::isAligned((typename Api::Real *)out)};
+
+  typename Api::Plan p = acquire_plan<precision>(key);
+  Api::r2c(p, in, out);
+  release_plan<precision>(key, p);
+}
+
+template <FFT_PRECISION precision>
+static void execute_c2r(int n_count,
+                        typename FFTWApi<precision>::Complex in[],
+                        typename FFTWApi<precision>::Real out[])
+{
+  typedef FFTWApi<precision> Api;
+
+  PlanKey key = {n_count, FFT_DIRECTION_BACKWARD, precision,
+    Api::isAligned((typename Api::Real *)in) && Api::isAligned(out)};
+
+  typename Api::Plan p = acquire_plan<precision>(key);
+  Api::c2r(p, in, out);
+  release_plan<precision>(key, p);
+}
+
+void fft_r2c(int n_count, double in[], fftw_complex out[])
+{
+  execute_r2c<FFT_PRECISION_DOUBLE>(n_count, in, out);
+}
+
+void fft_r2c(int n_count, float in[], fftwf_complex out[])
+{
+  execute_r2c<FFT_PRECISION_FLOAT>(n_count, in, out);
+}
+
+void fft_c2r(int n_count, fftw_complex in[], double out[])
+{
+  execute_c2r<FFT_PRECISION_DOUBLE>(n_count, in, out);
+}
+
+void fft_c2r(int n_count, fftwf_complex in[], float out[])
+{
+  execute_c2r<FFT_PRECISION_FLOAT>(n_count, in, out);
+}
+
+static QByteArray wisdom_filename(QString name)
+{
+  QString cacheDir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+  QDir().mkpath(cacheDir);
+
+  return QFile::encodeName(cacheDir + "/" + name);
+}
+
+// Imports FFTW wisdom saved by previous sessions,
+// so FFTW_MEASURE plans are created without measuring
+void fft_plan_cache_load_wisdom()
+{
+  QMutexLocker locker(&planCacheMutex);
+
+  fftw_import_wisdom_from_filename(wisdom_filename("fftw_wisdom").constData());
+  fftwf_import_wisdom_from_filename(wisdom_filename("fftwf_wisdom").constData());
+}
+
+void fft_plan_cache_save_wisdom()
+{
+  QMutexLocker locker(&planCacheMutex);
+
+  fftw_export_wisdom_to_filename(wisdom_filename("fftw_wisdom").constData());
+  fftwf_export_wisdom_to_filename(wisdom_filename("fftwf_wisdom").constData());
+}
+
+void fft_plan_cache_clear()
+{
+  QMutexLocker locker(&planCacheMutex);
+
+  for (auto it = planCache.begin(); it != planCache.end(); ++it)
+  {
+    if (it.key().precision == FFT_PRECISION_DOUBLE)
+    {
+      fftw_destroy_plan(static_cast<fftw_plan>(it.value()));
+    }
+    else
+    {
+      fftwf_destroy_plan(static_cast<fftwf_plan>(it.value()));
+    }
+  }
+
+  planCache.clear();
+}
@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2018-2020 Oleg Kapitonov
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * --------------------------------------------------------------------------
+ */
+
+#ifndef FFTPLANCACHE_H
+#define FFTPLANCACHE_H
+
+#include <fftw3.h>
+
+// Thread-safe cache of FFTW plans shared by all
+// analysis routines. Plans are created once per
+// transform size, direction and precision and executed
+// with the new-array interface, so any buffers of
+// that size can be used.
+// Planning results are kept in FFTW wisdom files
+// in the user cache directory.
+
+enum FFT_DIRECTION {FFT_DIRECTION_FORWARD, FFT_DIRECTION_BACKWARD};
+enum FFT_PRECISION {FFT_PRECISION_DOUBLE, FFT_PRECISION_FLOAT};
+
+// Only power of two transforms up to this size are measured
+// and cached, so the cache holds a bounded set of plans.
+// Other sizes are usually one-off (whole files), they are
+// planned with FFTW_ESTIMATE, where measuring costs more
+// than it saves
+#define FFT_PLAN_CACHE_MAX_SIZE (1 << 17)
+
+void fft_plan_cache_load_wisdom();
+void fft_plan_cache_save_wisdom();
+void fft_plan_cache_clear();
+
+// Unnormalized real-to-complex transform,
+// out[] must have n_count / 2 + 1 elements
+void fft_r2c(int n_count, double in[], fftw_complex out[]);
+void fft_r2c(int n_count, float in[], fftwf_complex out[]);
+
+// Unnormalized complex-to-real transform,
+// in[] is destroyed
+void fft_c2r(int n_count, fftw_complex in[], double out[]);
+void fft_c2r(int n_count, fftwf_complex in[], float out[]);
+
+#endif //FFTPLANCACHE_H
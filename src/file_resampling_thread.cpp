@@ -41,8 +41,13 @@ void FileResamplingThread::loadFile(const char *filename)
   SNDFILE *sndFile = sf_open(filename, SFM_READ, &sfinfo);
   if (sndFile != NULL)
   {
+    // Playback is streamed from disk, only an excerpt
+    // of a long file is loaded for analysis
+    sfinfo.frames = std::min(sfinfo.frames,
+                             (sf_count_t)sfinfo.samplerate * ANALYSIS_EXCERPT_SEC);
+
     QVector<float> tempBuffer(sfinfo.frames * sfinfo.channels);
-    sf_readf_float(sndFile, tempBuffer.data(), sfinfo.frames);
+    sfinfo.frames = sf_readf_float(sndFile, tempBuffer.data(), sfinfo.frames);
 
     sf_close(sndFile);
 
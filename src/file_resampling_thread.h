@@ -27,6 +27,10 @@
 
 #include "player.h"
 
+// Length of the file part used by auto-EQ
+// and level matching
+#define ANALYSIS_EXCERPT_SEC 60
+
 class FileResamplingThread : public QThread
 {
   Q_OBJECT
@@ -0,0 +1,219 @@
+/*
+ * Copyright (C) 2018-2020 Oleg Kapitonov
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * --------------------------------------------------------------------------
+ */
+
+#include <cmath>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define LEVEL_KERNELS_AVX2
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define LEVEL_KERNELS_NEON
+#endif
+
+#include "level_kernels.h"
+
+// Scalar versions, used without SIMD support
+// and for the remaining tail of the blocks
+
+static float sum_squares_scalar(const float x[], int begin, int n_count)
+{
+  float sum = 0.0;
+  for (int i = begin; i < n_count; i++)
+  {
+    sum += x[i] * x[i];
+  }
+
+  return sum;
+}
+
+static float peak_scalar(const float x[], int begin, int n_count)
+{
+  float peak = 0.0;
+  for (int i = begin; i < n_count; i++)
+  {
+    peak = fmax(peak, fabs(x[i]));
+  }
+
+  return peak;
+}
+
+// SIMD versions process as many elements as fit
+// into whole vectors, store partial result of the processed
+// elements and return number of processed elements
+
+#ifdef LEVEL_KERNELS_AVX2
+
+static bool has_avx2()
+{
+  static const bool supported = __builtin_cpu_supports("avx2") &&
+    __builtin_cpu_supports("fma");
+
+  return supported;
+}
+
+__attribute__((target("avx2,fma")))
+static float horizontal_sum_avx2(__m256 v)
+{
+  __m128 sum = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+  sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+  sum = _mm_add_ss(sum, _mm_movehdup_ps(sum));
+
+  return _mm_cvtss_f32(sum);
+}
+
+__attribute__((target("avx2,fma")))
+static float horizontal_max_avx2(__m256 v)
+{
+  __m128 max = _mm_max_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+  max = _mm_max_ps(max, _mm_movehl_ps(max, max));
+  max = _mm_max_ss(max, _mm_movehdup_ps(max));
+
+  return _mm_cvtss_f32(max);
+}
+
+// Two accumulators hide the FMA latency
+
+__attribute__((target("avx2,fma")))
+static int sum_squares_avx2(const float x[], int n_count, float *result)
+{
+  __m256 sum0 = _mm256_setzero_ps();
+  __m256 sum1 = _mm256_setzero_ps();
+
+  int i = 0;
+  for (; i + 16 <= n_count; i += 16)
+  {
+    __m256 v0 = _mm256_loadu_ps(x + i);
+    __m256 v1 = _mm256_loadu_ps(x + i + 8);
+
+    sum0 = _mm256_fmadd_ps(v0, v0, sum0);
+    sum1 = _mm256_fmadd_ps(v1, v1, sum1);
+  }
+
+  for (; i + 8 <= n_count; i += 8)
+  {
+    __m256 v0 = _mm256_loadu_ps(x + i);
+    sum0 = _mm256_fmadd_ps(v0, v0, sum0);
+  }
+
+  *result = horizontal_sum_avx2(_mm256_add_ps(sum0, sum1));
+
+  return i;
+}
+
+__attribute__((target("avx2,fma")))
+static int peak_avx2(const float x[], int n_count, float *result)
+{
+  const __m256 sign = _mm256_set1_ps(-0.0f);
+  __m256 peak = _mm256_setzero_ps();
+
+  int i = 0;
+  for (; i + 8 <= n_count; i += 8)
+  {
+    peak = _mm256_max_ps(peak, _mm256_andnot_ps(sign, _mm256_loadu_ps(x + i)));
+  }
+
+  *result = horizontal_max_avx2(peak);
+
+  return i;
+}
+
+#endif //LEVEL_KERNELS_AVX2
+
+#ifdef LEVEL_KERNELS_NEON
+
+static int sum_squares_neon(const float x[], int n_count, float *result)
+{
+  float32x4_t sum0 = vdupq_n_f32(0.0f);
+  float32x4_t sum1 = vdupq_n_f32(0.0f);
+
+  int i = 0;
+  for (; i + 8 <= n_count; i += 8)
+  {
+    float32x4_t v0 = vld1q_f32(x + i);
+    float32x4_t v1 = vld1q_f32(x + i + 4);
+
+    sum0 = vfmaq_f32(sum0, v0, v0);
+    sum1 = vfmaq_f32(sum1, v1, v1);
+  }
+
+  for (; i + 4 <= n_count; i += 4)
+  {
+    float32x4_t v0 = vld1q_f32(x + i);
+    sum0 = vfmaq_f32(sum0, v0, v0);
+  }
+
+  *result = vaddvq_f32(vaddq_f32(sum0, sum1));
+
+  return i;
+}
+
+static int peak_neon(const float x[], int n_count, float *result)
+{
+  float32x4_t peak = vdupq_n_f32(0.0f);
+
+  int i = 0;
+  for (; i + 4 <= n_count; i += 4)
+  {
+    peak = vmaxq_f32(peak, vabsq_f32(vld1q_f32(x + i)));
+  }
+
+  *result = vmaxvq_f32(peak);
+
+  return i;
+}
+
+#endif //LEVEL_KERNELS_NEON
+
+// Public functions dispatch to the best available
+// implementation, scalar code finishes the tail
+
+float block_sum_squares(const float x[], int n_count)
+{
+  float sum = 0.0;
+  int i = 0;
+
+#if defined(LEVEL_KERNELS_AVX2)
+  if (has_avx2())
+  {
+    i = sum_squares_avx2(x, n_count, &sum);
+  }
+#elif defined(LEVEL_KERNELS_NEON)
+  i = sum_squares_neon(x, n_count, &sum);
+#endif
+
+  return sum + sum_squares_scalar(x, i, n_count);
+}
+
+float block_peak(const float x[], int n_count)
+{
+  float peak = 0.0;
+  int i = 0;
+
+#if defined(LEVEL_KERNELS_AVX2)
+  if (has_avx2())
+  {
+    i = peak_avx2(x, n_count, &peak);
+  }
+#elif defined(LEVEL_KERNELS_NEON)
+  i = peak_neon(x, n_count, &peak);
+#endif
+
+  return fmax(peak, peak_scalar(x, i, n_count));
+}
@@ -0,0 +1,33 @@
+/*
+ * Copyright (C) 2018-2020 Oleg Kapitonov
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * --------------------------------------------------------------------------
+ */
+
+#ifndef LEVELKERNELS_H
+#define LEVELKERNELS_H
+
+// Reductions over blocks of real samples for the meters.
+// Vectorized with AVX2/FMA (selected at runtime) or NEON,
+// safe to call from the real-time thread.
+
+// Sum of x[i]^2
+float block_sum_squares(const float x[], int n_count);
+
+// Maximum of |x[i]|
+float block_peak(const float x[], int n_count);
+
+#endif //LEVELKERNELS_H
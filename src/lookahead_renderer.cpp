@@ -0,0 +1,322 @@
+/*
+ * Copyright (C) 2018-2020 Oleg Kapitonov
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * --------------------------------------------------------------------------
+ */
+
+#include <QMutexLocker>
+
+#include <jack/jack.h>
+
+#include "lookahead_renderer.h"
+#include "player.h"
+#include "processor.h"
+
+LookaheadRenderer::LookaheadRenderer(Player *plr)
+{
+  player = plr;
+
+  ringIn.resize(LOOKAHEAD_RING_FRAMES);
+  ringL.resize(LOOKAHEAD_RING_FRAMES);
+  ringR.resize(LOOKAHEAD_RING_FRAMES);
+
+  blockIn.resize(LOOKAHEAD_BLOCK_FRAMES);
+  blockL.resize(LOOKAHEAD_BLOCK_FRAMES);
+  blockR.resize(LOOKAHEAD_BLOCK_FRAMES);
+
+  flushL.resize(LOOKAHEAD_RING_FRAMES);
+  flushR.resize(LOOKAHEAD_RING_FRAMES);
+
+  processor = nullptr;
+  newProcessor = nullptr;
+
+  readPos = 0;
+  writePos = 0;
+  historyPos = 0;
+
+  rendering = false;
+  primed = false;
+  periodSize = fragm;
+
+  resetRequest = 0;
+  resetDone = 0;
+
+  underrunsCount = 0;
+}
+
+LookaheadRenderer::~LookaheadRenderer()
+{
+  requestInterruption();
+  wait();
+
+  delete processor;
+  delete newProcessor.load();
+}
+
+void LookaheadRenderer::setPeriodSize(int nframes)
+{
+  periodSize = nframes;
+}
+
+// Copy that was not taken yet is replaced
+void LookaheadRenderer::setProcessor(Processor *prc)
+{
+  delete newProcessor.exchange(prc);
+}
+
+void LookaheadRenderer::reset()
+{
+  resetRequest++;
+}
+
+void LookaheadRenderer::waitIdle()
+{
+  QMutexLocker locker(&idleMutex);
+
+  while (rendering)
+  {
+    idleCondition.wait(&idleMutex);
+  }
+}
+
+int LookaheadRenderer::getFill()
+{
+  return qMax(writePos - readPos, (qint64)0);
+}
+
+int LookaheadRenderer::getTargetFill()
+{
+  return qBound(LOOKAHEAD_MIN_FRAMES, LOOKAHEAD_PERIODS * periodSize,
+                LOOKAHEAD_RING_FRAMES - LOOKAHEAD_BLOCK_FRAMES);
+}
+
+int LookaheadRenderer::read(float *in, float *outL, float *outR, int n_count)
+{
+  int n_read = 0;
+
+  if ((resetRequest == resetDone) && primed)
+  {
+    qint64 pos = readPos;
+    n_read = qBound((qint64)0, writePos - pos, (qint64)n_count);
+
+    for (int i = 0; i < n_read; i++)
+    {
+      int index = (pos + i) & (LOOKAHEAD_RING_FRAMES - 1);
+
+      in[i] = ringIn[index];
+      outL[i] = ringL[index];
+      outR[i] = ringR[index];
+    }
+
+    readPos = pos + n_read;
+
+    // Rendering fell behind, playback waits
+    // until the lookahead is filled again
+    if (n_read < n_count)
+    {
+      primed = false;
+      underrunsCount++;
+    }
+  }
+
+  for (int i = n_read; i < n_count; i++)
+  {
+    in[i] = 0.0;
+    outL[i] = 0.0;
+    outR[i] = 0.0;
+  }
+
+  return n_read;
+}
+
+bool LookaheadRenderer::renderBlock()
+{
+  // Reset may race with the last read of the process callback
+  qint64 pos = qMax(writePos.load(), readPos.load());
+  int n_count = LOOKAHEAD_BLOCK_FRAMES;
+
+  StreamingSource *source = player->diSource;
+
+  source->flush();
+
+  if (source->getReadSpace() < n_count)
+  {
+    return false;
+  }
+
+  source->read(blockIn.data(), nullptr, n_count);
+
+  jack_time_t startTime = jack_get_time();
+
+  processor->process(blockL.data(), blockR.data(), blockIn.data(), n_count);
+
+  // Governor sees the load of the rendering
+  // relative to the duration of the block
+  float load = (jack_get_time() - startTime) * player->getSampleRate() /
+    (1.0e6 * n_count);
+
+  if (load > player->dspLoadPeak)
+  {
+    player->dspLoadPeak = load;
+  }
+
+  // DI input is kept for the meters
+  for (int i = 0; i < n_count; i++)
+  {
+    int index = (pos + i) & (LOOKAHEAD_RING_FRAMES - 1);
+
+    ringIn[index] = blockIn[i];
+    ringL[index] = blockL[i];
+    ringR[index] = blockR[i];
+  }
+
+  writePos = pos + n_count;
+
+  return true;
+}
+
+// Renders the audio after the next two periods again with the new
+// processor. The new processor first takes up to
+// LOOKAHEAD_WARMUP_FRAMES of the DI input before that, so its
+// convolver tails and FAUST state follow the played audio.
+// Playback goes on while rendering, so the new audio is blended
+// in after the periods the process callback may be reading then
+void LookaheadRenderer::flush(Processor *prc)
+{
+  qint64 end = writePos;
+  qint64 start = qMin(readPos + 2 * periodSize, end);
+
+  qint64 first = qMax(start - LOOKAHEAD_WARMUP_FRAMES,
+                      qMax(historyPos, end - LOOKAHEAD_RING_FRAMES));
+
+  // Processor takes whole fragments
+  first = end - (end - first) / fragm * fragm;
+  start = qMax(start, first);
+
+  for (qint64 pos = first; pos < end; pos += LOOKAHEAD_BLOCK_FRAMES)
+  {
+    // Dropped rendering is not blended
+    if (resetRequest != resetDone)
+    {
+      delete processor;
+      processor = prc;
+      return;
+    }
+
+    int n_count = qMin((qint64)LOOKAHEAD_BLOCK_FRAMES, end - pos);
+
+    for (int i = 0; i < n_count; i++)
+    {
+      blockIn[i] = ringIn[(pos + i) & (LOOKAHEAD_RING_FRAMES - 1)];
+    }
+
+    prc->process(blockL.data(), blockR.data(), blockIn.data(), n_count);
+
+    for (int i = 0; i < n_count; i++)
+    {
+      int index = (pos + i) & (LOOKAHEAD_RING_FRAMES - 1);
+
+      flushL[index] = blockL[i];
+      flushR[index] = blockR[i];
+    }
+  }
+
+  qint64 splice = qMax(start, readPos + 2 * periodSize);
+  qint64 crossfadeLength = qMin(end - splice, (qint64)LOOKAHEAD_CROSSFADE_FRAMES);
+
+  for (qint64 pos = splice; pos < end; pos++)
+  {
+    int index = pos & (LOOKAHEAD_RING_FRAMES - 1);
+
+    float newGain = 1.0;
+
+    if (pos - splice < crossfadeLength)
+    {
+      newGain = (pos - splice + 1) / (float)(crossfadeLength + 1);
+    }
+
+    ringL[index] = ringL[index] * (1.0 - newGain) + flushL[index] * newGain;
+    ringR[index] = ringR[index] * (1.0 - newGain) + flushR[index] * newGain;
+  }
+
+  delete processor;
+  processor = prc;
+}
+
+void LookaheadRenderer::run()
+{
+  while (!isInterruptionRequested())
+  {
+    rendering = true;
+
+    if (resetRequest != resetDone)
+    {
+      primed = false;
+
+      writePos = readPos.load();
+      historyPos = writePos;
+
+      // Process callback does not read the ring until here
+      resetDone = resetRequest.load();
+    }
+
+    if ((player->status == Player::PlayerStatus::PS_PLAY_DI) &&
+        player->diSource->isOpen())
+    {
+      Processor *prc = newProcessor.exchange(nullptr);
+
+      if (prc != nullptr)
+      {
+        if (processor == nullptr)
+        {
+          processor = prc;
+        }
+        else
+        {
+          flush(prc);
+        }
+      }
+
+      int targetFill = getTargetFill();
+
+      while ((processor != nullptr) &&
+             (getFill() + LOOKAHEAD_BLOCK_FRAMES <= targetFill) &&
+             (player->status == Player::PlayerStatus::PS_PLAY_DI) &&
+             (resetRequest == resetDone))
+      {
+        if (!renderBlock())
+        {
+          break;
+        }
+      }
+
+      if ((getFill() + LOOKAHEAD_BLOCK_FRAMES > targetFill) &&
+          (resetRequest == resetDone))
+      {
+        primed = true;
+      }
+    }
+
+    {
+      QMutexLocker locker(&idleMutex);
+
+      rendering = false;
+      idleCondition.wakeAll();
+    }
+
+    msleep(LOOKAHEAD_THREAD_INTERVAL_MS);
+  }
+}
@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2018-2020 Oleg Kapitonov
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * --------------------------------------------------------------------------
+ */
+
+#ifndef LOOKAHEADRENDERER_H
+#define LOOKAHEADRENDERER_H
+
+#include <QThread>
+#include <QVector>
+#include <QMutex>
+#include <QWaitCondition>
+
+#include <atomic>
+
+// Ring size in frames, power of 2
+#define LOOKAHEAD_RING_FRAMES 32768
+// Frames processed in one step, multiple of fragm
+#define LOOKAHEAD_BLOCK_FRAMES 1024
+// Rendered audio kept ahead of the playback position
+#define LOOKAHEAD_PERIODS 8
+#define LOOKAHEAD_MIN_FRAMES 4096
+#define LOOKAHEAD_THREAD_INTERVAL_MS 2
+// Played DI input run through a new processor before
+// the flushed audio, multiple of fragm
+#define LOOKAHEAD_WARMUP_FRAMES 4096
+// Old and new rendering are blended after a parameter change
+#define LOOKAHEAD_CROSSFADE_FRAMES 1024
+// Processor changes are handed to the renderer at this interval
+#define LOOKAHEAD_SYNC_INTERVAL_MS 40
+
+class Player;
+class Processor;
+
+// Renders DI playback ahead of the process callback.
+// DI input is known in advance, so the whole processing chain
+// runs on this thread in large blocks and the process callback
+// only copies the rendered audio from the ring.
+//
+// The renderer processes with its own copy of the processor,
+// the GUI thread hands over a new copy after parameter changes.
+// Processor state can not be rewound, so the new copy is first
+// run over the DI input played before the flushed audio, then
+// the audio not yet played is rendered again and crossfaded
+// from the old rendering. The renderer goes on with the new copy.
+//
+// The renderer is the only reader of the DI stream,
+// the GUI thread changes status, then waitIdle() before
+// the DI stream is moved
+class LookaheadRenderer : public QThread
+{
+  Q_OBJECT
+
+  void run() override;
+
+public:
+  LookaheadRenderer(Player *plr);
+  ~LookaheadRenderer();
+
+  void setPeriodSize(int nframes);
+  // Takes ownership of a copy of the processor with
+  // new parameters, GUI thread only
+  void setProcessor(Processor *prc);
+
+  // Drops rendered audio, used on seek
+  void reset();
+  // Waits until the current pass is finished,
+  // call after leaving PS_PLAY_DI mode
+  void waitIdle();
+  // Rendered frames not yet played
+  int getFill();
+
+  // Process callback only, copies n_count frames of DI input
+  // and processed output, missing frames are zero.
+  // Returns number of rendered frames
+  int read(float *in, float *outL, float *outR, int n_count);
+
+  // Times playback got ahead of rendering
+  std::atomic<int> underrunsCount;
+
+private:
+  Player *player;
+
+  // Renderer thread only
+  Processor *processor;
+  // Copy handed over by the GUI thread, not taken yet
+  std::atomic<Processor *> newProcessor;
+
+  QVector<float> ringIn;
+  QVector<float> ringL;
+  QVector<float> ringR;
+
+  // Absolute positions, ring index is position modulo ring size
+  std::atomic<qint64> readPos;
+  std::atomic<qint64> writePos;
+
+  std::atomic<bool> rendering;
+  QMutex idleMutex;
+  QWaitCondition idleCondition;
+  // Playback waits until the lookahead is filled
+  std::atomic<bool> primed;
+  std::atomic<int> periodSize;
+
+  std::atomic<int> resetRequest;
+  std::atomic<int> resetDone;
+  // DI input in the ring is continuous from this position
+  qint64 historyPos;
+
+  QVector<float> blockIn;
+  QVector<float> blockL;
+  QVector<float> blockR;
+
+  // Audio rendered again by the new processor, ring indexed
+  QVector<float> flushL;
+  QVector<float> flushR;
+
+  int getTargetFill();
+  bool renderBlock();
+  void flush(Processor *prc);
+};
+
+#endif // LOOKAHEADRENDERER_H
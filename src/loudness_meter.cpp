@@ -0,0 +1,298 @@
+/*
+ * Copyright (C) 2018-2020 Oleg Kapitonov
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * --------------------------------------------------------------------------
+ */
+
+#include <cmath>
+#include <cstring>
+
+#include "loudness_meter.h"
+#include "level_kernels.h"
+
+LoudnessMeter::LoudnessMeter(int samplingRate, int channelsCount)
+{
+  channels = channelsCount;
+  blockSize = samplingRate * LOUDNESS_BLOCK_MS / 1000;
+
+  // K-weighting filters for any sample rate,
+  // parameters of the BS.1770 48 kHz filters
+  double K = tan(M_PI * 1681.974450955533 / samplingRate);
+  double Q = 0.7071752369554196;
+  double Vh = pow(10.0, 3.999843853973347 / 20.0);
+  double Vb = pow(Vh, 0.4996667741545416);
+  double a0 = 1.0 + K / Q + K * K;
+
+  shelfB[0] = (Vh + Vb * K / Q + K * K) / a0;
+  shelfB[1] = 2.0 * (K * K - Vh) / a0;
+  shelfB[2] = (Vh - Vb * K / Q + K * K) / a0;
+  shelfA[0] = 1.0;
+  shelfA[1] = 2.0 * (K * K - 1.0) / a0;
+  shelfA[2] = (1.0 - K / Q + K * K) / a0;
+
+  K = tan(M_PI * 38.13547087602444 / samplingRate);
+  Q = 0.5003270373238773;
+  a0 = 1.0 + K / Q + K * K;
+
+  highpassB[0] = 1.0;
+  highpassB[1] = -2.0;
+  highpassB[2] = 1.0;
+  highpassA[0] = 1.0;
+  highpassA[1] = 2.0 * (K * K - 1.0) / a0;
+  highpassA[2] = (1.0 - K / Q + K * K) / a0;
+
+  // Hann-windowed sinc interpolator, cutoff at
+  // the original Nyquist frequency, unity gain of each phase
+  int filterSize = TRUE_PEAK_OVERSAMPLING * TRUE_PEAK_TAPS_PER_PHASE;
+  truePeakFilter.resize(filterSize);
+
+  double filterSum = 0.0;
+  for (int k = 0; k < filterSize; k++)
+  {
+    double x = (k - (filterSize - 1) / 2.0) / TRUE_PEAK_OVERSAMPLING;
+    double sinc = (x == 0.0) ? 1.0 : sin(M_PI * x) / (M_PI * x);
+    double window = 0.5 - 0.5 * cos(2.0 * M_PI * (k + 0.5) / filterSize);
+
+    truePeakFilter[k] = sinc * window;
+    filterSum += truePeakFilter[k];
+  }
+
+  for (int k = 0; k < filterSize; k++)
+  {
+    truePeakFilter[k] *= TRUE_PEAK_OVERSAMPLING / filterSum;
+  }
+
+  weighted.resize(blockSize);
+  oversampled.resize(blockSize);
+
+  int histogramSize = (LOUDNESS_HISTOGRAM_MAX - LOUDNESS_ABSOLUTE_GATE) /
+    LOUDNESS_HISTOGRAM_STEP + 1;
+  histogramCount.resize(histogramSize);
+  histogramEnergy.resize(histogramSize);
+
+  reset();
+}
+
+void LoudnessMeter::reset()
+{
+  blockPos = 0;
+  blocksCount = 0;
+
+  filterState.fill(0.0, 4 * channels);
+  blockEnergy.fill(0.0, channels);
+  blockHistory.fill(0.0, LOUDNESS_SHORT_TERM_BLOCKS);
+  truePeakHistory.fill(0.0, channels * (TRUE_PEAK_TAPS_PER_PHASE - 1 + blockSize));
+
+  histogramCount.fill(0);
+  histogramEnergy.fill(0.0);
+
+  momentary = -INFINITY;
+  shortTerm = -INFINITY;
+  integrated = -INFINITY;
+  truePeak = 0.0;
+}
+
+void LoudnessMeter::process(const float *const data[], int n_count)
+{
+  int pos = 0;
+
+  while (pos < n_count)
+  {
+    int chunk = qMin(n_count - pos, blockSize - blockPos);
+
+    for (int channel = 0; channel < channels; channel++)
+    {
+      kWeighting(channel, data[channel] + pos, chunk);
+      blockEnergy[channel] += block_sum_squares(weighted.constData(), chunk);
+
+      measureTruePeak(channel, data[channel] + pos, chunk);
+    }
+
+    pos += chunk;
+    blockPos += chunk;
+
+    if (blockPos == blockSize)
+    {
+      finishBlock();
+    }
+  }
+}
+
+// Transposed direct form II biquads,
+// result goes to the 'weighted' buffer
+void LoudnessMeter::kWeighting(int channel, const float *in, int n_count)
+{
+  double *state = filterState.data() + 4 * channel;
+
+  double s1 = state[0];
+  double s2 = state[1];
+  double h1 = state[2];
+  double h2 = state[3];
+
+  for (int i = 0; i < n_count; i++)
+  {
+    double x = in[i];
+
+    double y = shelfB[0] * x + s1;
+    s1 = shelfB[1] * x - shelfA[1] * y + s2;
+    s2 = shelfB[2] * x - shelfA[2] * y;
+
+    double z = highpassB[0] * y + h1;
+    h1 = highpassB[1] * y - highpassA[1] * z + h2;
+    h2 = highpassB[2] * y - highpassA[2] * z;
+
+    weighted[i] = z;
+  }
+
+  state[0] = s1;
+  state[1] = s2;
+  state[2] = h1;
+  state[3] = h2;
+}
+
+// Each interpolation phase is calculated for the whole
+// chunk, inner loop over samples is vectorized
+void LoudnessMeter::measureTruePeak(int channel, const float *in, int n_count)
+{
+  int historySize = TRUE_PEAK_TAPS_PER_PHASE - 1;
+  float *history = truePeakHistory.data() +
+    channel * (historySize + blockSize);
+  float *out = oversampled.data();
+
+  memcpy(history + historySize, in, n_count * sizeof(float));
+
+  truePeak = qMax(truePeak, block_peak(in, n_count));
+
+  for (int phase = 0; phase < TRUE_PEAK_OVERSAMPLING; phase++)
+  {
+    memset(out, 0, n_count * sizeof(float));
+
+    for (int k = 0; k < TRUE_PEAK_TAPS_PER_PHASE; k++)
+    {
+      float tap = truePeakFilter[k * TRUE_PEAK_OVERSAMPLING + phase];
+      const float *x = history + historySize - k;
+
+      for (int i = 0; i < n_count; i++)
+      {
+        out[i] += tap * x[i];
+      }
+    }
+
+    truePeak = qMax(truePeak, block_peak(out, n_count));
+  }
+
+  memmove(history, history + n_count, historySize * sizeof(float));
+}
+
+void LoudnessMeter::finishBlock()
+{
+  double energy = 0.0;
+  for (int channel = 0; channel < channels; channel++)
+  {
+    energy += blockEnergy[channel] / blockSize;
+    blockEnergy[channel] = 0.0;
+  }
+
+  blockHistory[blocksCount % LOUDNESS_SHORT_TERM_BLOCKS] = energy;
+  blocksCount++;
+  blockPos = 0;
+
+  momentary = -0.691 + 10.0 * log10(windowEnergy(LOUDNESS_MOMENTARY_BLOCKS));
+  shortTerm = -0.691 + 10.0 * log10(windowEnergy(LOUDNESS_SHORT_TERM_BLOCKS));
+
+  // Gating blocks are momentary windows
+  // with 75% overlap
+  if ((blocksCount >= LOUDNESS_MOMENTARY_BLOCKS) &&
+      (momentary >= LOUDNESS_ABSOLUTE_GATE))
+  {
+    int bin = (momentary - LOUDNESS_ABSOLUTE_GATE) / LOUDNESS_HISTOGRAM_STEP;
+    bin = qMin(bin, histogramCount.size() - 1);
+
+    histogramCount[bin]++;
+    histogramEnergy[bin] += windowEnergy(LOUDNESS_MOMENTARY_BLOCKS);
+
+    updateIntegrated();
+  }
+}
+
+// Mean square of the last n_blocks blocks,
+// fewer blocks are used at the start
+double LoudnessMeter::windowEnergy(int n_blocks)
+{
+  n_blocks = qMin(n_blocks, blocksCount);
+
+  double energy = 0.0;
+  for (int i = 1; i <= n_blocks; i++)
+  {
+    energy += blockHistory[(blocksCount - i) % LOUDNESS_SHORT_TERM_BLOCKS];
+  }
+
+  return energy / n_blocks;
+}
+
+void LoudnessMeter::updateIntegrated()
+{
+  int count = 0;
+  double energy = 0.0;
+
+  for (int bin = 0; bin < histogramCount.size(); bin++)
+  {
+    count += histogramCount[bin];
+    energy += histogramEnergy[bin];
+  }
+
+  double relativeGate = -0.691 + 10.0 * log10(energy / count) +
+    LOUDNESS_RELATIVE_GATE;
+
+  count = 0;
+  energy = 0.0;
+
+  for (int bin = 0; bin < histogramCount.size(); bin++)
+  {
+    double binLoudness = LOUDNESS_ABSOLUTE_GATE + (bin + 0.5) * LOUDNESS_HISTOGRAM_STEP;
+
+    if (binLoudness >= relativeGate)
+    {
+      count += histogramCount[bin];
+      energy += histogramEnergy[bin];
+    }
+  }
+
+  if (count > 0)
+  {
+    integrated = -0.691 + 10.0 * log10(energy / count);
+  }
+}
+
+double LoudnessMeter::getMomentary()
+{
+  return momentary;
+}
+
+double LoudnessMeter::getShortTerm()
+{
+  return shortTerm;
+}
+
+double LoudnessMeter::getIntegrated()
+{
+  return integrated;
+}
+
+double LoudnessMeter::getTruePeak()
+{
+  return 20.0 * log10(truePeak);
+}
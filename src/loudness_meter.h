@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2018-2020 Oleg Kapitonov
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * --------------------------------------------------------------------------
+ */
+
+#ifndef LOUDNESSMETER_H
+#define LOUDNESSMETER_H
+
+#include <QVector>
+
+// Loudness measurement after ITU-R BS.1770-4 / EBU R128
+#define LOUDNESS_BLOCK_MS 100
+#define LOUDNESS_MOMENTARY_BLOCKS 4
+#define LOUDNESS_SHORT_TERM_BLOCKS 30
+#define LOUDNESS_ABSOLUTE_GATE -70.0
+#define LOUDNESS_RELATIVE_GATE -10.0
+// Integrated loudness histogram covers
+// absolute gate .. LOUDNESS_HISTOGRAM_MAX in 0.1 LU steps
+#define LOUDNESS_HISTOGRAM_MAX 5.0
+#define LOUDNESS_HISTOGRAM_STEP 0.1
+#define TRUE_PEAK_OVERSAMPLING 4
+#define TRUE_PEAK_TAPS_PER_PHASE 12
+// True peak below this level is shown as silence (dBTP)
+#define TRUE_PEAK_DISPLAY_FLOOR -150.0
+
+// K-weighted momentary, short-term and integrated
+// loudness (LUFS) and 4x oversampled true peak (dBTP)
+// of a multichannel signal, all channels have unity weight.
+// Values are -INFINITY until enough signal is measured
+class LoudnessMeter
+{
+public:
+  LoudnessMeter(int samplingRate, int channelsCount);
+
+  // Planar input, one buffer of n_count samples per channel
+  void process(const float *const data[], int n_count);
+  void reset();
+
+  double getMomentary();
+  double getShortTerm();
+  double getIntegrated();
+  double getTruePeak();
+
+private:
+  int channels;
+  int blockSize;
+  int blockPos;
+
+  // K-weighting: high shelf followed by highpass
+  double shelfB[3];
+  double shelfA[3];
+  double highpassB[3];
+  double highpassA[3];
+
+  // Per channel biquad state, 4 values per channel
+  QVector<double> filterState;
+  QVector<double> blockEnergy;
+  QVector<float> weighted;
+
+  // Mean square of the last LOUDNESS_SHORT_TERM_BLOCKS blocks
+  QVector<double> blockHistory;
+  int blocksCount;
+
+  QVector<int> histogramCount;
+  QVector<double> histogramEnergy;
+
+  QVector<float> truePeakFilter;
+  QVector<float> truePeakHistory;
+  QVector<float> oversampled;
+
+  double momentary;
+  double shortTerm;
+  double integrated;
+  float truePeak;
+
+  void kWeighting(int channel, const float *in, int n_count);
+  void measureTruePeak(int channel, const float *in, int n_count);
+  void finishBlock();
+  double windowEnergy(int n_blocks);
+  void updateIntegrated();
+};
+
+#endif // LOUDNESSMETER_H
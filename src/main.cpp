@@ -25,6 +25,8 @@
 #include "mainwindow.h"
 #include "processor.h"
 #include "player.h"
+#include "fft_plan_cache.h"
+#include "multirate_convolver.h"
 
 int main(int argc, char *argv[])
 {
@@ -40,6 +42,8 @@ int main(int argc, char *argv[])
   translator.load("tAD_" + QLocale::system().name(), appdir.absolutePath());
   a.installTranslator(&translator);
 
+  fft_plan_cache_load_wisdom();
+
   Player *playerInstance = new Player();
   if (playerInstance->connectToJack() == 1)
   {
@@ -49,6 +53,12 @@ int main(int argc, char *argv[])
   }
 
   Processor *processorInstance = new Processor(playerInstance->getSampleRate());
+
+  QSettings multirateSettings;
+  processorInstance->setCabinetMultirate(
+    multirateSettings.value("cabinet/multirate", false).toBool(),
+    multirateSettings.value("cabinet/multirateHeadLength", MULTIRATE_DEFAULT_HEAD_MS).toFloat());
+
   processorInstance->loadProfile(":/profiles/British Crunch.tapf");
 
   playerInstance->setProcessor(processorInstance);
@@ -62,6 +72,9 @@ int main(int argc, char *argv[])
   delete playerInstance;
   delete processorInstance;
 
+  fft_plan_cache_save_wisdom();
+  fft_plan_cache_clear();
+
   int value = w.centralWidget->playerPanel->getInputLevelSliderValue();
   QSettings settings;
   settings.setValue("playerPanel/inputLevel", value - 50);
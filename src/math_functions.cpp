@@ -18,17 +18,88 @@
  */
 
 #include <QScopedPointer>
+#include <QMutex>
+#include <QThreadPool>
+#include <QRunnable>
+#include <QSemaphore>
+#include <QHash>
+#include <QString>
+#include <QByteArray>
 #include <gsl/gsl_complex_math.h>
 #include <gsl/gsl_multifit.h>
 #include <gsl/gsl_spline.h>
 
-#include <fftw3.h>
 #include <cstring>
 
 #include "math_functions.h"
+#include "fft_plan_cache.h"
+#include "spectral_kernels.h"
 
 #include <zita-resampler/resampler.h>
 
+// Complex type of FFT buffers for given sample type
+template <typename Real> struct FFTComplex;
+template <> struct FFTComplex<double> {typedef s_fftw_complex Type;};
+template <> struct FFTComplex<float> {typedef s_fftwf_complex Type;};
+
+static inline void fft_r2c(int n_count, double in[], s_fftw_complex out[])
+{
+  fft_r2c(n_count, in, (double (*)[2])out);
+}
+
+static inline void fft_r2c(int n_count, float in[], s_fftwf_complex out[])
+{
+  fft_r2c(n_count, in, (float (*)[2])out);
+}
+
+static inline void fft_c2r(int n_count, s_fftw_complex in[], double out[])
+{
+  fft_c2r(n_count, (double (*)[2])in, out);
+}
+
+static inline void fft_c2r(int n_count, s_fftwf_complex in[], float out[])
+{
+  fft_c2r(n_count, (float (*)[2])in, out);
+}
+
+// Calculates minimum phase response from
+// log(A(w)) response by Hilbert transform.
+// data[] contains log(A(w)) for the full circle
+// of frequencies (negative frequencies included),
+// result phase response is written to the same buffer
+static void minimum_phase_from_log_amplitude(double data[], int n_count)
+{
+  // 1. Perform FFT of input log(A(w)) response
+  QVector<s_fftw_complex> out(n_count/2+1);
+
+  fft_r2c(n_count, data, (double (*)[2])out.data());
+
+  // 2. Perform Hilbert transform (swap real and imaginary parts)
+  out[0].real = 0.0;
+  out[0].imagine = 0.0;
+
+  out[n_count/2].real = 0.0;
+  out[n_count/2].imagine = 0.0;
+
+  for (int i=1;i<n_count/2;i++)
+  {
+    double a,b;
+    a = out[i].real;
+    b = out[i].imagine;
+    out[i].imagine = a;
+    out[i].real = -b;
+  }
+
+  // 3. Perform inverse FFT
+  fft_c2r(n_count, (double (*)[2])out.data(), data);
+
+  // 4. Normalize result
+  for (int i = 0; i < n_count; i++)
+  {
+    data[i] /= n_count;
+  }
+}
+
 // Function converts amplitude-frequency response
 // to time domain impulse response.
 void frequency_response_to_impulse_response(double w_in[],
@@ -109,52 +180,17 @@ void frequency_response_to_impulse_response(double w_in[],
   gsl_spline_free (spline);
   gsl_interp_accel_free (acc);
 
-  // Frequency response
-  QVector<double> F(hilbert_count);
-
-  // Perform Hilbert transform in frequency domain.
-  // For this:
-  // 1. Perform FFT of input interpolated log(A(w)) response
-  QVector<s_fftw_complex> out(hilbert_count/2+1);
-
-  fftw_plan p,p1;
-
-  p = fftw_plan_dft_r2c_1d(hilbert_count, Alog.data(),
-    (double (*)[2])out.data(), FFTW_ESTIMATE);
-
-  fftw_execute(p);
-
-  // 2. Perform Hilbert transform (swap real and imaginary parts)
-  out[0].real = 0.0;
-  out[0].imagine = 0.0;
-
-  out[hilbert_count/2].real = 0.0;
-  out[hilbert_count/2].imagine = 0.0;
-
-  for (int i=1;i<hilbert_count/2;i++)
-  {
-    double a,b;
-    a = out[i].real;
-    b = out[i].imagine;
-    out[i].imagine = a;
-    out[i].real = -b;
-  }
-
-  // 3. Perform inverse FFT
-  p1 = fftw_plan_dft_c2r_1d(hilbert_count, (double (*)[2])out.data(),
-    F.data(), FFTW_ESTIMATE);
-
-  fftw_execute(p1);
+  // Perform Hilbert transform of log(A(w)),
+  // get minimum phase response (F[])
+  QVector<double> F(Alog);
 
-  fftw_destroy_plan(p);
-  fftw_destroy_plan(p1);
+  minimum_phase_from_log_amplitude(F.data(), hilbert_count);
 
-  // 4. Normalize result, get minimum phase response (F[])
   QVector<double> F_interp(hilbert_count/2);
 
   for (int i=hilbert_count/2;i<hilbert_count;i++)
   {
-    F_interp[i-hilbert_count/2] = F[i] / hilbert_count; // !!!!!!!!!!!!!!!!!!!!!!!!
+    F_interp[i-hilbert_count/2] = F[i];
   }
 
   // Construct spectrum in complex form
@@ -177,12 +213,7 @@ void frequency_response_to_impulse_response(double w_in[],
   // Get output impulse response from spectrum by inverse FFT
   QVector<double> IR_internal(IR_n_count);
 
-  p1 = fftw_plan_dft_c2r_1d(IR_n_count, (double (*)[2])spectrum.data(),
-    IR_internal.data(), FFTW_ESTIMATE);
-
-  fftw_execute(p1);
-
-  fftw_destroy_plan(p1);
+  fft_c2r(IR_n_count, (double (*)[2])spectrum.data(), IR_internal.data());
 
   // Calculated frequency response is not accurate.
   // This may lead to problems in impulse response -
@@ -239,11 +270,175 @@ void frequency_response_to_impulse_response(double w_in[],
   }
 }
 
+// Converts impulse response to the minimum phase form
+// with the same amplitude-frequency response.
+// Minimum phase response has no pre-delay and its energy
+// is concentrated at the beginning, so the tail can be cut.
+// Returns the new length of the response - number of samples
+// before the tail energy falls below tail_threshold_db
+// (relative to the full energy of the response)
+int minimum_phase_impulse_response(float IR[], int IR_n_count,
+                                   float tail_threshold_db)
+{
+  // Zero padding reduces time aliasing
+  // of the Hilbert transform
+  int n_count = 2;
+  while (n_count < IR_n_count * 4)
+  {
+    n_count *= 2;
+  }
+
+  QVector<double> IR_double(n_count);
+
+  for (int i = 0; i < IR_n_count; i++)
+  {
+    IR_double[i] = IR[i];
+  }
+
+  for (int i = IR_n_count; i < n_count; i++)
+  {
+    IR_double[i] = 0.0;
+  }
+
+  // Get spectrum of the impulse response
+  QVector<s_fftw_complex> spectrum(n_count / 2 + 1);
+
+  fft_r2c(n_count, IR_double.data(), (double (*)[2])spectrum.data());
+
+  double max_A = 0.0;
+
+  for (int i = 0; i < n_count / 2 + 1; i++)
+  {
+    double A = sqrt(spectrum[i].real * spectrum[i].real +
+      spectrum[i].imagine * spectrum[i].imagine);
+
+    if (A > max_A)
+    {
+      max_A = A;
+    }
+  }
+
+  if (max_A == 0.0)
+  {
+    return IR_n_count;
+  }
+
+  // log(A(w)) for the full circle of frequencies,
+  // zeros in spectrum are limited to -160 dB
+  QVector<double> Alog(n_count);
+
+  for (int i = 0; i < n_count / 2 + 1; i++)
+  {
+    double A = sqrt(spectrum[i].real * spectrum[i].real +
+      spectrum[i].imagine * spectrum[i].imagine);
+
+    if (A < max_A * 1e-8)
+    {
+      A = max_A * 1e-8;
+    }
+
+    Alog[i] = log(A);
+  }
+
+  for (int i = 1; i < n_count / 2; i++)
+  {
+    Alog[n_count - i] = Alog[i];
+  }
+
+  QVector<double> F(Alog);
+
+  minimum_phase_from_log_amplitude(F.data(), n_count);
+
+  // Construct minimum phase spectrum
+  // from amplitude and phase responses
+  for (int i = 0; i < n_count / 2 + 1; i++)
+  {
+    gsl_complex A = gsl_complex_polar(exp(Alog[i]), F[i]);
+    spectrum[i].real = GSL_REAL(A);
+    spectrum[i].imagine = GSL_IMAG(A);
+  }
+
+  fft_c2r(n_count, (double (*)[2])spectrum.data(), IR_double.data());
+
+  double energy = 0.0;
+
+  for (int i = 0; i < IR_n_count; i++)
+  {
+    IR[i] = IR_double[i] / n_count;
+    energy += IR[i] * IR[i];
+  }
+
+  // Find the point where the remaining tail
+  // becomes inaudible
+  double tail_threshold = energy * pow(10.0, tail_threshold_db / 10.0);
+  double tail_energy = 0.0;
+
+  int new_n_count = IR_n_count;
+
+  for (int i = IR_n_count - 1; i >= 0; i--)
+  {
+    tail_energy += IR[i] * IR[i];
+
+    if (tail_energy > tail_threshold)
+    {
+      new_n_count = i + 1;
+      break;
+    }
+  }
+
+  if (new_n_count < 64)
+  {
+    new_n_count = 64;
+  }
+
+  if (new_n_count > IR_n_count)
+  {
+    new_n_count = IR_n_count;
+  }
+
+  // Smooth fade out of the cut response
+  int fade_n_count = new_n_count / 10;
+
+  for (int i = 0; i < fade_n_count; i++)
+  {
+    IR[new_n_count - fade_n_count + i] *= 0.5 * (1.0 + cos(M_PI * i / fade_n_count));
+  }
+
+  for (int i = new_n_count; i < IR_n_count; i++)
+  {
+    IR[i] = 0.0;
+  }
+
+  return new_n_count;
+}
+
+// Returns position of the sample
+// with maximum absolute value
+int find_peak_position(float data[], int n_count)
+{
+  int peak_position = 0;
+  float peak_value = 0.0;
+
+  for (int i = 0; i < n_count; i++)
+  {
+    if (fabs(data[i]) > peak_value)
+    {
+      peak_value = fabs(data[i]);
+      peak_position = i;
+    }
+  }
+
+  return peak_position;
+}
+
 // Calculates convolution of signal and impulse response
 // in frequency domain
-void fft_convolver(float signal[], int signal_n_count, float impulse_response[],
-                   int ir_n_count)
+template <typename Real>
+static void fft_convolver_impl(float signal[], int signal_n_count,
+                               float impulse_response[], int ir_n_count)
 {
+  typedef typename FFTComplex<Real>::Type Complex;
+
   int n_count;
 
   // Signal and impulse responce must have the same length,
@@ -258,236 +453,242 @@ void fft_convolver(float signal[], int signal_n_count, float impulse_response[],
     n_count = ir_n_count;
   }
 
-  QVector<double> signal_double(n_count);
+  QVector<Real> signal_internal(n_count);
 
   for (int i = 0; i < signal_n_count; i++)
   {
-    signal_double[i] = signal[i];
+    signal_internal[i] = signal[i];
   }
 
   for (int i = signal_n_count; i < n_count; i++)
   {
-    signal_double[i] = 0.0;
+    signal_internal[i] = 0.0;
   }
 
   // Get spectrum of the signal
-  QVector<s_fftw_complex> signal_spectrum(n_count / 2 + 1);
-
-  fftw_plan p;
+  QVector<Complex> signal_spectrum(n_count / 2 + 1);
 
-  p = fftw_plan_dft_r2c_1d(n_count, signal_double.data(),
-    (double (*)[2])signal_spectrum.data(), FFTW_ESTIMATE);
-
-  fftw_execute(p);
-  fftw_destroy_plan(p);
+  fft_r2c(n_count, signal_internal.data(), signal_spectrum.data());
 
   // Extend impulse response to signal length if needed
-  QVector<double> impulse_response_double(n_count);
+  QVector<Real> impulse_response_internal(n_count);
 
   for (int i = 0; i < ir_n_count; i++)
   {
-    impulse_response_double[i] = impulse_response[i];
+    impulse_response_internal[i] = impulse_response[i];
   }
 
   for (int i = ir_n_count; i < n_count; i++)
   {
-    impulse_response_double[i] = 0.0;
+    impulse_response_internal[i] = 0.0;
   }
 
   // Get spectrum of the frequency response
-  QVector<s_fftw_complex> impulse_response_spectrum(n_count / 2 + 1);
-
-  p = fftw_plan_dft_r2c_1d(n_count, impulse_response_double.data(),
-    (double (*)[2])impulse_response_spectrum.data(), FFTW_ESTIMATE);
+  QVector<Complex> impulse_response_spectrum(n_count / 2 + 1);
 
-  fftw_execute(p);
-  fftw_destroy_plan(p);
+  fft_r2c(n_count, impulse_response_internal.data(),
+    impulse_response_spectrum.data());
 
   // Perform convolution in frequency domain
   // result = signal * impulse_response
-  for (int i = 0; i < n_count / 2 + 1; i++)
+  spectrum_mul(signal_spectrum.data(), impulse_response_spectrum.data(),
+    signal_spectrum.data(), signal_spectrum.size());
+
+  // Perform inverse FFT, get output signal
+  fft_c2r(n_count, signal_spectrum.data(), signal_internal.data());
+
+  // Normalize output signal
+  for (int i = 0; i < signal_n_count; i++)
   {
-    gsl_complex signal_A = gsl_complex_rect(signal_spectrum[i].real,
-      signal_spectrum[i].imagine);
-    gsl_complex impulse_response_A = gsl_complex_rect(impulse_response_spectrum[i].real,
-      impulse_response_spectrum[i].imagine);
+    signal[i] = signal_internal[i] / n_count;
+  }
+}
 
-    gsl_complex result_A = gsl_complex_mul(signal_A, impulse_response_A);
+void fft_convolver(float signal[], int signal_n_count, float impulse_response[],
+                   int ir_n_count, FFT_PRECISION precision)
+{
+  switch (precision)
+  {
+    case FFT_PRECISION_DOUBLE:
+      fft_convolver_impl<double>(signal, signal_n_count,
+                                 impulse_response, ir_n_count);
+    break;
+    case FFT_PRECISION_FLOAT:
+      fft_convolver_impl<float>(signal, signal_n_count,
+                                impulse_response, ir_n_count);
+    break;
+  }
+}
 
-    signal_spectrum[i].real = GSL_REAL(result_A);
-    signal_spectrum[i].imagine = GSL_IMAG(result_A);
+// Regularization profile of deconvolver relative to
+// the test signal peak power: regularization_db inside
+// the band, 0 dB an octave outside of it, raised cosine
+// in log frequency between them.
+// It depends only on spectrum size, band and strength,
+// so the last calculated table is cached
+// (left and right channels use the same one)
+template <typename Real>
+static QVector<Real> deconvolver_regularization_profile(int n_bins,
+                                                        float lowcut_relative_frequency,
+                                                        float highcut_relative_frequency,
+                                                        float regularization_db)
+{
+  static QMutex cache_mutex;
+  static QVector<Real> cached_profile;
+  static float cached_lowcut_relative_frequency = 0.0;
+  static float cached_highcut_relative_frequency = 0.0;
+  static float cached_regularization_db = 0.0;
+
+  QMutexLocker locker(&cache_mutex);
+
+  if ((cached_profile.size() == n_bins) &&
+      (cached_lowcut_relative_frequency == lowcut_relative_frequency) &&
+      (cached_highcut_relative_frequency == highcut_relative_frequency) &&
+      (cached_regularization_db == regularization_db))
+  {
+    return cached_profile;
   }
 
-  // Perform inverse FFT, get output signal
-  p = fftw_plan_dft_c2r_1d(n_count, (double (*)[2])signal_spectrum.data(),
-    signal_double.data(), FFTW_ESTIMATE);
+  QVector<Real> profile(n_bins);
 
-  fftw_execute(p);
-  fftw_destroy_plan(p);
+  profile[0] = 1.0;
 
-  // Normalize output signal
-  for (int i = 0; i < signal_n_count; i++)
+  for (int i = 1; i < n_bins; i++)
   {
-    signal[i] = signal_double[i] / n_count;
+    double relative_frequency = 0.5 * (double)i / n_bins;
+
+    // Distance outside of the band in octaves
+    double octaves = 0.0;
+    if (relative_frequency < lowcut_relative_frequency)
+    {
+      octaves = log2(lowcut_relative_frequency / relative_frequency);
+    }
+    else if (relative_frequency > highcut_relative_frequency)
+    {
+      octaves = log2(relative_frequency / highcut_relative_frequency);
+    }
+
+    double transition = 1.0;
+    if (octaves < 1.0)
+    {
+      transition = 0.5 - 0.5 * cos(M_PI * octaves);
+    }
+
+    profile[i] = pow(10.0, regularization_db * (1.0 - transition) / 10.0);
   }
+
+  cached_profile = profile;
+  cached_lowcut_relative_frequency = lowcut_relative_frequency;
+  cached_highcut_relative_frequency = highcut_relative_frequency;
+  cached_regularization_db = regularization_db;
+
+  return profile;
 }
 
 // Recreates impulse response
 // from test signal (signal_a)
 // and response signal (signal_c)
 // in frequency domain.
-// Filters result by lowpass and hipass
-void fft_deconvolver(float signal_a[],
-                     int signal_a_n_count,
-                     float signal_c[],
-                     int signal_c_n_count,
-                     float impulse_response[],
-                     int ir_n_count,
-                     float lowcut_relative_frequency,
-                     float highcut_relative_frequency,
-                     float noisegate_threshold_db
-                    )
+// Uses regularized (Kirkeby) inverse of the test
+// spectrum, so bins where the test signal is weak
+// are attenuated instead of amplified
+template <typename Real>
+static void fft_deconvolver_impl(float signal_a[],
+                                 int signal_a_n_count,
+                                 float signal_c[],
+                                 int signal_c_n_count,
+                                 float impulse_response[],
+                                 int ir_n_count,
+                                 float lowcut_relative_frequency,
+                                 float highcut_relative_frequency,
+                                 float regularization_db
+                                )
 {
+  typedef typename FFTComplex<Real>::Type Complex;
+
   int n_count = signal_c_n_count;
-  QVector<double> signal_c_double(n_count);
+  QVector<Real> signal_c_internal(n_count);
 
   for (int i = 0; i < n_count; i++)
   {
-    signal_c_double[i] = signal_c[i];
+    signal_c_internal[i] = signal_c[i];
   }
 
   // Calculate response signal spectrum
-  QVector<s_fftw_complex> signal_c_spectrum(n_count / 2 + 1);
-
-  fftw_plan p;
+  QVector<Complex> signal_c_spectrum(n_count / 2 + 1);
 
-  p = fftw_plan_dft_r2c_1d(n_count, signal_c_double.data(),
-    (double (*)[2])signal_c_spectrum.data(), FFTW_ESTIMATE);
+  fft_r2c(n_count, signal_c_internal.data(), signal_c_spectrum.data());
 
-  fftw_execute(p);
-  fftw_destroy_plan(p);
-
-  QVector<double> signal_a_double(n_count);
+  QVector<Real> signal_a_internal(n_count);
 
   for (int i = 0; i < signal_a_n_count; i++)
   {
-    signal_a_double[i] = signal_a[i];
+    signal_a_internal[i] = signal_a[i];
   }
 
   for (int i = signal_a_n_count; i < n_count; i++)
   {
-    signal_a_double[i] = 0.0;
+    signal_a_internal[i] = 0.0;
   }
 
   // Calculate test signal frequency
-  QVector<s_fftw_complex> signal_a_spectrum(n_count / 2 + 1);
+  QVector<Complex> signal_a_spectrum(n_count / 2 + 1);
 
-  p = fftw_plan_dft_r2c_1d(n_count, signal_a_double.data(),
-    (double (*)[2])signal_a_spectrum.data(), FFTW_ESTIMATE);
+  fft_r2c(n_count, signal_a_internal.data(), signal_a_spectrum.data());
 
-  fftw_execute(p);
-  fftw_destroy_plan(p);
+  QVector<Real> impulse_response_internal(n_count);
+  QVector<Complex> impulse_response_spectrum(n_count / 2 + 1);
 
-  QVector<double> impulse_response_double(n_count);
-  QVector<s_fftw_complex> impulse_response_spectrum(n_count / 2 + 1);
+  // Regularization follows the test signal power,
+  // weak parts of its spectrum are not inverted
+  QVector<Real> signal_a_magnitude(signal_a_spectrum.size());
+  spectrum_magnitude(signal_a_spectrum.data(), signal_a_magnitude.data(),
+    signal_a_magnitude.size());
 
-  // Perform deconvolution in frequency domain
-  // impulse_response = signal_c / signal_a
-  for (int i = 0; i < n_count / 2 + 1; i++)
+  Real max_magnitude = 0.0;
+  for (int i = 0; i < signal_a_magnitude.size(); i++)
   {
-    gsl_complex signal_a_A = gsl_complex_rect(signal_a_spectrum[i].real,
-                                              signal_a_spectrum[i].imagine);
-    gsl_complex signal_c_A = gsl_complex_rect(signal_c_spectrum[i].real,
-                                              signal_c_spectrum[i].imagine);
+    max_magnitude = qMax(max_magnitude, signal_a_magnitude[i]);
+  }
 
-    gsl_complex impulse_response_A = gsl_complex_div(signal_c_A, signal_a_A);
+  QVector<Real> epsilon = deconvolver_regularization_profile<Real>(
+    impulse_response_spectrum.size(),
+    lowcut_relative_frequency,
+    highcut_relative_frequency,
+    regularization_db);
 
-    impulse_response_spectrum[i].real = GSL_REAL(impulse_response_A);
-    impulse_response_spectrum[i].imagine = GSL_IMAG(impulse_response_A);
+  for (int i = 0; i < epsilon.size(); i++)
+  {
+    epsilon[i] *= max_magnitude * max_magnitude;
   }
 
+  // Perform deconvolution in frequency domain
+  // impulse_response = signal_c * conj(signal_a) / (|signal_a|^2 + epsilon)
+  spectrum_regularized_div(signal_c_spectrum.data(), signal_a_spectrum.data(),
+    impulse_response_spectrum.data(), epsilon.data(),
+    impulse_response_spectrum.size());
+
   // Kill constant component
   impulse_response_spectrum[0].real = 0.0;
   impulse_response_spectrum[0].imagine = 0.0;
 
-  // Perform lowpass and hipass filtering
-  for (int i = 1; i < impulse_response_spectrum.size(); i++)
-  {
-    double lowcut_T = 1.0 / (2.0 * M_PI * lowcut_relative_frequency);
-    double highcut_T = 1.0 / (2.0 * M_PI * highcut_relative_frequency);
-
-    gsl_complex jw = gsl_complex_rect(0.0, 2 * M_PI * 0.5 * (double)i /
-      impulse_response_spectrum.size());
-    gsl_complex highcut_A = gsl_complex_div(gsl_complex_rect(1.0, 0.0),
-      gsl_complex_add(gsl_complex_mul(jw, gsl_complex_rect(highcut_T, 0.0)),
-                      gsl_complex_rect(1.0,0.0))
-    );
-
-    gsl_complex lowcut_A = gsl_complex_div(gsl_complex_mul(gsl_complex_rect(lowcut_T, 0.0),
-      jw), gsl_complex_add(gsl_complex_mul(jw, gsl_complex_rect(lowcut_T, 0.0)),
-                      gsl_complex_rect(1.0,0.0))
-    );
-
-    gsl_complex freq = gsl_complex_rect(impulse_response_spectrum[i].real,
-                                        impulse_response_spectrum[i].imagine);
-
-    for (int j = 0; j < 7; j++)
-    {
-      freq = gsl_complex_mul(freq, lowcut_A);
-      freq = gsl_complex_mul(freq, highcut_A);
-    }
-
-    impulse_response_spectrum[i].real = GSL_REAL(freq);
-    impulse_response_spectrum[i].imagine = GSL_IMAG(freq);
-  }
-
   // Perform inverse FFT, get impulse response
-  p = fftw_plan_dft_c2r_1d(n_count, (double (*)[2])impulse_response_spectrum.data(),
-    impulse_response_double.data(), FFTW_ESTIMATE);
-
-  fftw_execute(p);
-  fftw_destroy_plan(p);
+  fft_c2r(n_count, impulse_response_spectrum.data(),
+    impulse_response_internal.data());
 
   QVector<float> IR_internal(ir_n_count);
 
-  // Normalize impulse response and apply noise gate
+  // Normalize impulse response
   float irMax = 0.0;
   for (int i = 0; i < ir_n_count; i++)
   {
-    IR_internal[i] = impulse_response_double[i] / n_count;
+    IR_internal[i] = impulse_response_internal[i] / n_count;
     if (fabs(IR_internal[i]) > irMax)
     {
       irMax = fabs(IR_internal[i]);
     }
   }
 
-  // Apply noisegate
-
-  float noisegate_threshold = pow(10.0, noisegate_threshold_db / 20.0);
-
-  float noiseGateThresholdOff = 0.9 * irMax * noisegate_threshold;
-  float noiseGateThresholdOn = 1.1 * irMax * noisegate_threshold;
-
-  bool noiseGateOn = false;
-
-  for (int i = 0; i < ir_n_count; i++)
-  {
-    if (fabs(IR_internal[i]) <= noiseGateThresholdOff)
-    {
-      noiseGateOn = false;
-    }
-
-    if (fabs(IR_internal[i]) >= noiseGateThresholdOn)
-    {
-      noiseGateOn = true;
-    }
-
-    if (!noiseGateOn)
-    {
-      IR_internal[i] = 0.0;
-    }
-  }
-
   // Calculated frequency response is not accurate.
   // This may lead to problems in impulse response -
   // it will start at time t < 0 instead of t = 0
@@ -539,151 +740,729 @@ void fft_deconvolver(float signal_a[],
   }
 }
 
-// Calculates average amplitude value of each
-// frequency component of the signal in buffer
-// Spectrum calculated on each n_spectrum samples
-// type:
-// FFT_AVERAGE_MAX - to get maximum value
-// FFT_AVERAGE_MEAN - to get mean value
-void fft_average(double *average_spectrum,
-                 double *buffer,
-                 int n_spectrum,
-                 int n_samples,
-                 FFT_AVERAGE_TYPE type)
+void fft_deconvolver(float signal_a[],
+                     int signal_a_n_count,
+                     float signal_c[],
+                     int signal_c_n_count,
+                     float impulse_response[],
+                     int ir_n_count,
+                     float lowcut_relative_frequency,
+                     float highcut_relative_frequency,
+                     float regularization_db,
+                     FFT_PRECISION precision
+                    )
 {
-  QVector<s_fftw_complex> out(n_spectrum + 1);
-  memset(average_spectrum, 0.0, n_spectrum * sizeof(double));
+  switch (precision)
+  {
+    case FFT_PRECISION_DOUBLE:
+      fft_deconvolver_impl<double>(signal_a, signal_a_n_count,
+                                   signal_c, signal_c_n_count,
+                                   impulse_response, ir_n_count,
+                                   lowcut_relative_frequency,
+                                   highcut_relative_frequency,
+                                   regularization_db);
+    break;
+    case FFT_PRECISION_FLOAT:
+      fft_deconvolver_impl<float>(signal_a, signal_a_n_count,
+                                  signal_c, signal_c_n_count,
+                                  impulse_response, ir_n_count,
+                                  lowcut_relative_frequency,
+                                  highcut_relative_frequency,
+                                  regularization_db);
+    break;
+  }
+}
+
+// Keep inverse filters for a few sweep configurations,
+// each one holds a full spectrum of the FFT size
+#define INVERSE_SWEEP_CACHE_MAX_ENTRIES 4
+
+// Spectrum of analytic inverse filter of the exponential
+// sweep made by generate_logarithmic_sweep(), n_fft points.
+// Inverse filter is the time-reversed sweep with
+// +6 dB/octave amplitude envelope, which compensates
+// for -3 dB/octave energy distribution of the sweep.
+// Filter is scaled so that the sweep convolved with it
+// gives unit impulse at sample sweep_n_count - 1.
+// Spectra are cached per sweep configuration,
+// sample rate and FFT size
+template <typename Real>
+static QVector<typename FFTComplex<Real>::Type> inverse_sweep_spectrum(double length_sec,
+                                                                       int sample_rate,
+                                                                       double f_start,
+                                                                       double f_end,
+                                                                       double sweep_amplitude,
+                                                                       int n_fft)
+{
+  typedef typename FFTComplex<Real>::Type Complex;
+
+  static QMutex cache_mutex;
+  static QHash<QString, QVector<Complex>> cache;
 
-  int p_buffer = 0;
+  QString key = QString("%1:%2:%3:%4:%5:%6")
+    .arg(length_sec, 0, 'g', 17)
+    .arg(sample_rate)
+    .arg(f_start, 0, 'g', 17)
+    .arg(f_end, 0, 'g', 17)
+    .arg(sweep_amplitude, 0, 'g', 17)
+    .arg(n_fft);
 
-  // Calculate spectrum on n_spectrum slice,
-  // calculate average value of each frequency in spectrum
-  while ((p_buffer + n_spectrum * 2) < n_samples)
+  QMutexLocker locker(&cache_mutex);
+
+  if (cache.contains(key))
   {
-    // Perform FFT
-    fftw_plan p;
+    return cache.value(key);
+  }
 
-    p = fftw_plan_dft_r2c_1d(n_spectrum * 2, buffer + p_buffer,
-      (double (*)[2])out.data(), FFTW_ESTIMATE);
+  int sweep_n_count = sample_rate * length_sec;
 
-    p_buffer += n_spectrum * 2;
+  QVector<float> sweep(sweep_n_count);
+  generate_logarithmic_sweep(length_sec, sample_rate, f_start, f_end,
+                             sweep_amplitude, sweep.data());
 
-    fftw_execute(p);
-    fftw_destroy_plan(p);
+  QVector<Real> sweep_internal(n_fft);
+  QVector<Real> inverse_internal(n_fft);
 
-    for (int i = 1; i < n_spectrum + 1; i++)
-    {
-      double A = sqrt(pow(out[i].real, 2) + pow(out[i].imagine, 2)) / n_spectrum / 2.0;
-      switch (type)
-      {
-        case FFT_AVERAGE_MAX:
-          if (A > average_spectrum[i - 1])
-          {
-            average_spectrum[i - 1] = A;
-          }
-        break;
-        case FFT_AVERAGE_MEAN:
-          average_spectrum[i - 1] += A / n_spectrum;
-        break;
+  double sweep_rate = log(f_end / f_start) / length_sec;
+
+  for (int i = 0; i < sweep_n_count; i++)
+  {
+    sweep_internal[i] = sweep[i];
+    inverse_internal[i] = sweep[sweep_n_count - 1 - i] *
+      exp(-sweep_rate * i / sample_rate);
+  }
+
+  QVector<Complex> sweep_spectrum(n_fft / 2 + 1);
+  QVector<Complex> inverse_spectrum(n_fft / 2 + 1);
+
+  fft_r2c(n_fft, sweep_internal.data(), sweep_spectrum.data());
+  fft_r2c(n_fft, inverse_internal.data(), inverse_spectrum.data());
+
+  // Sweep convolved with inverse filter has flat
+  // amplitude response inside the sweep band,
+  // scale it to unity measured an octave away from the band edges
+  spectrum_mul(sweep_spectrum.data(), inverse_spectrum.data(),
+    sweep_spectrum.data(), sweep_spectrum.size());
+
+  QVector<Real> magnitude(sweep_spectrum.size());
+  spectrum_magnitude(sweep_spectrum.data(), magnitude.data(), magnitude.size());
+
+  int first_bin = qMax(1, (int)(2.0 * f_start * n_fft / sample_rate));
+  int last_bin = qMin(magnitude.size() - 1, (int)(0.5 * f_end * n_fft / sample_rate));
+
+  double magnitude_sum = 0.0;
+  for (int i = first_bin; i <= last_bin; i++)
+  {
+    magnitude_sum += magnitude[i];
+  }
+
+  double scale = 1.0;
+  if ((last_bin >= first_bin) && (magnitude_sum > 0.0))
+  {
+    scale = (last_bin - first_bin + 1) / magnitude_sum;
+  }
+
+  for (int i = 0; i < inverse_spectrum.size(); i++)
+  {
+    inverse_spectrum[i].real *= scale;
+    inverse_spectrum[i].imagine *= scale;
+  }
+
+  if (cache.size() >= INVERSE_SWEEP_CACHE_MAX_ENTRIES)
+  {
+    cache.clear();
+  }
+  cache.insert(key, inverse_spectrum);
+
+  return inverse_spectrum;
+}
+
+// Calculates impulse response from the response
+// to exponential sweep by convolution with
+// analytic inverse filter (Farina method).
+// Harmonic distortion products land before
+// the linear impulse response and are cut off.
+// Known part of the measured chain (system_ir)
+// is removed by regularized spectral division
+template <typename Real>
+static void sweep_deconvolver_impl(double length_sec,
+                                   int sample_rate,
+                                   double f_start,
+                                   double f_end,
+                                   double sweep_amplitude,
+                                   float response[],
+                                   int response_n_count,
+                                   float impulse_response[],
+                                   int ir_n_count,
+                                   float system_ir[],
+                                   int system_ir_n_count)
+{
+  typedef typename FFTComplex<Real>::Type Complex;
+
+  int sweep_n_count = sample_rate * length_sec;
+
+  // FFT size is rounded up to power of 2,
+  // so responses of similar length share one inverse filter
+  int n_fft = 1;
+  while (n_fft < response_n_count + sweep_n_count)
+  {
+    n_fft *= 2;
+  }
+
+  QVector<Complex> inverse_spectrum = inverse_sweep_spectrum<Real>(length_sec,
+                                                                   sample_rate,
+                                                                   f_start,
+                                                                   f_end,
+                                                                   sweep_amplitude,
+                                                                   n_fft);
+
+  QVector<Real> response_internal(n_fft);
+
+  for (int i = 0; i < response_n_count; i++)
+  {
+    response_internal[i] = response[i];
+  }
+
+  QVector<Complex> response_spectrum(n_fft / 2 + 1);
+
+  fft_r2c(n_fft, response_internal.data(), response_spectrum.data());
+
+  spectrum_mul(response_spectrum.data(), inverse_spectrum.data(),
+    response_spectrum.data(), response_spectrum.size());
+
+  if ((system_ir != nullptr) && (system_ir_n_count > 0))
+  {
+    QVector<Real> system_internal(n_fft);
+
+    for (int i = 0; i < qMin(system_ir_n_count, n_fft); i++)
+    {
+      system_internal[i] = system_ir[i];
+    }
+
+    QVector<Complex> system_spectrum(n_fft / 2 + 1);
+
+    fft_r2c(n_fft, system_internal.data(), system_spectrum.data());
+
+    QVector<Real> system_magnitude(system_spectrum.size());
+    spectrum_magnitude(system_spectrum.data(), system_magnitude.data(),
+      system_magnitude.size());
+
+    Real max_magnitude = 0.0;
+    for (int i = 0; i < system_magnitude.size(); i++)
+    {
+      max_magnitude = qMax(max_magnitude, system_magnitude[i]);
+    }
+
+    // Regularization bounds the gain where the system
+    // response is 60 dB below its peak
+    spectrum_regularized_div(response_spectrum.data(), system_spectrum.data(),
+      response_spectrum.data(), max_magnitude * max_magnitude * 1e-6,
+      response_spectrum.size());
+  }
+
+  // Kill constant component
+  response_spectrum[0].real = 0.0;
+  response_spectrum[0].imagine = 0.0;
+
+  fft_c2r(n_fft, response_spectrum.data(), response_internal.data());
+
+  // Linear impulse response starts at the last sample of the sweep
+  for (int i = 0; i < ir_n_count; i++)
+  {
+    int n = sweep_n_count - 1 + i;
+
+    if (n < n_fft)
+    {
+      impulse_response[i] = response_internal[n] / n_fft;
+    }
+    else
+    {
+      impulse_response[i] = 0.0;
+    }
+  }
+}
+
+void sweep_deconvolver(double length_sec,
+                       int sample_rate,
+                       double f_start,
+                       double f_end,
+                       double sweep_amplitude,
+                       float response[],
+                       int response_n_count,
+                       float impulse_response[],
+                       int ir_n_count,
+                       float system_ir[],
+                       int system_ir_n_count,
+                       FFT_PRECISION precision)
+{
+  switch (precision)
+  {
+    case FFT_PRECISION_DOUBLE:
+      sweep_deconvolver_impl<double>(length_sec, sample_rate, f_start, f_end,
+                                     sweep_amplitude,
+                                     response, response_n_count,
+                                     impulse_response, ir_n_count,
+                                     system_ir, system_ir_n_count);
+    break;
+    case FFT_PRECISION_FLOAT:
+      sweep_deconvolver_impl<float>(length_sec, sample_rate, f_start, f_end,
+                                    sweep_amplitude,
+                                    response, response_n_count,
+                                    impulse_response, ir_n_count,
+                                    system_ir, system_ir_n_count);
+    break;
+  }
+}
+
+// Coherent average of repeated takes.
+// Take k nominally starts at k * period, its actual
+// position is found by cross-correlation with the first take
+// within +-max_lag samples, so clock drift and jitter
+// between takes don't smear the average
+QVector<float> average_aligned_takes(float signal[],
+                                     int n_count,
+                                     int n_takes,
+                                     int period,
+                                     int max_lag)
+{
+  int segment_size = period + 2 * max_lag;
+
+  int n_fft = 1;
+  while (n_fft < segment_size + period)
+  {
+    n_fft *= 2;
+  }
+
+  // Reads signal with zeros outside of it
+  auto sample = [signal, n_count](qint64 n)
+  {
+    return ((n >= 0) && (n < n_count)) ? signal[n] : 0.0f;
+  };
+
+  QVector<double> reference(n_fft);
+  for (int i = 0; i < period; i++)
+  {
+    reference[i] = sample(i);
+  }
+
+  QVector<s_fftw_complex> reference_spectrum(n_fft / 2 + 1);
+  fft_r2c(n_fft, reference.data(), reference_spectrum.data());
+
+  QVector<qint64> take_start(n_takes);
+
+  parallel_for(n_takes - 1, [&](int job)
+  {
+    int take = job + 1;
+    qint64 segment_start = (qint64)take * period - max_lag;
+
+    QVector<double> segment(n_fft);
+    for (int i = 0; i < segment_size; i++)
+    {
+      segment[i] = sample(segment_start + i);
+    }
+
+    QVector<s_fftw_complex> segment_spectrum(n_fft / 2 + 1);
+    fft_r2c(n_fft, segment.data(), segment_spectrum.data());
+
+    spectrum_mul_conj(segment_spectrum.data(), reference_spectrum.data(),
+      segment_spectrum.data(), segment_spectrum.size());
+
+    fft_c2r(n_fft, segment_spectrum.data(), segment.data());
+
+    // segment[j] now holds correlation at lag j - max_lag
+    int best_lag = max_lag;
+    for (int j = 0; j <= 2 * max_lag; j++)
+    {
+      if (segment[j] > segment[best_lag])
+      {
+        best_lag = j;
       }
     }
+
+    take_start[take] = segment_start + best_lag;
+  });
+
+  QVector<float> average(period);
+
+  for (int take = 0; take < n_takes; take++)
+  {
+    for (int i = 0; i < period; i++)
+    {
+      average[i] += sample(take_start[take] + i);
+    }
+  }
+
+  for (int i = 0; i < period; i++)
+  {
+    average[i] /= n_takes;
   }
+
+  return average;
 }
 
-// Calculates correction frequency response
-// for auto-equalizer
-void calulate_autoeq_amplitude_response(int n_spectrum,
-                                        int sample_rate,
-                                        double *current_signal,
-                                        int n_current_samples,
-                                        double *ref_signal,
-                                        int n_ref_samples,
-                                        double *f_log_values,
-                                        double *db_values,
-                                        int n_autoeq_points
-                                       )
+// Nesting level of parallel_for() on the current thread
+static thread_local int parallel_for_depth = 0;
+
+// Contiguous range of parallel_for() jobs,
+// runs on a thread of the global pool
+class ParallelForRange : public QRunnable
 {
-  QVector<double> current_spectrum(n_spectrum);
-  QVector<double> ref_spectrum(n_spectrum);
+public:
+  ParallelForRange(const std::function<void(int)> &job, int begin, int end,
+                   QSemaphore &done) :
+    job(job), begin(begin), end(end), done(done)
+  {
+  }
 
-  // Calculate average spectrums of current signal
-  // and reference signal
-  fft_average(current_spectrum.data(), current_signal, n_spectrum,
-    n_current_samples, FFT_AVERAGE_MEAN);
+  void run() override
+  {
+    parallel_for_depth++;
 
-  fft_average(ref_spectrum.data(), ref_signal, n_spectrum,
-    n_ref_samples, FFT_AVERAGE_MEAN);
+    for (int i = begin; i < end; i++)
+    {
+      job(i);
+    }
 
-  // Calculate diff between spectrums
-  QVector<double> diff_spectrum(n_spectrum + 1);
-  QVector<double> diff_spectrum_log_freqs(n_spectrum + 1);
+    parallel_for_depth--;
+    done.release();
+  }
 
-  for (int i = 1; i < n_spectrum + 1; i++)
+private:
+  const std::function<void(int)> &job;
+  int begin;
+  int end;
+  QSemaphore &done;
+};
+
+// Runs job(i) for each i in [0, n_jobs).
+// Jobs are split into contiguous ranges,
+// one range per thread of the global pool.
+// Nested calls run serially, the outer call
+// already occupies the pool threads
+void parallel_for(int n_jobs, std::function<void(int)> job)
+{
+  QThreadPool *pool = QThreadPool::globalInstance();
+
+  int n_threads = qMin(n_jobs, qMax(1, pool->maxThreadCount()));
+
+  if ((n_threads <= 1) || (parallel_for_depth > 0))
   {
-    diff_spectrum[i] = 20.0 * log10(ref_spectrum[i - 1] / current_spectrum[i - 1]);
-    diff_spectrum_log_freqs[i] = log10(
-      (double)(i + 1)
-      / (double)(n_spectrum)
-      * sample_rate / 2
-    );
+    for (int i = 0; i < n_jobs; i++)
+    {
+      job(i);
+    }
+    return;
   }
 
-  diff_spectrum_log_freqs[0] = 0.0;
-  diff_spectrum[0] = diff_spectrum[1];
+  QSemaphore done;
 
-  gsl_interp_accel *acc = gsl_interp_accel_alloc ();
-  gsl_spline *spline = gsl_spline_alloc (gsl_interp_cspline,
-                                         n_spectrum + 1);
+  for (int t = 1; t < n_threads; t++)
+  {
+    int begin = (qint64)n_jobs * t / n_threads;
+    int end = (qint64)n_jobs * (t + 1) / n_threads;
+
+    pool->start(new ParallelForRange(job, begin, end, done));
+  }
+
+  ParallelForRange(job, 0, n_jobs / n_threads, done).run();
+
+  done.acquire(n_threads);
+}
 
-  gsl_spline_init (spline,
-                   diff_spectrum_log_freqs.data(),
-                   diff_spectrum.data(),
-                   n_spectrum + 1);
+// Calculates average amplitude value of each
+// frequency component of the signal in buffer
+// (Welch method).
+// Spectrum calculated on Hann-windowed slices
+// of n_spectrum * 2 samples, overlapping by
+// overlap fraction of slice length.
+// type:
+// FFT_AVERAGE_MAX - to get maximum value
+// FFT_AVERAGE_MEAN - to get mean value (RMS of all slices)
+template <typename Real>
+static void fft_average_impl(double *average_spectrum,
+                             Real *buffer,
+                             int n_spectrum,
+                             int n_samples,
+                             FFT_AVERAGE_TYPE type,
+                             double overlap)
+{
+  typedef typename FFTComplex<Real>::Type Complex;
 
-  // Interpolate diff spectrum to given frequency values
-  QVector<double> interpolated_diff_spectrum_log_freqs(n_autoeq_points * 100);
-  QVector<double> interpolated_diff_spectrum(n_autoeq_points * 100);
+  memset(average_spectrum, 0.0, n_spectrum * sizeof(double));
+
+  int slice_size = n_spectrum * 2;
+  int hop = slice_size * (1.0 - overlap);
+  if (hop < 1)
+  {
+    hop = 1;
+  }
 
-  for (int i = 0; i < n_autoeq_points * 100; i++)
+  if (n_samples < slice_size)
   {
-    interpolated_diff_spectrum_log_freqs[i] = (log10(20000.0) - log10(10.0))
-      * (double)(i) / (n_autoeq_points * 100 - 1) + log10(10.0);
+    return;
+  }
+
+  int n_slices = (n_samples - slice_size) / hop + 1;
 
-    interpolated_diff_spectrum[i] =
-      gsl_spline_eval(spline,
-                      interpolated_diff_spectrum_log_freqs[i],
-                      acc);
+  QVector<Real> window(slice_size);
+  double window_sum = 0.0;
 
+  for (int i = 0; i < slice_size; i++)
+  {
+    window[i] = 0.5 - 0.5 * cos(2.0 * M_PI * i / slice_size);
+    window_sum += window[i];
   }
 
-  int begin_f_pos = 0;
+  // Slices are split into contiguous chunks,
+  // each chunk has its own accumulator,
+  // accumulators are reduced in fixed order
+  int n_chunks = qMin(n_slices,
+                      qMax(1, QThreadPool::globalInstance()->maxThreadCount()));
 
-  for (int i = 0; i < n_autoeq_points - 1; i++)
+  QVector<QVector<double>> accumulators(n_chunks);
+
+  for (int chunk = 0; chunk < n_chunks; chunk++)
   {
-    double amplitude_sum = 0.0;
-    int prev_f_pos = begin_f_pos;
+    accumulators[chunk].fill(0.0, n_spectrum);
+  }
+
+  parallel_for(n_chunks, [&](int chunk)
+  {
+    double *accumulator = accumulators[chunk].data();
+
+    QVector<Real> slice(slice_size);
+    QVector<Complex> out(n_spectrum + 1);
+    QVector<Real> out_A(n_spectrum + 1);
+
+    int begin = (qint64)n_slices * chunk / n_chunks;
+    int end = (qint64)n_slices * (chunk + 1) / n_chunks;
+
+    for (int n = begin; n < end; n++)
+    {
+      Real *slice_data = buffer + (qint64)n * hop;
+
+      for (int i = 0; i < slice_size; i++)
+      {
+        slice[i] = slice_data[i] * window[i];
+      }
+
+      fft_r2c(slice_size, slice.data(), out.data());
+      spectrum_magnitude(out.data(), out_A.data(), out.size());
+
+      for (int i = 1; i < n_spectrum + 1; i++)
+      {
+        double A = out_A[i] / window_sum;
+        switch (type)
+        {
+          case FFT_AVERAGE_MAX:
+            if (A > accumulator[i - 1])
+            {
+              accumulator[i - 1] = A;
+            }
+          break;
+          case FFT_AVERAGE_MEAN:
+            accumulator[i - 1] += A * A;
+          break;
+        }
+      }
+    }
+  });
+
+  for (int chunk = 0; chunk < n_chunks; chunk++)
+  {
+    for (int i = 0; i < n_spectrum; i++)
+    {
+      switch (type)
+      {
+        case FFT_AVERAGE_MAX:
+          if (accumulators[chunk][i] > average_spectrum[i])
+          {
+            average_spectrum[i] = accumulators[chunk][i];
+          }
+        break;
+        case FFT_AVERAGE_MEAN:
+          average_spectrum[i] += accumulators[chunk][i];
+        break;
+      }
+    }
+  }
 
-    while (interpolated_diff_spectrum_log_freqs[begin_f_pos] < f_log_values[i])
+  // Mean of power, converted back to amplitude
+  if (type == FFT_AVERAGE_MEAN)
+  {
+    for (int i = 0; i < n_spectrum; i++)
     {
-      amplitude_sum += interpolated_diff_spectrum[begin_f_pos];
-      begin_f_pos++;
+      average_spectrum[i] = sqrt(average_spectrum[i] / n_slices);
     }
+  }
+}
+
+void fft_average(double *average_spectrum,
+                 double *buffer,
+                 int n_spectrum,
+                 int n_samples,
+                 FFT_AVERAGE_TYPE type,
+                 double overlap)
+{
+  fft_average_impl(average_spectrum, buffer, n_spectrum, n_samples, type, overlap);
+}
+
+void fft_average(double *average_spectrum,
+                 float *buffer,
+                 int n_spectrum,
+                 int n_samples,
+                 FFT_AVERAGE_TYPE type,
+                 double overlap)
+{
+  fft_average_impl(average_spectrum, buffer, n_spectrum, n_samples, type, overlap);
+}
+
+// Weight of spectrum bin in fractional-octave band
+struct s_band_weight
+{
+  int bin;
+  int band;
+  double weight;
+};
+
+// Keep weight tables for a few smoothing configurations
+#define FRACTIONAL_OCTAVE_CACHE_MAX_ENTRIES 8
+
+// Calculates weights of average_spectrum bins
+// (FFT bins 1..n_spectrum) in bands of 1/octave_fraction octave
+// centered at 10^f_log_values[i].
+// Weight is the part of bin width covered by the band,
+// so narrow low frequency bands still get the nearest bins.
+// Bands that do not cover any bin (below the first bin
+// or above Nyquist frequency) get the nearest bin.
+// Tables are cached per spectrum size, sample rate,
+// fraction and band centers
+static QVector<s_band_weight> fractional_octave_weights(int n_spectrum,
+                                                        int sample_rate,
+                                                        double *f_log_values,
+                                                        int n_bands,
+                                                        int octave_fraction)
+{
+  static QMutex cache_mutex;
+  static QHash<QByteArray, QVector<s_band_weight>> cache;
+
+  QByteArray key;
+  key.append((const char *)&n_spectrum, sizeof(int));
+  key.append((const char *)&sample_rate, sizeof(int));
+  key.append((const char *)&octave_fraction, sizeof(int));
+  key.append((const char *)f_log_values, n_bands * sizeof(double));
+
+  QMutexLocker locker(&cache_mutex);
+
+  if (cache.contains(key))
+  {
+    return cache.value(key);
+  }
+
+  QVector<s_band_weight> weights;
+
+  double bin_width = (double)sample_rate / 2.0 / n_spectrum;
+  double half_band = pow(2.0, 0.5 / octave_fraction);
+
+  for (int band = 0; band < n_bands; band++)
+  {
+    double f_center = pow(10.0, f_log_values[band]);
+    double f_low = f_center / half_band;
+    double f_high = f_center * half_band;
 
-    int end_f_pos = begin_f_pos;
+    int first_bin = qMax(1, (int)floor(f_low / bin_width - 0.5));
+    int last_bin = qMin(n_spectrum, (int)ceil(f_high / bin_width + 0.5));
 
-    while (interpolated_diff_spectrum_log_freqs[end_f_pos] < f_log_values[i + 1])
+    bool band_empty = true;
+
+    for (int k = first_bin; k <= last_bin; k++)
     {
-      amplitude_sum += interpolated_diff_spectrum[end_f_pos];
-      end_f_pos++;
+      double f_bin_low = (k - 0.5) * bin_width;
+      double f_bin_high = (k + 0.5) * bin_width;
+
+      double overlap = qMin(f_high, f_bin_high) - qMax(f_low, f_bin_low);
+
+      if (overlap > 0.0)
+      {
+        weights.append({k - 1, band, overlap / bin_width});
+        band_empty = false;
+      }
     }
 
-    amplitude_sum /= end_f_pos - prev_f_pos;
+    if (band_empty)
+    {
+      int nearest_bin = qBound(1, (int)round(f_center / bin_width), n_spectrum);
+      weights.append({nearest_bin - 1, band, 1.0});
+    }
+  }
 
-    db_values[i] = amplitude_sum;
+  if (cache.size() >= FRACTIONAL_OCTAVE_CACHE_MAX_ENTRIES)
+  {
+    cache.clear();
   }
+  cache.insert(key, weights);
 
-  db_values[n_autoeq_points - 1] =
-    db_values[n_autoeq_points - 2];
+  return weights;
+}
+
+// Calculates correction frequency response
+// for auto-equalizer.
+// Power ratio of reference and current signals
+// is calculated in fractional-octave bands
+// (octave_fraction = 3, 6, 12) around each point
+template <typename Real>
+static void calulate_autoeq_amplitude_response_impl(int n_spectrum,
+                                                    int sample_rate,
+                                                    Real *current_signal,
+                                                    int n_current_samples,
+                                                    Real *ref_signal,
+                                                    int n_ref_samples,
+                                                    double *f_log_values,
+                                                    double *db_values,
+                                                    int n_autoeq_points,
+                                                    int octave_fraction
+                                                   )
+{
+  QVector<double> current_spectrum(n_spectrum);
+  QVector<double> ref_spectrum(n_spectrum);
+
+  // Calculate average spectrums of current signal
+  // and reference signal
+  fft_average(current_spectrum.data(), current_signal, n_spectrum,
+    n_current_samples, FFT_AVERAGE_MEAN);
+
+  fft_average(ref_spectrum.data(), ref_signal, n_spectrum,
+    n_ref_samples, FFT_AVERAGE_MEAN);
+
+  QVector<s_band_weight> weights = fractional_octave_weights(n_spectrum,
+                                                             sample_rate,
+                                                             f_log_values,
+                                                             n_autoeq_points,
+                                                             octave_fraction);
+
+  // Accumulate power of both signals in bands
+  QVector<double> current_band_power(n_autoeq_points, 0.0);
+  QVector<double> ref_band_power(n_autoeq_points, 0.0);
+
+  for (int i = 0; i < weights.size(); i++)
+  {
+    const s_band_weight &w = weights[i];
+
+    current_band_power[w.band] += w.weight * pow(current_spectrum[w.bin], 2);
+    ref_band_power[w.band] += w.weight * pow(ref_spectrum[w.bin], 2);
+  }
+
+  for (int i = 0; i < n_autoeq_points; i++)
+  {
+    if ((current_band_power[i] > 0.0) && (ref_band_power[i] > 0.0))
+    {
+      db_values[i] = 10.0 * log10(ref_band_power[i] / current_band_power[i]);
+    }
+    else
+    {
+      db_values[i] = 0.0;
+    }
+  }
 
   // Normalize amplitude response
   double max_amplitude = -DBL_MAX;
@@ -701,6 +1480,44 @@ void calulate_autoeq_amplitude_response(int n_spectrum,
   }
 }
 
+void calulate_autoeq_amplitude_response(int n_spectrum,
+                                        int sample_rate,
+                                        double *current_signal,
+                                        int n_current_samples,
+                                        double *ref_signal,
+                                        int n_ref_samples,
+                                        double *f_log_values,
+                                        double *db_values,
+                                        int n_autoeq_points,
+                                        int octave_fraction
+                                       )
+{
+  calulate_autoeq_amplitude_response_impl(n_spectrum, sample_rate,
+                                          current_signal, n_current_samples,
+                                          ref_signal, n_ref_samples,
+                                          f_log_values, db_values,
+                                          n_autoeq_points, octave_fraction);
+}
+
+void calulate_autoeq_amplitude_response(int n_spectrum,
+                                        int sample_rate,
+                                        float *current_signal,
+                                        int n_current_samples,
+                                        float *ref_signal,
+                                        int n_ref_samples,
+                                        double *f_log_values,
+                                        double *db_values,
+                                        int n_autoeq_points,
+                                        int octave_fraction
+                                       )
+{
+  calulate_autoeq_amplitude_response_impl(n_spectrum, sample_rate,
+                                          current_signal, n_current_samples,
+                                          ref_signal, n_ref_samples,
+                                          f_log_values, db_values,
+                                          n_autoeq_points, octave_fraction);
+}
+
 // Generates logarithmic sweep signal
 // It can be used as a test signal to get inpulse response
 void generate_logarithmic_sweep(double length_sec,
@@ -718,7 +1535,7 @@ void generate_logarithmic_sweep(double length_sec,
 }
 
 // Resamples signal in buffer
-QVector<float> resample_vector(QVector<float> sourceBuffer,
+QVector<float> resample_vector(SampleSpan sourceBuffer,
                                float sourceSamplerate,
                                float targetSamplerate)
 {
@@ -726,7 +1543,7 @@ QVector<float> resample_vector(QVector<float> sourceBuffer,
 
   if (sourceSamplerate == targetSamplerate)
   {
-    targetBuffer = sourceBuffer;
+    targetBuffer = sourceBuffer.toVector();
   }
   else
   {
@@ -748,10 +1565,7 @@ QVector<float> resample_vector(QVector<float> sourceBuffer,
       signalIn[i] = 0.0;
     }
 
-    for (int i = k/2 - 1; i < sourceBuffer.size() + k/2 - 1; i++)
-    {
-      signalIn[i] = sourceBuffer[i - k/2 + 1];
-    }
+    sourceBuffer.copyTo(signalIn.data() + k/2 - 1);
 
     resampl->inp_count = sourceBuffer.size() + k/2 - 1 + k - 1;
     resampl->out_count = (sourceBuffer.size() + k/2 - 1 + k - 1) * ratio;
@@ -768,3 +1582,16 @@ QVector<float> resample_vector(QVector<float> sourceBuffer,
 
   return targetBuffer;
 }
+
+QVector<float> resample_vector(const QVector<float> &sourceBuffer,
+                               float sourceSamplerate,
+                               float targetSamplerate)
+{
+  // Same rate, share the data without copying
+  if (sourceSamplerate == targetSamplerate)
+  {
+    return sourceBuffer;
+  }
+
+  return resample_vector(SampleSpan(sourceBuffer), sourceSamplerate, targetSamplerate);
+}
@@ -21,6 +21,10 @@
 #define MATHFUNCTIONS_H
 
 #include <QVector>
+#include <functional>
+
+#include "fft_plan_cache.h"
+#include "sample_span.h"
 
 struct s_fftw_complex
 {
@@ -28,6 +32,12 @@ struct s_fftw_complex
   double imagine;
 };
 
+struct s_fftwf_complex
+{
+  float real;
+  float imagine;
+};
+
 void frequency_response_to_impulse_response(double w_in[],
                                             double A_in[],
                                             int n_count,
@@ -35,8 +45,22 @@ void frequency_response_to_impulse_response(double w_in[],
                                             int IR_n_count,
                                             int rate);
 
-void fft_convolver(float signal[], int signal_n_count, float impulse_response[], int ir_n_count);
+int minimum_phase_impulse_response(float IR[], int IR_n_count,
+                                   float tail_threshold_db);
+
+int find_peak_position(float data[], int n_count);
+
+// Precision selects double or single precision FFT.
+// Single precision halves memory traffic of long signals,
+// round-off error stays below -100 dB of signal peak
+void fft_convolver(float signal[], int signal_n_count,
+                   float impulse_response[], int ir_n_count,
+                   FFT_PRECISION precision = FFT_PRECISION_DOUBLE);
 
+// Regularized deconvolution, regularization_db sets
+// the test signal level (relative to its spectrum peak)
+// below which it is not inverted inside the band,
+// outside of the band regularization rises to 0 dB
 void fft_deconvolver(float signal_a[],
                      int signal_a_n_count,
                      float signal_c[],
@@ -45,16 +69,58 @@ void fft_deconvolver(float signal_a[],
                      int ir_n_count,
                      float lowcut_relative_frequency,
                      float highcut_relative_frequency,
-                     float noisegate_threshold_db
+                     float regularization_db,
+                     FFT_PRECISION precision = FFT_PRECISION_DOUBLE
                     );
 
+// Impulse response from the response to exponential
+// sweep (generate_logarithmic_sweep() with the same
+// parameters) by multiplication with the spectrum of
+// analytic inverse filter. Harmonic distortion is
+// separated in time and cut off.
+// Optional system_ir is removed from the result
+// by regularized division
+void sweep_deconvolver(double length_sec,
+                       int sample_rate,
+                       double f_start,
+                       double f_end,
+                       double sweep_amplitude,
+                       float response[],
+                       int response_n_count,
+                       float impulse_response[],
+                       int ir_n_count,
+                       float system_ir[] = nullptr,
+                       int system_ir_n_count = 0,
+                       FFT_PRECISION precision = FFT_PRECISION_DOUBLE
+                      );
+
+// Averages n_takes repetitions (period samples apart)
+// after aligning each one to the first by cross-correlation
+// within +-max_lag samples, returns one take
+QVector<float> average_aligned_takes(float signal[],
+                                     int n_count,
+                                     int n_takes,
+                                     int period,
+                                     int max_lag);
+
 enum FFT_AVERAGE_TYPE {FFT_AVERAGE_MEAN, FFT_AVERAGE_MAX};
 
-void fft_average(double *buffer,
-                 double *avrage_spectrum,
+void parallel_for(int n_jobs, std::function<void(int)> job);
+
+// Welch average spectrum, overlap is a fraction of slice length
+void fft_average(double *average_spectrum,
+                 double *buffer,
+                 int n_spectrum,
+                 int n_samples,
+                 FFT_AVERAGE_TYPE type,
+                 double overlap = 0.5);
+
+void fft_average(double *average_spectrum,
+                 float *buffer,
                  int n_spectrum,
                  int n_samples,
-                 FFT_AVERAGE_TYPE type);
+                 FFT_AVERAGE_TYPE type,
+                 double overlap = 0.5);
 
 void calulate_autoeq_amplitude_response(int n_spectrum,
                                         int sample_rate,
@@ -64,7 +130,20 @@ void calulate_autoeq_amplitude_response(int n_spectrum,
                                         int n_ref_samples,
                                         double *f_log_values,
                                         double *db_values,
-                                        int n_autoeq_points
+                                        int n_autoeq_points,
+                                        int octave_fraction = 3
+                                       );
+
+void calulate_autoeq_amplitude_response(int n_spectrum,
+                                        int sample_rate,
+                                        float *current_signal,
+                                        int n_current_samples,
+                                        float *ref_signal,
+                                        int n_ref_samples,
+                                        double *f_log_values,
+                                        double *db_values,
+                                        int n_autoeq_points,
+                                        int octave_fraction = 3
                                        );
 
 void generate_logarithmic_sweep(double length_sec,
@@ -74,7 +153,13 @@ void generate_logarithmic_sweep(double length_sec,
                                 double sweep_amplitude,
                                 float data[]);
 
-QVector<float> resample_vector(QVector<float> sourceBuffer,
+// Resamples a view, strided channels of interleaved
+// audio are read in place
+QVector<float> resample_vector(SampleSpan sourceBuffer,
+                               float sourceSamplerate,
+                               float targetSamplerate);
+
+QVector<float> resample_vector(const QVector<float> &sourceBuffer,
                                float sourceSamplerate,
                                float targetSamplerate);
 #endif //MATHFUNCTIONS_H
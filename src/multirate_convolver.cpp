@@ -0,0 +1,376 @@
+/*
+ * Copyright (C) 2018-2020 Oleg Kapitonov
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * --------------------------------------------------------------------------
+ */
+
+
+#include <cmath>
+#include <cstring>
+
+#include "multirate_convolver.h"
+#include "processor.h"
+
+MultirateConvolver::MultirateConvolver(QVector<float> leftImpulse,
+                                       QVector<float> rightImpulse,
+                                       int samplingRate,
+                                       bool multirate,
+                                       float headLengthMs)
+{
+  headConvproc = nullptr;
+  tailConvproc = nullptr;
+  errorDb = -INFINITY;
+
+  int impulseSize = qMax(leftImpulse.size(), rightImpulse.size());
+  leftImpulse.resize(impulseSize);
+  rightImpulse.resize(impulseSize);
+
+  decimation = multirate ? calculateDecimation(samplingRate) : 1;
+
+  // Tail convolver processes the decimated samples of every
+  // fragment, its partitions are longer than the quantum,
+  // so zita computes all of them in background threads and
+  // spreads the work over callbacks for extra latency
+  tailQuantum = fragm / decimation;
+  tailPartition = qMax((int)Convproc::MINPART, tailQuantum);
+  tailLatency = tailPartition - tailQuantum;
+
+  int filterSize = MULTIRATE_FILTER_TAPS_PER_PHASE * decimation;
+  int tailDelay = filterSize - 1 + tailLatency * decimation;
+  int crossfade = MULTIRATE_CROSSFADE_MS * samplingRate / 1000.0;
+  int headLength = qMax((int)(headLengthMs * samplingRate / 1000.0),
+                        tailDelay + crossfade);
+
+  if ((decimation == 1) || (impulseSize <= headLength))
+  {
+    decimation = 1;
+
+    headConvproc = new Convproc;
+    headConvproc->configure(1, 2, impulseSize, fragm, fragm, Convproc::MAXPART, 0.0);
+    headConvproc->impdata_create(0, 0, 1, leftImpulse.data(), 0, impulseSize);
+    headConvproc->impdata_create(0, 1, 1, rightImpulse.data(), 0, impulseSize);
+    headConvproc->start_process(CONVPROC_SCHEDULER_PRIORITY, CONVPROC_SCHEDULER_CLASS);
+
+    return;
+  }
+
+  // Decimator and interpolator share the lowpass,
+  // odd-length version of it filters the tail before
+  // decimation without shifting it
+  double cutoff = 0.45 / decimation;
+  filter = designLowpass(filterSize, cutoff);
+  QVector<float> tailFilter = designLowpass(filterSize + 1, cutoff);
+  int tailFilterCenter = filterSize / 2;
+
+  // Split impulse response into head and tail
+  int tailLength = (impulseSize - tailDelay + decimation - 1) / decimation;
+  int crossfadeStart = headLength - crossfade;
+
+  QVector<float> head[2];
+  QVector<float> tail[2];
+
+  for (int channel = 0; channel < 2; channel++)
+  {
+    const QVector<float> &impulse = (channel == 0) ? leftImpulse : rightImpulse;
+
+    head[channel] = impulse.mid(0, headLength);
+
+    QVector<float> fullRateTail(impulseSize);
+
+    for (int i = crossfadeStart; i < impulseSize; i++)
+    {
+      float fade = 1.0;
+      if (i < headLength)
+      {
+        fade = 0.5 - 0.5 * cos(M_PI * (i - crossfadeStart) / crossfade);
+        head[channel][i] *= 1.0 - fade;
+      }
+
+      fullRateTail[i] = impulse[i] * fade;
+    }
+
+    // Tail is advanced by the tail path delay and lowpass
+    // filtered against aliasing, decimated samples
+    // are scaled to keep the full-rate gain
+    tail[channel].resize(tailLength);
+
+    for (int m = 0; m < tailLength; m++)
+    {
+      int n = m * decimation + tailDelay - tailFilterCenter;
+
+      double sum = 0.0;
+      for (int k = 0; k < tailFilter.size(); k++)
+      {
+        if ((n + k >= 0) && (n + k < impulseSize))
+        {
+          sum += tailFilter[k] * fullRateTail[n + k];
+        }
+      }
+
+      tail[channel][m] = decimation * sum;
+    }
+
+    interpolatorHistory[channel].fill(0.0, MULTIRATE_FILTER_TAPS_PER_PHASE +
+                                      fragm / decimation);
+  }
+
+  decimatorHistory.fill(0.0, filterSize - 1 + fragm);
+
+  errorDb = qMax(calculateErrorDb(leftImpulse, head[0], tail[0]),
+                 calculateErrorDb(rightImpulse, head[1], tail[1]));
+
+  headConvproc = new Convproc;
+  headConvproc->configure(1, 2, headLength, fragm, fragm, Convproc::MAXPART, 0.0);
+  headConvproc->impdata_create(0, 0, 1, head[0].data(), 0, headLength);
+  headConvproc->impdata_create(0, 1, 1, head[1].data(), 0, headLength);
+  headConvproc->start_process(CONVPROC_SCHEDULER_PRIORITY, CONVPROC_SCHEDULER_CLASS);
+
+  tailConvproc = new Convproc;
+  tailConvproc->configure(1, 2, tailLength, tailQuantum, tailPartition,
+                          Convproc::MAXPART, 0.0);
+  tailConvproc->impdata_create(0, 0, 1, tail[0].data(), 0, tailLength);
+  tailConvproc->impdata_create(0, 1, 1, tail[1].data(), 0, tailLength);
+  tailConvproc->start_process(CONVPROC_SCHEDULER_PRIORITY, CONVPROC_SCHEDULER_CLASS);
+}
+
+MultirateConvolver::~MultirateConvolver()
+{
+  delete headConvproc;
+  delete tailConvproc;
+}
+
+// Decimation must divide the fragment into whole
+// decimated samples, at least a minimum zita quantum
+int MultirateConvolver::calculateDecimation(int samplingRate)
+{
+  int decimation = 1;
+
+  while ((decimation * 2 * MULTIRATE_TAIL_SAMPLERATE <= samplingRate) &&
+         (fragm / (decimation * 2) >= Convproc::MINQUANT))
+  {
+    decimation *= 2;
+  }
+
+  return decimation;
+}
+
+float *MultirateConvolver::inpdata()
+{
+  return headConvproc->inpdata(0);
+}
+
+float *MultirateConvolver::outdata(int channel)
+{
+  return headConvproc->outdata(channel);
+}
+
+void MultirateConvolver::process()
+{
+  if (decimation == 1)
+  {
+    headConvproc->process(true);
+    return;
+  }
+
+  decimate(headConvproc->inpdata(0));
+
+  headConvproc->process(true);
+  tailConvproc->process(true);
+
+  // Tail is added to the head output in place
+  for (int channel = 0; channel < 2; channel++)
+  {
+    interpolate(channel, headConvproc->outdata(channel));
+  }
+}
+
+// Polyphase decimator, only every 'decimation'-th
+// output of the lowpass filter is calculated
+void MultirateConvolver::decimate(const float *in)
+{
+  int filterSize = filter.size();
+  int block = fragm / decimation;
+
+  float *history = decimatorHistory.data();
+  float *out = tailConvproc->inpdata(0);
+
+  memcpy(history + filterSize - 1, in, fragm * sizeof(float));
+
+  for (int m = 0; m < block; m++)
+  {
+    const float *x = history + filterSize - 1 + m * decimation;
+
+    float sum = 0.0;
+    for (int k = 0; k < filterSize; k++)
+    {
+      sum += filter[k] * x[-k];
+    }
+
+    out[m] = sum;
+  }
+
+  memmove(history, history + fragm, (filterSize - 1) * sizeof(float));
+}
+
+// Polyphase interpolator, each output sample uses
+// one branch of the lowpass filter, result is added to out
+void MultirateConvolver::interpolate(int channel, float *out)
+{
+  int block = fragm / decimation;
+
+  float *history = interpolatorHistory[channel].data();
+
+  memcpy(history + MULTIRATE_FILTER_TAPS_PER_PHASE,
+         tailConvproc->outdata(channel),
+         block * sizeof(float));
+
+  for (int i = 0; i < fragm; i++)
+  {
+    const float *branch = filter.constData() + i % decimation;
+    const float *v = history + MULTIRATE_FILTER_TAPS_PER_PHASE + i / decimation;
+
+    float sum = 0.0;
+    for (int p = 0; p < MULTIRATE_FILTER_TAPS_PER_PHASE; p++)
+    {
+      sum += branch[p * decimation] * v[-p];
+    }
+
+    out[i] += decimation * sum;
+  }
+
+  memmove(history, history + block, MULTIRATE_FILTER_TAPS_PER_PHASE * sizeof(float));
+}
+
+// Blackman-windowed sinc lowpass, unity gain at DC
+QVector<float> MultirateConvolver::designLowpass(int size, double cutoff)
+{
+  QVector<float> lowpass(size);
+  double sum = 0.0;
+
+  for (int k = 0; k < size; k++)
+  {
+    double x = k - (size - 1) / 2.0;
+    double sinc = (x == 0.0) ? 2.0 * cutoff : sin(2.0 * M_PI * cutoff * x) / (M_PI * x);
+    double window = 0.42 - 0.5 * cos(2.0 * M_PI * k / (size - 1)) +
+      0.08 * cos(4.0 * M_PI * k / (size - 1));
+
+    lowpass[k] = sinc * window;
+    sum += lowpass[k];
+  }
+
+  for (int k = 0; k < size; k++)
+  {
+    lowpass[k] /= sum;
+  }
+
+  return lowpass;
+}
+
+// Builds impulse response of the multirate path
+// for each position of the impulse relative to
+// the decimation grid and compares it with
+// the full-rate impulse response
+double MultirateConvolver::calculateErrorDb(const QVector<float> &impulse,
+                                            const QVector<float> &head,
+                                            const QVector<float> &tail)
+{
+  int filterSize = filter.size();
+  int phaseTaps = MULTIRATE_FILTER_TAPS_PER_PHASE;
+
+  double energy = 0.0;
+  for (int i = 0; i < impulse.size(); i++)
+  {
+    energy += impulse[i] * impulse[i];
+  }
+
+  if (energy == 0.0)
+  {
+    return -INFINITY;
+  }
+
+  int responseSize = impulse.size() + filterSize;
+  double worstError = 0.0;
+
+  for (int phase = 0; phase < decimation; phase++)
+  {
+    // Decimator output for unit impulse at 'phase'
+    QVector<double> decimated(phaseTaps + 1);
+    for (int m = 0; m < decimated.size(); m++)
+    {
+      int k = m * decimation - phase;
+      if ((k >= 0) && (k < filterSize))
+      {
+        decimated[m] = filter[k];
+      }
+    }
+
+    // Tail convolution, delayed by the tail convolver latency
+    QVector<double> convolved(tailLatency + tail.size() + decimated.size());
+    for (int m = 0; m < decimated.size(); m++)
+    {
+      for (int j = 0; j < tail.size(); j++)
+      {
+        convolved[tailLatency + m + j] += decimated[m] * tail[j];
+      }
+    }
+
+    double error = 0.0;
+
+    for (int lag = 0; lag < responseSize; lag++)
+    {
+      int n = lag + phase;
+
+      double interpolated = 0.0;
+      for (int p = 0; p < phaseTaps; p++)
+      {
+        int m = n / decimation - p;
+        if ((m >= 0) && (m < convolved.size()))
+        {
+          interpolated += filter[n % decimation + p * decimation] * convolved[m];
+        }
+      }
+
+      double equivalent = decimation * interpolated;
+      if (lag < head.size())
+      {
+        equivalent += head[lag];
+      }
+
+      double reference = (lag < impulse.size()) ? impulse[lag] : 0.0;
+
+      error += (equivalent - reference) * (equivalent - reference);
+    }
+
+    worstError = qMax(worstError, error);
+  }
+
+  return 10.0 * log10(worstError / energy + 1e-30);
+}
+
+bool MultirateConvolver::isMultirate()
+{
+  return decimation > 1;
+}
+
+int MultirateConvolver::getDecimation()
+{
+  return decimation;
+}
+
+double MultirateConvolver::getErrorDb()
+{
+  return errorDb;
+}
@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2018-2020 Oleg Kapitonov
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * --------------------------------------------------------------------------
+ */
+
+
+#ifndef MULTIRATECONVOLVER_H
+#define MULTIRATECONVOLVER_H
+
+#include <QVector>
+
+#include <zita-convolver.h>
+
+// Tail of the cabinet impulse response is convolved
+// at this sample rate or above it (decimation is a power of 2)
+#define MULTIRATE_TAIL_SAMPLERATE 24000
+// Lowpass length of decimator and interpolator
+// in taps per polyphase branch
+#define MULTIRATE_FILTER_TAPS_PER_PHASE 24
+#define MULTIRATE_DEFAULT_HEAD_MS 20.0
+// Head and tail overlap, impulse response is split
+// by complementary raised cosine fades
+#define MULTIRATE_CROSSFADE_MS 2.0
+
+// Cabinet convolver with mono input and stereo output.
+// Head of the impulse response is convolved at full rate,
+// late tail (with little high frequency energy left) is
+// convolved at decimated rate through polyphase
+// lowpass decimator and interpolator and summed back in.
+// Delay of the tail path is compensated by advancing
+// the tail impulse response, so head must be longer than it.
+// When multirate is disabled or the sample rate is too low,
+// the whole impulse response is convolved at full rate
+class MultirateConvolver
+{
+public:
+  MultirateConvolver(QVector<float> leftImpulse,
+                     QVector<float> rightImpulse,
+                     int samplingRate,
+                     bool multirate,
+                     float headLengthMs = MULTIRATE_DEFAULT_HEAD_MS);
+  ~MultirateConvolver();
+
+  // Input buffer of the current fragment, previous
+  // processing stage writes fragm samples directly into it
+  float *inpdata();
+
+  // Processes the fragment in the input buffer, result
+  // stays in outdata() buffers until the next call
+  void process();
+  float *outdata(int channel);
+
+  bool isMultirate();
+  int getDecimation();
+
+  // Decimation of the tail at this sample rate,
+  // 1 when the rate is too low for multirate
+  static int calculateDecimation(int samplingRate);
+
+  // Worst-case difference between impulse responses
+  // of multirate and full-rate paths, relative to
+  // the full-rate impulse response energy
+  double getErrorDb();
+
+private:
+  Convproc *headConvproc;
+  Convproc *tailConvproc;
+
+  int decimation;
+  int tailQuantum;
+  int tailPartition;
+  int tailLatency;
+  double errorDb;
+
+  QVector<float> filter;
+
+  // State of the tail path, decimated input is written
+  // straight to the tail convolver and interpolator
+  // reads its output buffers
+  QVector<float> decimatorHistory;
+  QVector<float> interpolatorHistory[2];
+
+  static QVector<float> designLowpass(int size, double cutoff);
+
+  void decimate(const float *in);
+  void interpolate(int channel, float *out);
+
+  double calculateErrorDb(const QVector<float> &impulse,
+                          const QVector<float> &head,
+                          const QVector<float> &tail);
+};
+
+#endif // MULTIRATECONVOLVER_H
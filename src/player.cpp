@@ -22,12 +22,62 @@
 #include <QSharedPointer>
 
 #include "player.h"
+#include "level_kernels.h"
 
 #define RMS_COUNT_MAX 4800
+// Capture must survive analysis of a finished
+// test signal part while recording goes on
+#define CAPTURE_RINGBUFFER_SEC 30
+// Meter blocks are read by the GUI every METER_INTERVAL_MS,
+// ringbuffer holds periods of several intervals
+#define METER_INTERVAL_MS 40
+#define METER_RINGBUFFER_BLOCKS 256
+#define LOUDNESS_RINGBUFFER_SEC 2
+#define LOUDNESS_THREAD_INTERVAL_MS 20
+// Poll interval while waiting for the process callback to return
+#define CALLBACK_WAIT_INTERVAL_US 200
+
+// Input levels of one period, published from the
+// process callback to the GUI input meter,
+// output is measured by the loudness meter
+struct MeterBlock
+{
+  float inputSumSquares;
+  float inputPeak;
+  jack_nframes_t nframes;
+};
+
+// Block is dropped when the GUI does not keep up,
+// input may be nullptr when nothing is processed
+static void publish_meter_block(Player *inst, const float *in,
+                                const float *outL, const float *outR,
+                                jack_nframes_t nframes)
+{
+  MeterBlock block;
+
+  block.inputSumSquares = (in != nullptr) ? block_sum_squares(in, nframes) : 0.0;
+  block.inputPeak = (in != nullptr) ? block_peak(in, nframes) : 0.0;
+  block.nframes = nframes;
+
+  if (jack_ringbuffer_write_space(inst->meterRingbuffer) >= sizeof(MeterBlock))
+  {
+    jack_ringbuffer_write(inst->meterRingbuffer, (const char *)&block,
+                          sizeof(MeterBlock));
+  }
 
-int peakRMScount = 0;
-double peakInputRMSsum = 0.0;
-double peakOutputRMSsum = 0.0;
+  // Whole period is written or dropped
+  size_t samplesSize = sizeof (jack_default_audio_sample_t) * nframes;
+
+  if ((inst->loudnessRingbuffer != nullptr) &&
+      (jack_ringbuffer_write_space(inst->loudnessRingbuffer) >=
+       sizeof(jack_nframes_t) + 2 * samplesSize))
+  {
+    jack_ringbuffer_write(inst->loudnessRingbuffer, (const char *)&nframes,
+                          sizeof(jack_nframes_t));
+    jack_ringbuffer_write(inst->loudnessRingbuffer, (const char *)outL, samplesSize);
+    jack_ringbuffer_write(inst->loudnessRingbuffer, (const char *)outR, samplesSize);
+  }
+}
 
 static int process (jack_nframes_t nframes, void *arg)
 {
@@ -42,13 +92,20 @@ static int process (jack_nframes_t nframes, void *arg)
   outR = (jack_default_audio_sample_t *)jack_port_get_buffer (inst->output_port_right,
                                                               nframes);
 
-  switch (inst->status)
+  jack_time_t startTime = jack_get_time();
+
+  inst->callbackRunning = true;
+
+  Player::PlayerStatus status = inst->status;
+
+  // Discard stale data of the reference after open or seek,
+  // DI stream is read only by the lookahead renderer
+  inst->refSource->flush();
+
+  switch (status)
   {
     case Player::PlayerStatus::PS_STOP:
     {
-      inst->diPos = 0;
-      inst->refPos = 0;
-
       memset(outL, 0, sizeof (jack_default_audio_sample_t) * nframes);
       memset(outR, 0, sizeof (jack_default_audio_sample_t) * nframes);
     }
@@ -61,67 +118,17 @@ static int process (jack_nframes_t nframes, void *arg)
     break;
     case Player::PlayerStatus::PS_PLAY_DI:
     {
-      if (inst->diData.size() != 0)
+      if (inst->diSource->isOpen())
       {
-        if ((inst->diPos + nframes) > (unsigned int)inst->diData.size())
-        {
-          QVector<float> tempBuffer(nframes);
-
-          for (unsigned int i = inst->diPos;
-               i < (unsigned int)inst->diData.size(); i++)
-          {
-            tempBuffer[i - inst->diPos] = inst->diData[i];
-            peakInputRMSsum += pow(inst->diData[i], 2);
-          }
-
-          for (unsigned int i = 0;
-               i < (nframes - inst->diData.size() + inst->diPos); i++)
-          {
-            tempBuffer[i + inst->diData.size() - inst->diPos] = inst->diData[i];
-            peakInputRMSsum += pow(inst->diData[i], 2);
-            inst->incRMScounter();
-          }
-
-          inst->processor->process(outL,
-                                   outR,
-                                   tempBuffer.data(),
-                                   nframes);
-
-          for (unsigned int i = 0; i < nframes; i++)
-          {
-            peakOutputRMSsum += pow(outL[i], 2);
-          }
-
-          inst->diPos = inst->diPos + nframes - inst->diData.size();
-        }
-        else
-        {
-          for (unsigned int i = 0; i < nframes; i++)
-          {
-            peakInputRMSsum += pow(inst->diData[i + inst->diPos], 2);
-            inst->incRMScounter();
-          }
-          inst->processor->process(outL,
-                                   outR,
-                                   inst->diData.data() + inst->diPos,
-                                   nframes);
-
-          for (unsigned int i = 0; i < nframes; i++)
-          {
-            peakOutputRMSsum += pow(outL[i], 2);
-          }
-
-          inst->diPos += nframes;
-        }
+        float *diBuffer = inst->diBuffer.data();
 
-        if ((inst->refPos + nframes) > (unsigned int)inst->refDataL.size())
-        {
-          inst->refPos = inst->refPos + nframes - inst->refDataL.size();
-        }
-        else
-        {
-          inst->refPos += nframes;
-        }
+        // Processed ahead by the lookahead renderer.
+        // Reference advances too, so switching
+        // between DI and Reference keeps the position
+        inst->lookaheadRenderer->read(diBuffer, outL, outR, nframes);
+        inst->refSource->skip(nframes);
+
+        publish_meter_block(inst, diBuffer, outL, outR, nframes);
       }
       else
       {
@@ -132,68 +139,19 @@ static int process (jack_nframes_t nframes, void *arg)
     break;
     case Player::PlayerStatus::PS_PLAY_REF:
     {
-      if (inst->refDataL.size() != 0)
+      if (inst->refSource->isOpen())
       {
-        if ((inst->refPos + nframes) > (unsigned int)inst->refDataL.size())
-        {
-          for (int i = inst->refPos; i < inst->refDataL.size(); i++)
-          {
-            outL[i - inst->refPos] = inst->refDataL[i] * inst->getLevel();
-            peakInputRMSsum += 0.0;
-            peakOutputRMSsum += pow(outL[i - inst->refPos], 2);
-            inst->incRMScounter();
-          }
-
-          for (unsigned int i = 0;
-               i < (nframes - inst->refDataL.size() + inst->refPos); i++)
-          {
-            outL[i + inst->refDataL.size() - inst->refPos] = inst->refDataL[i] *
-              inst->getLevel();
-            peakInputRMSsum += 0.0;
-            peakOutputRMSsum += pow(outL[i + inst->refDataL.size() - inst->refPos], 2);
-            inst->incRMScounter();
-          }
-
-          for (int i = inst->refPos; i < inst->refDataR.size(); i++)
-          {
-            outR[i - inst->refPos] = inst->refDataR[i] * inst->getLevel();
-          }
-
-          for (unsigned int i = 0;
-               i < (nframes - inst->refDataR.size() + inst->refPos); i++)
-          {
-            outR[i + inst->refDataR.size() - inst->refPos] = inst->refDataR[i] *
-              inst->getLevel();
-          }
-
-          inst->refPos = inst->refPos + nframes - inst->refDataL.size();
-        }
-        else
-        {
-          for (unsigned int i = inst->refPos; i < nframes + inst->refPos; i++)
-          {
-            outL[i - inst->refPos] = inst->refDataL[i] * inst->getLevel();
-            peakInputRMSsum += 0.0;
-            peakOutputRMSsum += pow(outL[i - inst->refPos], 2);
-            inst->incRMScounter();
-          }
-
-          for (unsigned int i = inst->refPos; i < nframes + inst->refPos; i++)
-          {
-            outR[i - inst->refPos] = inst->refDataR[i] * inst->getLevel();
-          }
-
-          inst->refPos += nframes;
-        }
+        inst->refSource->read(outL, outR, nframes);
 
-        if ((inst->diPos + nframes) > (unsigned int)inst->diData.size())
-        {
-          inst->diPos = inst->diPos + nframes - inst->diData.size();
-        }
-        else
+        float gain = inst->getLevel() * inst->refGain;
+
+        for (unsigned int i = 0; i < nframes; i++)
         {
-          inst->diPos += nframes;
+          outL[i] *= gain;
+          outR[i] *= gain;
         }
+
+        publish_meter_block(inst, nullptr, outL, outR, nframes);
       }
       else
       {
@@ -204,21 +162,83 @@ static int process (jack_nframes_t nframes, void *arg)
     break;
     case Player::PlayerStatus::PS_MONITOR:
     {
+      float inputLevel = inst->inputLevel;
+
       for (unsigned int i = 0; i < nframes; i++)
       {
-        in[i] *= inst->inputLevel;
-        peakInputRMSsum += pow(in[i], 2);
-        inst->incRMScounter();
+        in[i] *= inputLevel;
       }
       inst->processor->process(outL, outR, in, nframes);
 
+      publish_meter_block(inst, in, outL, outR, nframes);
+    }
+    break;
+    case Player::PlayerStatus::PS_PROFILE:
+    {
       for (unsigned int i = 0; i < nframes; i++)
       {
-        peakOutputRMSsum += pow(outL[i], 2);
+        if (inst->profilePos < (unsigned int)inst->profileData.size())
+        {
+          outL[i] = inst->profileData[inst->profilePos];
+          inst->profilePos++;
+        }
+        else
+        {
+          outL[i] = 0.0;
+        }
+      }
+
+      memcpy(outR, outL, sizeof (jack_default_audio_sample_t) * nframes);
+
+      size_t captureSize = sizeof (jack_default_audio_sample_t) * nframes;
+
+      if (jack_ringbuffer_write_space(inst->captureRingbuffer) >= captureSize)
+      {
+        jack_ringbuffer_write(inst->captureRingbuffer, (const char *)in, captureSize);
+      }
+      else
+      {
+        inst->captureOverflow = true;
       }
     }
     break;
   }
+
+  // Load is measured only in modes that run the processor,
+  // lookahead renderer measures DI mode load itself
+  if (status == Player::PlayerStatus::PS_MONITOR)
+  {
+    float load = (jack_get_time() - startTime) * inst->getSampleRate() /
+      (1.0e6 * nframes);
+
+    if (load > inst->dspLoadPeak)
+    {
+      inst->dspLoadPeak = load;
+    }
+  }
+
+  inst->callbackRunning = false;
+
+  return 0;
+}
+
+static int xrun_callback(void *arg)
+{
+  Player *inst = (Player *)arg;
+
+  inst->xrunCount++;
+
+  return 0;
+}
+
+// Called by JACK while process() is not running
+static int buffer_size_callback(jack_nframes_t nframes, void *arg)
+{
+  Player *inst = (Player *)arg;
+
+  inst->diBuffer.resize(nframes);
+  inst->lookaheadRenderer->setPeriodSize(nframes);
+
   return 0;
 }
 
@@ -252,11 +272,31 @@ static void jack_shutdown(void*)
 Player::Player()
 {
   simple_quit = 0;
-  diPos = 0;
-  refPos = 0;
+  profilePos = 0;
+  captureOverflow = false;
+  processor = nullptr;
+  dspLoadPeak = 0.0f;
+  xrunCount = 0;
 
   status = PS_STOP;
 
+  meterRingbuffer = jack_ringbuffer_create(sizeof(MeterBlock) *
+                                           METER_RINGBUFFER_BLOCKS);
+
+  meterTimer = new QTimer(this);
+  meterTimer->setInterval(METER_INTERVAL_MS);
+  connect(meterTimer, &QTimer::timeout, this, &Player::meterTimeout);
+  meterTimer->start();
+
+  governorTimer = new QTimer(this);
+  governorTimer->setInterval(GOVERNOR_INTERVAL_MS);
+  connect(governorTimer, &QTimer::timeout, this, &Player::governorTimeout);
+
+  lookaheadSyncTimer = new QTimer(this);
+  lookaheadSyncTimer->setInterval(LOOKAHEAD_SYNC_INTERVAL_MS);
+  connect(lookaheadSyncTimer, &QTimer::timeout, this, &Player::syncLookaheadProcessor);
+  lookaheadSyncTimer->start();
+
   equalDataRMSThread = new EqualDataRMSThread();
   connect(equalDataRMSThread, &QThread::finished, this,
           &Player::equalDataRMSThreadFinished);
@@ -265,25 +305,29 @@ Player::Player()
 Player::~Player()
 {
   jack_client_close(client);
-}
 
-void Player::incRMScounter()
-{
-  if (peakRMScount < RMS_COUNT_MAX)
+  if (loudnessMeterThread != nullptr)
   {
-    peakRMScount++;
+    loudnessMeterThread->requestInterruption();
+    loudnessMeterThread->wait();
+    delete loudnessMeterThread;
   }
-  else
+
+  if (loudnessRingbuffer != nullptr)
   {
-    float peakInputRMSvalue = sqrt(peakInputRMSsum / peakRMScount);
-    float peakOutputRMSvalue = sqrt(peakOutputRMSsum / peakRMScount);
+    jack_ringbuffer_free(loudnessRingbuffer);
+  }
 
-    peakRMScount = 0;
-    peakInputRMSsum = 0.0;
-    peakOutputRMSsum = 0.0;
+  delete lookaheadRenderer;
+  delete diSource;
+  delete refSource;
 
-    emit peakRMSValueCalculated(peakInputRMSvalue, peakOutputRMSvalue);
+  if (captureRingbuffer != nullptr)
+  {
+    jack_ringbuffer_free(captureRingbuffer);
   }
+
+  jack_ringbuffer_free(meterRingbuffer);
 }
 
 int Player::connectToJack()
@@ -332,12 +376,38 @@ int Player::connectToJack()
 
   jack_set_session_callback(client, session_callback, this);
 
+  jack_set_xrun_callback(client, xrun_callback, this);
+
+  jack_set_buffer_size_callback(client, buffer_size_callback, this);
+
   /* display the current sample rate.
   */
 
   printf ("engine sample rate: %" PRIu32 "\n", jack_get_sample_rate (client));
   sampleRate = jack_get_sample_rate (client);
 
+  captureRingbuffer = jack_ringbuffer_create(sizeof (jack_default_audio_sample_t) *
+                                             sampleRate * CAPTURE_RINGBUFFER_SEC);
+
+  loudnessRingbuffer = jack_ringbuffer_create(sizeof (jack_default_audio_sample_t) *
+                                              2 * sampleRate * LOUDNESS_RINGBUFFER_SEC);
+
+  diBuffer.resize(jack_get_buffer_size(client));
+
+  diSource = new StreamingSource(1, sampleRate);
+  diSource->start();
+  refSource = new StreamingSource(2, sampleRate);
+  refSource->start();
+
+  lookaheadRenderer = new LookaheadRenderer(this);
+  lookaheadRenderer->setPeriodSize(jack_get_buffer_size(client));
+  lookaheadRenderer->start();
+
+  loudnessMeterThread = new LoudnessMeterThread();
+  loudnessMeterThread->player = this;
+  loudnessMeterThread->samplingRate = sampleRate;
+  loudnessMeterThread->start();
+
 /* create two ports */
 
   input_port = jack_port_register (client, "input",
@@ -369,25 +439,166 @@ int Player::activate()
     return 1;
   }
 
+  governorTimer->start();
+
   return 0;
 }
 
 void Player::setDiData(QVector<float> data)
 {
   diData = data;
+  diFileName.clear();
+
+  if (diSource != nullptr)
+  {
+    diSource->openData(data, QVector<float>());
+  }
+
   emit dataChanged();
 }
 
 void Player::setRefData(QVector<float> dataL, QVector<float> dataR)
 {
+  refDataL = dataL;
+  refDataR = dataR;
+  refFileName.clear();
+
+  if (refSource != nullptr)
+  {
+    refSource->openData(dataL, dataR);
+  }
+
+  refGain = 1.0;
+  emit dataChanged();
+}
+
+bool Player::setDiFile(QString filename)
+{
+  bool opened = diSource->open(filename);
+
+  // Excerpt of the previous file is not valid anymore
+  diFileName = opened ? filename : QString();
+  diData.clear();
+  emit dataChanged();
+
+  return opened;
+}
+
+bool Player::setRefFile(QString filename)
+{
+  bool opened = refSource->open(filename);
+
+  refFileName = opened ? filename : QString();
+  refDataL.clear();
+  refDataR.clear();
+  refGain = 1.0;
+  emit dataChanged();
+
+  return opened;
+}
+
+void Player::setDiExcerpt(QString filename, QVector<float> data)
+{
+  if (filename != diFileName)
+  {
+    return;
+  }
+
+  diData = data;
+  emit dataChanged();
+}
+
+void Player::setRefExcerpt(QString filename, QVector<float> dataL,
+                           QVector<float> dataR)
+{
+  if (filename != refFileName)
+  {
+    return;
+  }
+
   refDataL = dataL;
   refDataR = dataR;
   emit dataChanged();
 }
 
+bool Player::isDiLoaded()
+{
+  return (diSource != nullptr) && diSource->isOpen();
+}
+
+// Both streams are moved to keep them in sync
+void Player::seek(qint64 frame)
+{
+  diSource->seek(frame);
+  refSource->seek(frame);
+  lookaheadRenderer->reset();
+  diStreamInSync = true;
+}
+
+// Reference advances with every played frame in both playback
+// modes, DI stream is read ahead by the lookahead renderer
+qint64 Player::getPlaybackPosition()
+{
+  return refSource->getPosition();
+}
+
+qint64 Player::getPlaybackLength()
+{
+  return refSource->getLength();
+}
+
 void Player::setStatus(PlayerStatus newStatus)
 {
+  PlayerStatus oldStatus = status;
+
+  // Integrated loudness is measured from the start
+  // of playback, resuming from pause continues it
+  bool playing = (newStatus == PS_PLAY_DI) || (newStatus == PS_PLAY_REF) ||
+    (newStatus == PS_MONITOR);
+
+  if (playing && (newStatus != oldStatus) && (oldStatus != PS_PAUSE) &&
+      (loudnessMeterThread != nullptr))
+  {
+    loudnessMeterThread->resetRequested = true;
+  }
+
+  if (diSource == nullptr)
+  {
+    status = newStatus;
+    return;
+  }
+
+  if (newStatus == PS_PLAY_REF)
+  {
+    diStreamInSync = false;
+  }
+
+  // DI stream stands still while the reference plays,
+  // it is moved to the played position before rendering
+  if ((newStatus == PS_PLAY_DI) && !diStreamInSync)
+  {
+    diSource->seek(refSource->getPosition());
+    lookaheadRenderer->reset();
+    diStreamInSync = true;
+  }
+
   status = newStatus;
+
+  if (newStatus == PS_PLAY_DI)
+  {
+    // Renderer starts with the current parameters
+    syncLookaheadProcessor();
+    return;
+  }
+
+  // DI stream may be moved once the renderer is idle
+  lookaheadRenderer->waitIdle();
+
+  // Stop rewinds playback to the start
+  if ((newStatus == PS_STOP) && (oldStatus != PS_STOP))
+  {
+    seek(0);
+  }
 }
 
 void Player::setProcessor(Processor *prc)
@@ -395,6 +606,32 @@ void Player::setProcessor(Processor *prc)
   processor = prc;
 }
 
+// Lookahead renderer processes DI playback with its own copy
+// of the processor, parameter changes are handed over as a new
+// copy. Copies are made on the GUI thread, which changes the
+// parameters, and only in DI mode
+void Player::syncLookaheadProcessor()
+{
+  if ((processor == nullptr) || (lookaheadRenderer == nullptr) ||
+      (status != PS_PLAY_DI))
+  {
+    return;
+  }
+
+  unsigned int changesCount = processor->getChangesCount();
+
+  if ((processor == lookaheadSourceProcessor) &&
+      (changesCount == lookaheadChangesCount))
+  {
+    return;
+  }
+
+  lookaheadSourceProcessor = processor;
+  lookaheadChangesCount = changesCount;
+
+  lookaheadRenderer->setProcessor(processor->clone(true));
+}
+
 int Player::getSampleRate()
 {
   return sampleRate;
@@ -407,7 +644,7 @@ void Player::equalDataRMS()
     return;
   }
 
-  if (refDataL.size() == 0)
+  if ((refDataL.size() == 0) || (diData.size() == 0))
   {
     emit equalRMSFinished();
     return;
@@ -446,16 +683,7 @@ void EqualDataRMSThread::run()
   QVector<float> processedDataR(player->diData.size());
 
   QSharedPointer<Processor> backProcessor
-    = QSharedPointer<Processor>(new Processor(processor->getSamplingRate()));
-
-  backProcessor->loadProfile(processor->getProfileFileName());
-
-  backProcessor->setControls(processor->getControls());
-  backProcessor->setProfile(processor->getProfile());
-
-  backProcessor->setPreampImpulse(processor->getPreampImpulse());
-  backProcessor->setCabinetImpulse(processor->getLeftImpulse(),
-                                   processor->getRightImpulse());
+    = QSharedPointer<Processor>(processor->clone());
 
   QVector<double> w(processor->correctionEqualizerFLogValues.size());
   QVector<double> A(processor->correctionEqualizerFLogValues.size());
@@ -495,26 +723,319 @@ void EqualDataRMSThread::run()
                          player->diData.data(),
                          sizeToFragm);
 
-  double rmsProcessedData = 0.0;
-  for (int i = 0; i < processedDataL.size(); i++)
+  // Reference is matched by integrated loudness,
+  // both signals are measured as stereo
+  LoudnessMeter processedMeter(processor->getSamplingRate(), 2);
+  const float *processedData[2] = {processedDataL.constData(),
+                                   processedDataR.constData()};
+  processedMeter.process(processedData, processedDataL.size());
+
+  LoudnessMeter refMeter(processor->getSamplingRate(), 2);
+  const float *refData[2] = {player->refDataL.constData(),
+                             player->refDataR.constData()};
+  refMeter.process(refData, player->refDataL.size());
+
+  double loudnessRatio = pow(10.0, (refMeter.getIntegrated() -
+    processedMeter.getIntegrated()) / 20.0);
+
+  // Nothing to match when either signal is below the gate
+  if (!std::isfinite(loudnessRatio) || (loudnessRatio <= 0.0))
+  {
+    return;
+  }
+
+  // Applied to the streamed reference on playback
+  player->refGain = 1.0 / loudnessRatio;
+}
+
+// Status and callbackRunning are sequentially consistent:
+// a callback that is not running when the new status is set
+// starts with the new status, so only a running one may
+// still use the state of the previous status.
+// The callback can not signal a condition from the
+// realtime thread, it is polled instead
+void Player::waitProcessCallback()
+{
+  while (callbackRunning)
+  {
+    QThread::usleep(CALLBACK_WAIT_INTERVAL_US);
+  }
+}
+
+void Player::startProfiling(QVector<float> testSignal)
+{
+  status = PS_STOP;
+
+  // Callback of the previous profiling may still
+  // read profileData and write the ringbuffer
+  waitProcessCallback();
+
+  profileData = testSignal;
+  profilePos = 0;
+  captureOverflow = false;
+  jack_ringbuffer_reset(captureRingbuffer);
+
+  status = PS_PROFILE;
+}
+
+void Player::stopProfiling()
+{
+  if (status == PS_PROFILE)
+  {
+    status = PS_STOP;
+  }
+}
+
+bool Player::isProfiling()
+{
+  return status == PS_PROFILE;
+}
+
+bool Player::isCaptureOverflow()
+{
+  return captureOverflow;
+}
+
+// Reads up to n_count captured samples, returns number of samples read
+int Player::readCapture(float *data, int n_count)
+{
+  size_t available = jack_ringbuffer_read_space(captureRingbuffer) /
+    sizeof (jack_default_audio_sample_t);
+
+  int n_read = qMin((size_t)n_count, available);
+
+  jack_ringbuffer_read(captureRingbuffer, (char *)data,
+                       sizeof (jack_default_audio_sample_t) * n_read);
+
+  return n_read;
+}
+
+// Delay from the output ports through the amplifier
+// back to the input port, in samples
+int Player::getRoundTripLatency()
+{
+  jack_latency_range_t playbackLatency;
+  jack_latency_range_t captureLatency;
+
+  jack_port_get_latency_range(output_port_left, JackPlaybackLatency, &playbackLatency);
+  jack_port_get_latency_range(input_port, JackCaptureLatency, &captureLatency);
+
+  return playbackLatency.max + captureLatency.max;
+}
+
+void Player::setGovernorEnabled(bool enabled)
+{
+  governorEnabled = enabled;
+
+  if (!enabled)
+  {
+    setQualityTier(QUALITY_FULL, "governor disabled");
+  }
+}
+
+bool Player::isGovernorEnabled()
+{
+  return governorEnabled;
+}
+
+void Player::governorTimeout()
+{
+  float load = dspLoadPeak.exchange(0.0f);
+  int xruns = xrunCount.exchange(0);
+
+  // Lookahead underruns are xruns of DI playback
+  if (lookaheadRenderer != nullptr)
+  {
+    xruns += lookaheadRenderer->underrunsCount.exchange(0);
+  }
+
+  // Cabinet changes postponed until the processing
+  // thread took the previous new convolver
+  if (processor != nullptr)
+  {
+    processor->rebuildPendingConvolvers();
+  }
+
+  if (!governorEnabled || (processor == nullptr) ||
+      ((status != PS_PLAY_DI) && (status != PS_MONITOR)))
+  {
+    governorCalmIntervals = 0;
+    return;
+  }
+
+  int tier = processor->getQualityTier();
+
+  char trigger[64];
+  snprintf(trigger, sizeof(trigger), "DSP load peak %.0f%%, xruns %d",
+           load * 100.0, xruns);
+
+  // Step up that survived without overload resets the wait
+  if (governorIntervalsSinceStepUp >= 0)
+  {
+    governorIntervalsSinceStepUp++;
+
+    if (governorIntervalsSinceStepUp >= GOVERNOR_STEP_UP_INTERVALS)
+    {
+      governorStepUpIntervals = GOVERNOR_STEP_UP_INTERVALS;
+      governorIntervalsSinceStepUp = -1;
+    }
+  }
+
+  if ((xruns > 0) || (load > GOVERNOR_STEP_DOWN_LOAD))
+  {
+    governorCalmIntervals = 0;
+
+    if (tier < QUALITY_TIER_COUNT - 1)
+    {
+      // Overload soon after a step up means the higher
+      // tier does not fit, wait longer before the next try
+      if (governorIntervalsSinceStepUp >= 0)
+      {
+        governorStepUpIntervals = qMin(governorStepUpIntervals * 2,
+                                       GOVERNOR_STEP_UP_INTERVALS_MAX);
+      }
+
+      governorIntervalsSinceStepUp = -1;
+      setQualityTier(nextQualityTier(tier, 1), trigger);
+    }
+  }
+  else if (load < GOVERNOR_STEP_UP_LOAD)
+  {
+    governorCalmIntervals++;
+
+    if ((tier > QUALITY_FULL) && (governorCalmIntervals >= governorStepUpIntervals))
+    {
+      governorCalmIntervals = 0;
+      governorIntervalsSinceStepUp = 0;
+      setQualityTier(nextQualityTier(tier, -1), trigger);
+    }
+  }
+  else
+  {
+    governorCalmIntervals = 0;
+  }
+}
+
+// Multirate cabinet tier is the same as the previous
+// one when the sample rate is too low to decimate
+int Player::nextQualityTier(int tier, int step)
+{
+  tier += step;
+
+  if ((tier == QUALITY_MULTIRATE_CABINET) &&
+      !processor->isCabinetMultirateAvailable())
+  {
+    tier += step;
+  }
+
+  return tier;
+}
+
+void Player::setQualityTier(int tier, const char *trigger)
+{
+  if ((processor == nullptr) || (processor->getQualityTier() == tier))
+  {
+    return;
+  }
+
+  fprintf(stderr, "CPU governor: quality tier %d -> %d, %s\n",
+          processor->getQualityTier(), tier, trigger);
+
+  processor->setQualityTier(tier);
+
+  emit qualityTierChanged(tier);
+}
+
+// Accumulates meter blocks published by the process
+// callback and reports levels every RMS_COUNT_MAX samples
+void Player::meterTimeout()
+{
+  MeterBlock block;
+
+  while (jack_ringbuffer_read_space(meterRingbuffer) >= sizeof(MeterBlock))
   {
-    rmsProcessedData += pow((processedDataL[i] +
-      processedDataR[i]) / 2.0, 2);
+    jack_ringbuffer_read(meterRingbuffer, (char *)&block, sizeof(MeterBlock));
+
+    meterInputSumSquares += block.inputSumSquares;
+    meterInputPeak = qMax(meterInputPeak, block.inputPeak);
+    meterCount += block.nframes;
+
+    if (meterCount >= RMS_COUNT_MAX)
+    {
+      emit peakRMSValueCalculated(sqrt(meterInputSumSquares / meterCount),
+                                  meterInputPeak);
+
+      meterCount = 0;
+      meterInputSumSquares = 0.0;
+      meterInputPeak = 0.0;
+    }
   }
-  rmsProcessedData = sqrt(rmsProcessedData / processedDataL.size());
 
-  double rmsRefData = 0.0;
-  for (int i = 0; i < player->refDataL.size(); i++)
+  if ((loudnessMeterThread != nullptr) &&
+      (loudnessMeterThread->updatesCount != loudnessUpdatesCount))
   {
-    rmsRefData += pow((player->refDataL[i] + player->refDataR[i]) / 2.0, 2);
+    loudnessUpdatesCount = loudnessMeterThread->updatesCount;
+
+    emit loudnessCalculated(loudnessMeterThread->momentary,
+                            loudnessMeterThread->shortTerm,
+                            loudnessMeterThread->integrated,
+                            loudnessMeterThread->truePeak);
   }
-  rmsRefData = sqrt(rmsRefData / player->refDataL.size());
+}
+
+void LoudnessMeterThread::run()
+{
+  LoudnessMeter meter(samplingRate, 2);
+
+  QVector<float> left;
+  QVector<float> right;
 
-  double rmsRatio = rmsRefData / rmsProcessedData;
+  jack_ringbuffer_t *ringbuffer = player->loudnessRingbuffer;
 
-  for (int i = 0; i < player->refDataL.size(); i++)
+  while (!isInterruptionRequested())
   {
-    player->refDataL[i] /= rmsRatio;
-    player->refDataR[i] /= rmsRatio;
+    if (resetRequested.exchange(false))
+    {
+      meter.reset();
+    }
+
+    bool measured = false;
+    jack_nframes_t nframes;
+
+    while (jack_ringbuffer_peek(ringbuffer, (char *)&nframes,
+                                sizeof(jack_nframes_t)) == sizeof(jack_nframes_t))
+    {
+      size_t samplesSize = sizeof (jack_default_audio_sample_t) * nframes;
+
+      if (jack_ringbuffer_read_space(ringbuffer) <
+          sizeof(jack_nframes_t) + 2 * samplesSize)
+      {
+        break;
+      }
+
+      left.resize(nframes);
+      right.resize(nframes);
+
+      jack_ringbuffer_read_advance(ringbuffer, sizeof(jack_nframes_t));
+      jack_ringbuffer_read(ringbuffer, (char *)left.data(), samplesSize);
+      jack_ringbuffer_read(ringbuffer, (char *)right.data(), samplesSize);
+
+      const float *data[2] = {left.constData(), right.constData()};
+      meter.process(data, nframes);
+
+      measured = true;
+    }
+
+    if (measured)
+    {
+      momentary = meter.getMomentary();
+      shortTerm = meter.getShortTerm();
+      integrated = meter.getIntegrated();
+      truePeak = meter.getTruePeak();
+
+      updatesCount++;
+    }
+
+    msleep(LOUDNESS_THREAD_INTERVAL_MS);
   }
 }
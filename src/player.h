@@ -21,6 +21,7 @@
 #define PLAYER_H
 
 #include <QVector>
+#include <QTimer>
 
 #include <stdio.h>
 #include <errno.h>
@@ -32,8 +33,27 @@
 #include <jack/jack.h>
 #include <jack/types.h>
 #include <jack/session.h>
+#include <jack/ringbuffer.h>
+
+#include <atomic>
+#include <cmath>
 
 #include "processor.h"
+#include "loudness_meter.h"
+#include "streaming_source.h"
+#include "lookahead_renderer.h"
+#include "profiler_audio.h"
+
+// CPU governor steps the processor quality tier down
+// when peak DSP load per callback exceeds the step down
+// threshold or xruns occur, and back up after the load
+// stays below the step up threshold for a number of intervals
+#define GOVERNOR_INTERVAL_MS 500
+#define GOVERNOR_STEP_DOWN_LOAD 0.75
+#define GOVERNOR_STEP_UP_LOAD 0.4
+#define GOVERNOR_STEP_UP_INTERVALS 10
+// Failed step up attempts double the wait up to this limit
+#define GOVERNOR_STEP_UP_INTERVALS_MAX 160
 
 class Player;
 
@@ -48,7 +68,28 @@ public:
   Processor *processor;
 };
 
-class Player : public QObject
+// Measures loudness of the output tap published
+// by the process callback, results are read
+// by the GUI through atomic values
+class LoudnessMeterThread : public QThread
+{
+  Q_OBJECT
+
+  void run() override;
+
+public:
+  Player *player;
+  int samplingRate;
+
+  std::atomic<bool> resetRequested{false};
+  std::atomic<int> updatesCount{0};
+  std::atomic<float> momentary{-INFINITY};
+  std::atomic<float> shortTerm{-INFINITY};
+  std::atomic<float> integrated{-INFINITY};
+  std::atomic<float> truePeak{-INFINITY};
+};
+
+class Player : public QObject, public ProfilerAudio
 {
   Q_OBJECT
 
@@ -71,52 +112,144 @@ public:
   void setLevel(float lev);
   float getLevel();
 
-  void setDiData(QVector<float> data);
-  void setRefData(QVector<float> dataL, QVector<float> dataR);
+  // Data at the player sample rate, played from memory
+  // and used for analysis as a whole
+  void setDiData(QVector<float> data) override;
+  void setRefData(QVector<float> dataL, QVector<float> dataR) override;
 
   void equalDataRMS();
 
+  // Files are streamed from disk on playback,
+  // data holds only the excerpts used for analysis
+  bool setDiFile(QString filename);
+  bool setRefFile(QString filename);
+  // Excerpt of a file that is not streamed anymore is ignored
+  void setDiExcerpt(QString filename, QVector<float> data);
+  void setRefExcerpt(QString filename, QVector<float> dataL, QVector<float> dataR);
+  bool isDiLoaded();
+
+  void seek(qint64 frame);
+  qint64 getPlaybackPosition();
+  qint64 getPlaybackLength();
+
   QVector<float> diData;
   QVector<float> refDataL;
   QVector<float> refDataR;
 
-  unsigned int diPos;
-  unsigned int refPos;
+  StreamingSource *diSource = nullptr;
+  StreamingSource *refSource = nullptr;
+  // Streamed files, empty when data is played from memory
+  QString diFileName;
+  QString refFileName;
+  // Period buffer for the DI stream
+  QVector<float> diBuffer;
+  LookaheadRenderer *lookaheadRenderer = nullptr;
+  // Set while the process callback runs,
+  // see waitProcessCallback()
+  std::atomic<bool> callbackRunning{false};
+  // False after the reference was played,
+  // GUI thread only
+  bool diStreamInSync = true;
+  // Reference level matched to the processed DI
+  std::atomic<float> refGain{1.0};
 
   enum PlayerStatus{
     PS_STOP,
     PS_PAUSE,
     PS_PLAY_DI,
     PS_PLAY_REF,
-    PS_MONITOR
+    PS_MONITOR,
+    PS_PROFILE
   };
 
-  PlayerStatus status;
+  std::atomic<PlayerStatus> status;
 
   Processor *processor;
 
   void setStatus(PlayerStatus newStatus);
-  int getSampleRate();
-  void incRMScounter();
+  int getSampleRate() override;
 
   void setInputLevel(float dbInputLevel);
 
   float inputLevel = 1.0;
   bool isEqualDataRMSThreadRunning = false;
 
+  // Live profiling: test signal is played on the outputs
+  // without processing, amplifier return from the input
+  // is captured to the ringbuffer
+  void startProfiling(QVector<float> testSignal) override;
+  void stopProfiling() override;
+  bool isProfiling() override;
+  bool isCaptureOverflow() override;
+  int readCapture(float *data, int n_count) override;
+  int getRoundTripLatency() override;
+
+  QVector<float> profileData;
+  unsigned int profilePos;
+  jack_ringbuffer_t *captureRingbuffer = nullptr;
+  std::atomic<bool> captureOverflow;
+
+  // Levels of processed periods for the GUI meters,
+  // written only by the process callback
+  jack_ringbuffer_t *meterRingbuffer;
+
+  // Stereo output for the loudness meter, each period
+  // is stored as frames count followed by planar samples
+  jack_ringbuffer_t *loudnessRingbuffer = nullptr;
+
+  // Peak ratio of processing time to period duration
+  // and number of xruns since the last governor interval
+  std::atomic<float> dspLoadPeak;
+  std::atomic<int> xrunCount;
+
+  void setGovernorEnabled(bool enabled);
+  bool isGovernorEnabled();
+
 private:
   int sampleRate;
   EqualDataRMSThread *equalDataRMSThread;
 
   float level = 1.0;
 
+  LoudnessMeterThread *loudnessMeterThread = nullptr;
+  int loudnessUpdatesCount = 0;
+
+  QTimer *meterTimer;
+  int meterCount = 0;
+  double meterInputSumSquares = 0.0;
+  float meterInputPeak = 0.0;
+
+  QTimer *governorTimer;
+  bool governorEnabled = true;
+  int governorCalmIntervals = 0;
+  int governorStepUpIntervals = GOVERNOR_STEP_UP_INTERVALS;
+  int governorIntervalsSinceStepUp = -1;
+
+  QTimer *lookaheadSyncTimer;
+  // Processor and its changes count of the last copy
+  // handed to the lookahead renderer
+  Processor *lookaheadSourceProcessor = nullptr;
+  unsigned int lookaheadChangesCount = 0;
+
+  void waitProcessCallback();
+
+  int nextQualityTier(int tier, int step);
+  void setQualityTier(int tier, const char *trigger);
+
 private slots:
   void equalDataRMSThreadFinished();
+  void governorTimeout();
+  void meterTimeout();
+  void syncLookaheadProcessor();
 
 signals:
   void dataChanged();
-  void peakRMSValueCalculated(float inputValue, float outputValue);
+  void peakRMSValueCalculated(float inputValue, float inputPeak);
+  // Output loudness in LUFS and true peak in dBTP
+  void loudnessCalculated(float momentary, float shortTerm,
+                          float integrated, float truePeak);
   void equalRMSFinished();
+  void qualityTierChanged(int tier);
 };
 
 #endif //PLAYER_H
@@ -20,6 +20,7 @@
 #include <QIcon>
 #include <QHBoxLayout>
 #include <QSettings>
+#include <QTimer>
 
 #include "player_panel.h"
 
@@ -30,6 +31,8 @@ PlayerPanel::PlayerPanel(QWidget *parent, Player *plr, Processor *prc) :
 
   connect(player, &Player::dataChanged, this, &PlayerPanel::playerDataChanged);
   connect(player, &Player::equalRMSFinished, this, &PlayerPanel::playerEqualRMSFinished);
+  connect(player, &Player::qualityTierChanged, this,
+          &PlayerPanel::playerQualityTierChanged);
 
   processor = prc;
   setFrameShape(QFrame::Panel);
@@ -77,6 +80,22 @@ PlayerPanel::PlayerPanel(QWidget *parent, Player *plr, Processor *prc) :
 
   connect(diButton, &QPushButton::clicked, this, &PlayerPanel::diButtonClicked);
 
+  positionSlider = new QSlider(Qt::Horizontal, this);
+  positionSlider->setMinimumWidth(200);
+  positionSlider->setRange(0, POSITION_SLIDER_MAX);
+  positionSlider->setToolTip(tr("Playback Position"));
+  positionSlider->setEnabled(false);
+  hbox->addWidget(positionSlider);
+
+  connect(positionSlider, &QSlider::sliderReleased, this,
+          &PlayerPanel::positionSliderReleased);
+
+  positionTimer = new QTimer(this);
+  positionTimer->setInterval(100);
+  connect(positionTimer, &QTimer::timeout, this,
+          &PlayerPanel::positionTimeout);
+  positionTimer->start();
+
   equalRMSButton = new QPushButton(this);
   equalRMSButton->setToolTip(tr("Adjust Reference file volume "
     "to match amplifier output volume"));
@@ -106,6 +125,21 @@ PlayerPanel::PlayerPanel(QWidget *parent, Player *plr, Processor *prc) :
     inputLevelSlider->setValue(value + 50);
   }
 
+  governorCheckBox = new QCheckBox(tr("Auto quality"), this);
+  governorCheckBox->setToolTip(tr("Reduce processing quality when "
+    "CPU load is too high for the JACK period"));
+  governorCheckBox->setChecked(settings.value("playerPanel/cpuGovernor",
+                                              true).toBool());
+  player->setGovernorEnabled(governorCheckBox->isChecked());
+  hbox->addWidget(governorCheckBox);
+
+  connect(governorCheckBox, &QCheckBox::stateChanged, this,
+          &PlayerPanel::governorCheckBoxChanged);
+
+  qualityLabel = new QLabel(this);
+  hbox->addWidget(qualityLabel);
+  playerQualityTierChanged(processor->getQualityTier());
+
   loadDialog = new LoadDialog(this);
 
   connect(loadDialog, &QDialog::finished, this, &PlayerPanel::loadDialogFinished);
@@ -113,9 +147,6 @@ PlayerPanel::PlayerPanel(QWidget *parent, Player *plr, Processor *prc) :
   diFileResamplingThread = new FileResamplingThread();
   refFileResamplingThread = new FileResamplingThread();
 
-  diFileResamplingThreadWorking = false;
-  refFileResamplingThreadWorking = false;
-
   connect(diFileResamplingThread, &QThread::finished, this,
    &PlayerPanel::diFileResamplingThreadFinished);
 
@@ -165,23 +196,34 @@ void PlayerPanel::loadDialogFinished(int result)
     QString diFilename = loadDialog->getDiFileName();
     QString refFilename = loadDialog->getRefFileName();
 
-    msg->setTitle(tr("Please wait!"));
-    msg->setMessage(tr("Resampling files..."));
-    msg->setProgressValue(0);
-    msg->open();
+    // Playback streams the files, the excerpts
+    // below are used only for analysis
+    if (!player->setDiFile(diFilename) || !player->setRefFile(refFilename))
+    {
+      QMessageBox::warning(this, tr("Error"),
+                           tr("Can't open DI or Reference file!"));
+      return;
+    }
 
-    diFileResamplingThread->filename = diFilename;
-    refFileResamplingThread->filename = refFilename;
+    // Excerpts are decoded in background, playback
+    // starts without them. Running thread is restarted
+    // with the new file when it finishes
     diFileResamplingThread->samplingRate = processor->getSamplingRate();
     refFileResamplingThread->samplingRate = processor->getSamplingRate();
 
-    diFileResamplingThreadWorking = true;
-    refFileResamplingThreadWorking = true;
-
     refFileResamplingThread->stereoMode = true;
 
-    diFileResamplingThread->start();
-    refFileResamplingThread->start();
+    if (!diFileResamplingThread->isRunning())
+    {
+      diFileResamplingThread->filename = diFilename;
+      diFileResamplingThread->start();
+    }
+
+    if (!refFileResamplingThread->isRunning())
+    {
+      refFileResamplingThread->filename = refFilename;
+      refFileResamplingThread->start();
+    }
   }
 }
 
@@ -227,7 +269,7 @@ void PlayerPanel::buttonMonitorClicked()
   else
   {
     player->setStatus(Player::PlayerStatus::PS_STOP);
-    if (player->diData.size() != 0)
+    if (player->isDiLoaded())
     {
       buttonPlay->setEnabled(true);
       buttonStop->setEnabled(true);
@@ -238,52 +280,62 @@ void PlayerPanel::buttonMonitorClicked()
 
 void PlayerPanel::diFileResamplingThreadFinished()
 {
-  player->setDiData(diFileResamplingThread->dataL);
-
-  diFileResamplingThreadWorking = false;
-
-  if ((!diFileResamplingThreadWorking) && (!refFileResamplingThreadWorking))
-  {
-    resamplingFinished();
-  }
-  else
+  if ((diFileResamplingThread->filename != player->diFileName) &&
+      (!player->diFileName.isEmpty()))
   {
-    msg->setProgressValue(10);
+    diFileResamplingThread->filename = player->diFileName;
+    diFileResamplingThread->start();
+    return;
   }
+
+  player->setDiExcerpt(diFileResamplingThread->filename,
+                       diFileResamplingThread->dataL);
 }
 
 void PlayerPanel::refFileResamplingThreadFinished()
 {
-  player->setRefData(refFileResamplingThread->dataL, refFileResamplingThread->dataR);
-
-  refFileResamplingThreadWorking = false;
-
-  if ((!diFileResamplingThreadWorking) && (!refFileResamplingThreadWorking))
-  {
-    resamplingFinished();
-  }
-  else
+  if ((refFileResamplingThread->filename != player->refFileName) &&
+      (!player->refFileName.isEmpty()))
   {
-    msg->setProgressValue(50);
+    refFileResamplingThread->filename = player->refFileName;
+    refFileResamplingThread->start();
+    return;
   }
-}
 
-void PlayerPanel::resamplingFinished()
-{
-  msg->setProgressValue(100);
-  msg->close();
+  player->setRefExcerpt(refFileResamplingThread->filename,
+                        refFileResamplingThread->dataL,
+                        refFileResamplingThread->dataR);
 }
 
 void PlayerPanel::playerDataChanged()
 {
-  if (player->diData.size() != 0)
+  if (player->isDiLoaded())
   {
     buttonPlay->setEnabled(true);
     buttonStop->setEnabled(true);
     diButton->setEnabled(true);
+    positionSlider->setEnabled(true);
+  }
+}
+
+void PlayerPanel::positionTimeout()
+{
+  qint64 length = player->getPlaybackLength();
+
+  if ((length > 0) && (!positionSlider->isSliderDown()))
+  {
+    positionSlider->setValue(player->getPlaybackPosition() *
+                             POSITION_SLIDER_MAX / length);
   }
 }
 
+void PlayerPanel::positionSliderReleased()
+{
+  qint64 length = player->getPlaybackLength();
+
+  player->seek(length * positionSlider->value() / POSITION_SLIDER_MAX);
+}
+
 void PlayerPanel::equalRMSButtonClicked()
 {
   player->equalDataRMS();
@@ -312,6 +364,39 @@ void PlayerPanel::playerEqualRMSFinished()
   msg->close();
 }
 
+void PlayerPanel::governorCheckBoxChanged(int state)
+{
+  player->setGovernorEnabled(state == Qt::Checked);
+
+  QSettings settings;
+  settings.setValue("playerPanel/cpuGovernor", state == Qt::Checked);
+}
+
+void PlayerPanel::playerQualityTierChanged(int tier)
+{
+  switch (tier)
+  {
+    case QUALITY_FULL:
+      qualityLabel->setText(tr("Quality: full"));
+      qualityLabel->setToolTip(tr("All processing stages are active"));
+      break;
+    case QUALITY_NO_CORRECTION:
+      qualityLabel->setText(tr("Quality: reduced 1"));
+      qualityLabel->setToolTip(tr("Correction equalizers are bypassed"));
+      break;
+    case QUALITY_MULTIRATE_CABINET:
+      qualityLabel->setText(tr("Quality: reduced 2"));
+      qualityLabel->setToolTip(tr("Correction equalizers are bypassed, "
+        "cabinet tail is convolved at decimated rate"));
+      break;
+    case QUALITY_SHORT_CABINET:
+      qualityLabel->setText(tr("Quality: reduced 3"));
+      qualityLabel->setToolTip(tr("Correction equalizers are bypassed, "
+        "cabinet impulse response is shortened"));
+      break;
+  }
+}
+
 void PlayerPanel::stopPlayback()
 {
   buttonStopClicked();
@@ -24,6 +24,8 @@
 #include <QPushButton>
 #include <QMessageBox>
 #include <QSlider>
+#include <QCheckBox>
+#include <QLabel>
 
 #include "load_dialog.h"
 #include "player.h"
@@ -31,6 +33,8 @@
 #include "processor.h"
 #include "message_widget.h"
 
+#define POSITION_SLIDER_MAX 1000
+
 class PlayerPanel : public QFrame
 {
   Q_OBJECT
@@ -40,9 +44,6 @@ public:
   int getInputLevelSliderValue();
 
 private:
-  bool diFileResamplingThreadWorking;
-  bool refFileResamplingThreadWorking;
-
   QPushButton *buttonStop;
   QPushButton *buttonPlay;
   QPushButton *buttonMonitor;
@@ -51,6 +52,12 @@ private:
   QPushButton *equalRMSButton;
 
   QSlider *inputLevelSlider;
+  QSlider *positionSlider;
+
+  QTimer *positionTimer;
+
+  QCheckBox *governorCheckBox;
+  QLabel *qualityLabel;
 
   LoadDialog *loadDialog;
 
@@ -63,8 +70,6 @@ private:
   FileResamplingThread *diFileResamplingThread;
   FileResamplingThread *refFileResamplingThread;
 
-  void resamplingFinished();
-
 public slots:
   void diButtonClicked();
   void loadButtonClicked();
@@ -83,7 +88,13 @@ public slots:
   void sliderValueChanged(int value);
   void playerEqualRMSFinished();
 
+  void governorCheckBoxChanged(int state);
+  void playerQualityTierChanged(int tier);
+
   void stopPlayback();
+
+  void positionTimeout();
+  void positionSliderReleased();
 };
 
 #endif // PLAYERPANEL_H
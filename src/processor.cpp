@@ -22,11 +22,15 @@
 
 #include <gsl/gsl_spline.h>
 #include <sndfile.h>
+#include <cmath>
 
 #include "processor.h"
 #include "kpp_tubeamp_dsp.h"
 #include "float.h"
 #include "math_functions.h"
+#include "fft_plan_cache.h"
+#include "spectral_kernels.h"
+#include "multirate_convolver.h"
 
 Processor::Processor(int SR)
 {
@@ -35,37 +39,48 @@ Processor::Processor(int SR)
   preampCorrectionEnabled = false;
   cabinetCorrectionEnabled = false;
 
+  cabinetMultirateEnabled = false;
+  cabinetMultirateHeadLength = MULTIRATE_DEFAULT_HEAD_MS;
+  cabinetMultirateErrorDb = -INFINITY;
+
+  qualityTier = QUALITY_FULL;
+  cabinetRebuildPending = false;
+  changesCount = 0;
+
   new_preamp_convproc = nullptr;
   new_preamp_correction_convproc = nullptr;
-  new_convproc = nullptr;
+  new_cabinet_convolver = nullptr;
   new_correction_convproc = nullptr;
 
   preamp_convproc = nullptr;
   preamp_correction_convproc = nullptr;
-  convproc = nullptr;
+  cabinet_convolver = nullptr;
   correction_convproc = nullptr;
 
   dsp = new mydsp();
   dsp->profile = nullptr;
 
   convolverDeleteThread = new ConvolverDeleteThread();
+  convolverDeleteThread->start();
 }
 
 Processor::~Processor()
 {
   cleanProfile();
+
+  delete convolverDeleteThread;
 }
 
 void Processor::cleanProfile()
 {
   delete preamp_convproc;
   delete preamp_correction_convproc;
-  delete convproc;
+  delete cabinet_convolver;
   delete correction_convproc;
 
   delete new_preamp_convproc;
   delete new_preamp_correction_convproc;
-  delete new_convproc;
+  delete new_cabinet_convolver;
   delete new_correction_convproc;
 
   delete dsp->profile;
@@ -73,7 +88,7 @@ void Processor::cleanProfile()
 
   new_preamp_convproc = nullptr;
   new_preamp_correction_convproc = nullptr;
-  new_convproc = nullptr;
+  new_cabinet_convolver = nullptr;
   new_correction_convproc = nullptr;
 }
 
@@ -218,7 +233,7 @@ bool Processor::loadProfile(QString filename)
       preamp_convproc = createMonoConvolver(preamp_impulse);
 
       // Create cabsym convolver
-      convproc = createStereoConvolver(left_impulse, right_impulse);
+      cabinet_convolver = createCabinetConvolver();
 
       // Create preamp correction convolver
       preamp_correction_convproc = createMonoConvolver(preamp_correction_impulse);
@@ -235,9 +250,62 @@ bool Processor::loadProfile(QString filename)
     return false;
   }
 
+  changesCount++;
+
   return true;
 }
 
+Processor *Processor::clone(bool keepCorrections)
+{
+  Processor *copy = new Processor(samplingRate);
+
+  copy->dsp->init(samplingRate);
+  copy->dsp->controls = dsp->controls;
+  copy->dsp->profile = new st_profile(*(dsp->profile));
+
+  copy->profileFileName = profileFileName;
+  copy->currentProfileFile = currentProfileFile;
+
+  copy->preamp_impulse = preamp_impulse;
+  copy->left_impulse = left_impulse;
+  copy->right_impulse = right_impulse;
+
+  copy->cabinetMultirateEnabled = cabinetMultirateEnabled;
+  copy->cabinetMultirateHeadLength = cabinetMultirateHeadLength;
+
+  if (keepCorrections)
+  {
+    copy->preamp_correction_impulse = preamp_correction_impulse;
+    copy->left_correction_impulse = left_correction_impulse;
+    copy->right_correction_impulse = right_correction_impulse;
+
+    copy->preampCorrectionEnabled = preampCorrectionEnabled;
+    copy->cabinetCorrectionEnabled = cabinetCorrectionEnabled;
+
+    copy->qualityTier = qualityTier.load();
+  }
+  else
+  {
+    copy->preamp_correction_impulse.fill(0.0f, preamp_impulse.size());
+    copy->preamp_correction_impulse[0] = 1.0f;
+    copy->left_correction_impulse.fill(0.0f, left_impulse.size());
+    copy->left_correction_impulse[0] = 1.0f;
+    copy->right_correction_impulse.fill(0.0f, right_impulse.size());
+    copy->right_correction_impulse[0] = 1.0f;
+  }
+
+  copy->preamp_convproc = copy->createMonoConvolver(copy->preamp_impulse);
+  copy->cabinet_convolver = copy->createCabinetConvolver();
+
+  copy->preamp_correction_convproc =
+    copy->createMonoConvolver(copy->preamp_correction_impulse);
+  copy->correction_convproc =
+    copy->createStereoConvolver(copy->left_correction_impulse,
+                                copy->right_correction_impulse);
+
+  return copy;
+}
+
 bool Processor::saveProfile(QString filename)
 {
   FILE * profile_file= fopen(filename.toUtf8().constData(), "wb");
@@ -298,20 +366,18 @@ QVector<float> Processor::getFrequencyResponse(QVector<float> freqs,
     double_impulse[i] = impulse[i];
   }
 
-  fftw_complex out[impulse.size() / 2 + 1];
-  fftw_plan p;
-
-  p = fftw_plan_dft_r2c_1d(impulse.size(), double_impulse.data(), out, FFTW_ESTIMATE);
+  QVector<s_fftw_complex> out(impulse.size() / 2 + 1);
 
-  fftw_execute(p);
-  fftw_destroy_plan(p);
+  fft_r2c(impulse.size(), double_impulse.data(), (double (*)[2])out.data());
 
   QVector<double> rawFrequencyResponse(impulse.size() / 2);
   QVector<double> rawFreqs(impulse.size() / 2);
 
+  spectrum_magnitude(out.data() + 1, rawFrequencyResponse.data(),
+    rawFrequencyResponse.size());
+
   for (int i = 0; i < rawFrequencyResponse.size(); i++)
   {
-    rawFrequencyResponse[i] = sqrt(pow(out[i + 1][0], 2) + pow(out[i + 1][1], 2));
     rawFreqs[i] = ((double)(i + 1) / rawFrequencyResponse.size()) * (samplingRate / 2);
   }
 
@@ -371,6 +437,7 @@ stControls Processor::getControls()
 void Processor::setControls(stControls newControls)
 {
   dsp->controls = newControls;
+  changesCount++;
 }
 
 st_profile Processor::getProfile()
@@ -381,6 +448,7 @@ st_profile Processor::getProfile()
 void Processor::setProfile(st_profile newProfile)
 {
   *(dsp->profile) = newProfile;
+  changesCount++;
 }
 
 float hardClipBottom(float input, float cut)
@@ -425,6 +493,8 @@ void Processor::setPreampCorrectionImpulseFromFrequencyResponse(QVector<double>
   }
 
   preampCorrectionEnabled = true;
+
+  changesCount++;
 }
 
 void Processor::setCabinetSumCorrectionImpulseFromFrequencyResponse(QVector<double> w,
@@ -455,6 +525,8 @@ void Processor::setCabinetSumCorrectionImpulseFromFrequencyResponse(QVector<doub
   }
 
   cabinetCorrectionEnabled = true;
+
+  changesCount++;
 }
 
 void Processor::applyPreampCorrection()
@@ -468,6 +540,8 @@ void Processor::applyPreampCorrection()
   {
     new_preamp_convproc = createMonoConvolver(preamp_impulse);
   }
+
+  changesCount++;
 }
 
 void Processor::applyCabinetSumCorrection()
@@ -478,10 +552,9 @@ void Processor::applyCabinetSumCorrection()
   fft_convolver(right_impulse.data(), right_impulse.size(),
                 right_correction_impulse.data(), right_correction_impulse.size());
 
-  if (new_convproc == nullptr)
-  {
-    new_convproc = createStereoConvolver(left_impulse, right_impulse);
-  }
+  rebuildCabinetConvolver();
+
+  changesCount++;
 }
 
 void Processor::resetPreampCorrection()
@@ -499,6 +572,8 @@ void Processor::resetPreampCorrection()
   }
 
   preampCorrectionEnabled = false;
+
+  changesCount++;
 }
 
 void Processor::resetCabinetSumCorrection()
@@ -524,6 +599,8 @@ void Processor::resetCabinetSumCorrection()
   }
 
   cabinetCorrectionEnabled = false;
+
+  changesCount++;
 }
 
 int Processor::getSamplingRate()
@@ -531,10 +608,8 @@ int Processor::getSamplingRate()
   return samplingRate;
 }
 
-void Processor::process(float *outL, float *outR, float *in, int nSamples)
+void Processor::exchangeAmpConvolvers()
 {
-  // Change convolvers if new available
-
   if (new_preamp_convproc != nullptr)
   {
     freeConvolver(preamp_convproc);
@@ -549,102 +624,105 @@ void Processor::process(float *outL, float *outR, float *in, int nSamples)
     new_preamp_correction_convproc = nullptr;
     //printf("Exchanged preamp correction convproc\n");
   }
+}
 
-  if (new_convproc != nullptr)
-  {
-    freeConvolver(convproc);
-    convproc = new_convproc;
-    new_convproc = nullptr;
-  }
-
-  if (new_correction_convproc != nullptr)
-  {
-    freeConvolver(correction_convproc);
-    correction_convproc = new_correction_convproc;
-    new_correction_convproc = nullptr;
-  }
-
-  // Preamp convolver
-
-  // Zita-convolver accepts 'fragm' number of samples,
-  // real buffer size may be greater,
-  // so perform convolution in multiple steps
-  int bufp = 0;
-  QVector<float> intermediateBuffer(nSamples);
-
-  while (bufp < nSamples)
-  {
-    memcpy (preamp_convproc->inpdata(0), in + bufp, fragm * sizeof(float));
-    preamp_convproc->process (true);
-    memcpy (intermediateBuffer.data() + bufp, preamp_convproc->outdata(0),
-            fragm * sizeof(float));
+// Processing stages are chained through convolver buffers:
+// each stage reads the previous stage output buffer and
+// writes the next stage input buffer. Zita-convolver owns
+// its buffers, so only adjacent convolvers need a copy
+void Processor::processAmpFragment(float *out, const float *in)
+{
+  memcpy (preamp_convproc->inpdata(0), in, fragm * sizeof(float));
+  preamp_convproc->process (true);
 
-    bufp += fragm;
-  }
+  float *stage = preamp_convproc->outdata(0);
 
   // Preamp correction convolver
-  if (preampCorrectionEnabled)
+  if (preampCorrectionEnabled && (qualityTier < QUALITY_NO_CORRECTION))
   {
-    bufp = 0;
-
-    while (bufp < nSamples)
-    {
-      memcpy (preamp_correction_convproc->inpdata(0), intermediateBuffer.data()
-        + bufp, fragm * sizeof(float));
-      preamp_correction_convproc->process (true);
-      memcpy (intermediateBuffer.data() + bufp,
-              preamp_correction_convproc->outdata(0), fragm * sizeof(float));
+    memcpy (preamp_correction_convproc->inpdata(0), stage, fragm * sizeof(float));
+    preamp_correction_convproc->process (true);
 
-      bufp += fragm;
-    }
+    stage = preamp_correction_convproc->outdata(0);
   }
 
   // Apply main tubeAmp model from FAUST code
-  float *inputs[1] = {intermediateBuffer.data()};
-  float *outputs[1] = {outL};
-
-  dsp->compute(nSamples, inputs, outputs);
+  float *inputs[1] = {stage};
+  float *outputs[1] = {out};
 
-  memcpy(outR, outL, sizeof(float) * nSamples);
+  dsp->compute(fragm, inputs, outputs);
+}
 
-  // Cabinet simulation convolver
-  bufp = 0;
+void Processor::processAmp(float *out, float *in, int nSamples)
+{
+  // Change convolvers if new available
+  exchangeAmpConvolvers();
 
-  while (bufp < nSamples)
+  // Zita-convolver accepts 'fragm' number of samples,
+  // real buffer size may be greater,
+  // so perform processing in multiple steps
+  for (int bufp = 0; bufp < nSamples; bufp += fragm)
   {
-    memcpy (convproc->inpdata(0), outL + bufp, fragm * sizeof(float));
-    memcpy (convproc->inpdata(1), outR + bufp, fragm * sizeof(float));
+    processAmpFragment(out + bufp, in + bufp);
+  }
+}
 
-    convproc->process (true);
-    memcpy (outL + bufp, convproc->outdata(0), fragm * sizeof(float));
-    memcpy (outR + bufp, convproc->outdata(1), fragm * sizeof(float));
+void Processor::process(float *outL, float *outR, float *in, int nSamples)
+{
+  // Change convolvers if new available
+  exchangeAmpConvolvers();
 
-    bufp += fragm;
+  if (new_cabinet_convolver != nullptr)
+  {
+    freeConvolver(cabinet_convolver);
+    cabinet_convolver = new_cabinet_convolver;
+    new_cabinet_convolver = nullptr;
   }
 
-  // Cabinet correction convolver
-  if (cabinetCorrectionEnabled)
+  if (new_correction_convproc != nullptr)
   {
-    bufp = 0;
+    freeConvolver(correction_convproc);
+    correction_convproc = new_correction_convproc;
+    new_correction_convproc = nullptr;
+  }
+
+  for (int bufp = 0; bufp < nSamples; bufp += fragm)
+  {
+    // Preamp and tubeAmp model write straight
+    // to the mono input of the cabinet convolver
+    processAmpFragment(cabinet_convolver->inpdata(), in + bufp);
+
+    // Cabinet simulation convolver
+    cabinet_convolver->process();
 
-    while (bufp < nSamples)
+    float *stageL = cabinet_convolver->outdata(0);
+    float *stageR = cabinet_convolver->outdata(1);
+
+    // Cabinet correction convolver
+    if (cabinetCorrectionEnabled && (qualityTier < QUALITY_NO_CORRECTION))
     {
-      memcpy (correction_convproc->inpdata(0), outL + bufp, fragm * sizeof(float));
-      memcpy (correction_convproc->inpdata(1), outR + bufp, fragm * sizeof(float));
+      memcpy (correction_convproc->inpdata(0), stageL, fragm * sizeof(float));
+      memcpy (correction_convproc->inpdata(1), stageR, fragm * sizeof(float));
 
       correction_convproc->process (true);
-      memcpy (outL + bufp, correction_convproc->outdata(0), fragm * sizeof(float));
-      memcpy (outR + bufp, correction_convproc->outdata(1), fragm * sizeof(float));
 
-      bufp += fragm;
+      stageL = correction_convproc->outdata(0);
+      stageR = correction_convproc->outdata(1);
     }
+
+    memcpy (outL + bufp, stageL, fragm * sizeof(float));
+    memcpy (outR + bufp, stageR, fragm * sizeof(float));
   }
 }
 
 void Processor::freeConvolver(Convproc *convolver)
 {
-  convolverDeleteThread->convolver = convolver;
-  convolverDeleteThread->start();
+  convolverDeleteThread->free(convolver);
+}
+
+void Processor::freeConvolver(MultirateConvolver *convolver)
+{
+  convolverDeleteThread->free(convolver);
 }
 
 Convproc* Processor::createMonoConvolver(QVector<float> impulse)
@@ -675,6 +753,73 @@ Convproc* Processor::createStereoConvolver(QVector<float> l_impulse,
   return newConv;
 }
 
+// Truncates impulse to n_count samples, the last quarter
+// is faded out to avoid a step at the cut
+static void shorten_impulse(QVector<float> &impulse, int n_count)
+{
+  if (impulse.size() <= n_count)
+  {
+    return;
+  }
+
+  impulse.resize(n_count);
+
+  int fadeSize = n_count / 4;
+  for (int i = 0; i < fadeSize; i++)
+  {
+    impulse[n_count - fadeSize + i] *= 0.5 * (1.0 + cos(M_PI * (i + 1) / fadeSize));
+  }
+}
+
+MultirateConvolver* Processor::createCabinetConvolver()
+{
+  QVector<float> l_impulse = left_impulse;
+  QVector<float> r_impulse = right_impulse;
+
+  if (qualityTier >= QUALITY_SHORT_CABINET)
+  {
+    int shortSize = QUALITY_SHORT_CABINET_MS / 1000.0 * samplingRate;
+
+    shorten_impulse(l_impulse, shortSize);
+    shorten_impulse(r_impulse, shortSize);
+  }
+
+  bool multirate = cabinetMultirateEnabled ||
+    (qualityTier >= QUALITY_MULTIRATE_CABINET);
+
+  MultirateConvolver *newConv = new MultirateConvolver(l_impulse, r_impulse,
+                                                       samplingRate,
+                                                       multirate,
+                                                       cabinetMultirateHeadLength);
+
+  cabinetMultirateErrorDb = newConv->getErrorDb();
+
+  return newConv;
+}
+
+// New cabinet convolver is not replaced while the processing
+// thread may exchange it, the rebuild is postponed instead
+void Processor::rebuildCabinetConvolver()
+{
+  if (new_cabinet_convolver == nullptr)
+  {
+    new_cabinet_convolver = createCabinetConvolver();
+    cabinetRebuildPending = false;
+  }
+  else
+  {
+    cabinetRebuildPending = true;
+  }
+}
+
+void Processor::rebuildPendingConvolvers()
+{
+  if (cabinetRebuildPending)
+  {
+    rebuildCabinetConvolver();
+  }
+}
+
 QString Processor::getProfileFileName()
 {
   return profileFileName;
@@ -698,6 +843,8 @@ void Processor::setPreampImpulse(QVector<float> data)
   {
     new_preamp_convproc = createMonoConvolver(preamp_impulse);
   }
+
+  changesCount++;
 }
 
 void Processor::setCabinetImpulse(QVector<float> dataL, QVector<float> dataR)
@@ -705,10 +852,9 @@ void Processor::setCabinetImpulse(QVector<float> dataL, QVector<float> dataR)
   left_impulse = dataL;
   right_impulse = dataR;
 
-  if (new_convproc == nullptr)
-  {
-    new_convproc = createStereoConvolver(left_impulse, right_impulse);
-  }
+  rebuildCabinetConvolver();
+
+  changesCount++;
 }
 
 QVector<float> Processor::getPreampImpulse()
@@ -729,11 +875,72 @@ QVector<float> Processor::getRightImpulse()
 void Processor::setPreampCorrectionStatus(bool status)
 {
   preampCorrectionEnabled = status;
+  changesCount++;
 }
 
 void Processor::setCabinetCorrectionStatus(bool status)
 {
   cabinetCorrectionEnabled = status;
+  changesCount++;
+}
+
+void Processor::setCabinetMultirate(bool enabled, float headLengthMs)
+{
+  cabinetMultirateEnabled = enabled;
+  cabinetMultirateHeadLength = headLengthMs;
+
+  if (left_impulse.size() > 0)
+  {
+    rebuildCabinetConvolver();
+  }
+
+  changesCount++;
+}
+
+bool Processor::isCabinetMultirateEnabled()
+{
+  return cabinetMultirateEnabled;
+}
+
+float Processor::getCabinetMultirateHeadLength()
+{
+  return cabinetMultirateHeadLength;
+}
+
+double Processor::getCabinetMultirateErrorDb()
+{
+  return cabinetMultirateErrorDb;
+}
+
+bool Processor::isCabinetMultirateAvailable()
+{
+  return MultirateConvolver::calculateDecimation(samplingRate) > 1;
+}
+
+void Processor::setQualityTier(int tier)
+{
+  int oldTier = qualityTier.exchange(tier);
+
+  bool cabinetChanged =
+    ((oldTier >= QUALITY_MULTIRATE_CABINET) != (tier >= QUALITY_MULTIRATE_CABINET)) ||
+    ((oldTier >= QUALITY_SHORT_CABINET) != (tier >= QUALITY_SHORT_CABINET));
+
+  if (cabinetChanged && (left_impulse.size() > 0))
+  {
+    rebuildCabinetConvolver();
+  }
+
+  changesCount++;
+}
+
+int Processor::getQualityTier()
+{
+  return qualityTier;
+}
+
+unsigned int Processor::getChangesCount()
+{
+  return changesCount;
 }
 
 void Processor::setProfileFileName(QString name)
@@ -741,7 +948,69 @@ void Processor::setProfileFileName(QString name)
   profileFileName = name;
 }
 
+ConvolverDeleteThread::ConvolverDeleteThread()
+{
+}
+
+ConvolverDeleteThread::~ConvolverDeleteThread()
+{
+  requestInterruption();
+  wait();
+
+  deleteQueued();
+}
+
+void ConvolverDeleteThread::free(Convproc *convolver)
+{
+  if (convolver != nullptr)
+  {
+    push({convolver, nullptr});
+  }
+}
+
+void ConvolverDeleteThread::free(MultirateConvolver *convolver)
+{
+  if (convolver != nullptr)
+  {
+    push({nullptr, convolver});
+  }
+}
+
+// Full queue means the deletion thread is stuck,
+// the convolver is leaked rather than deleted
+// on the processing thread
+void ConvolverDeleteThread::push(Garbage garbage)
+{
+  unsigned int write = queueWrite;
+
+  if (write - queueRead < CONVOLVER_DELETE_QUEUE_SIZE)
+  {
+    queue[write % CONVOLVER_DELETE_QUEUE_SIZE] = garbage;
+    queueWrite = write + 1;
+  }
+}
+
+void ConvolverDeleteThread::deleteQueued()
+{
+  unsigned int read = queueRead;
+
+  while (read != queueWrite)
+  {
+    Garbage garbage = queue[read % CONVOLVER_DELETE_QUEUE_SIZE];
+
+    delete garbage.convolver;
+    delete garbage.multirateConvolver;
+
+    read++;
+    queueRead = read;
+  }
+}
+
 void ConvolverDeleteThread::run()
 {
-  delete convolver;
+  while (!isInterruptionRequested())
+  {
+    deleteQueued();
+    msleep(CONVOLVER_DELETE_INTERVAL_MS);
+  }
 }
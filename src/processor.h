@@ -25,6 +25,8 @@
 #include <QString>
 #include <QThread>
 
+#include <atomic>
+
 #include "profile.h"
 
 #include <zita-convolver.h>
@@ -71,6 +73,19 @@
 
 #define fragm 64
 
+// Quality tiers used to shed DSP load under xrun pressure,
+// each tier includes the degradations of the previous ones
+enum QualityTier
+{
+  QUALITY_FULL,
+  QUALITY_NO_CORRECTION,     // Correction convolvers bypassed
+  QUALITY_MULTIRATE_CABINET, // Cabinet tail at decimated rate
+  QUALITY_SHORT_CABINET      // Cabinet impulse truncated
+};
+
+#define QUALITY_TIER_COUNT 4
+#define QUALITY_SHORT_CABINET_MS 50.0
+
 struct stControls
 {
   float volume;
@@ -85,7 +100,15 @@ using namespace std;
 #include "faust-support.h"
 
 class mydsp;
+class MultirateConvolver;
+
+// Maximum number of replaced convolvers waiting for deletion
+#define CONVOLVER_DELETE_QUEUE_SIZE 64
+#define CONVOLVER_DELETE_INTERVAL_MS 50
 
+// Deletes convolvers replaced on the processing thread.
+// They are passed through a lock-free single producer queue,
+// so several convolvers can be replaced in one callback
 class ConvolverDeleteThread : public QThread
 {
   Q_OBJECT
@@ -93,7 +116,27 @@ class ConvolverDeleteThread : public QThread
   void run() override;
 
 public:
-  Convproc *convolver;
+  ConvolverDeleteThread();
+  ~ConvolverDeleteThread();
+
+  // Called from the processing thread
+  void free(Convproc *convolver);
+  void free(MultirateConvolver *convolver);
+
+private:
+  struct Garbage
+  {
+    Convproc *convolver;
+    MultirateConvolver *multirateConvolver;
+  };
+
+  Garbage queue[CONVOLVER_DELETE_QUEUE_SIZE];
+  // Counts of pushed and deleted convolvers
+  std::atomic<unsigned int> queueWrite{0};
+  std::atomic<unsigned int> queueRead{0};
+
+  void push(Garbage garbage);
+  void deleteQueued();
 };
 
 class Processor
@@ -103,6 +146,14 @@ public:
   ~Processor();
 
   bool loadProfile(QString filename);
+  // Processor for background jobs with the same profile, controls,
+  // impulses and cabinet multirate settings, without reading
+  // the profile file. Impulses are shared copy-on-write.
+  // Corrections are reset as after loadProfile() and quality tier
+  // is QUALITY_FULL, unless keepCorrections is set: then both are
+  // copied, so the clone plays the same as this Processor.
+  // Caller owns the returned Processor
+  Processor *clone(bool keepCorrections = false);
   bool saveProfile(QString filename);
 
   QVector<float> getPreampFrequencyResponse(QVector<float> freqs);
@@ -131,6 +182,8 @@ public:
   int getSamplingRate();
 
   void process(float *outL, float *outR, float *in, int nSamples);
+  // Preamp and FAUST stages only, cabinet convolvers are not touched
+  void processAmp(float *out, float *in, int nSamples);
 
   QString getProfileFileName();
   void setProfileFileName(QString name);
@@ -145,6 +198,31 @@ public:
   void setPreampCorrectionStatus(bool status);
   void setCabinetCorrectionStatus(bool status);
 
+  // Cabinet tail convolution at decimated rate,
+  // head of headLengthMs is convolved at full rate
+  void setCabinetMultirate(bool enabled, float headLengthMs);
+  bool isCabinetMultirateEnabled();
+  float getCabinetMultirateHeadLength();
+  // Error of the multirate cabinet relative to full rate,
+  // -inf when the whole cabinet runs at full rate
+  double getCabinetMultirateErrorDb();
+  // False when the sample rate is too low to decimate the tail
+  bool isCabinetMultirateAvailable();
+
+  // May be called while processing, cabinet convolver
+  // is rebuilt when the tier affects it
+  void setQualityTier(int tier);
+  int getQualityTier();
+
+  // Counts parameter changes, copies of the processor
+  // are made again when it changes
+  unsigned int getChangesCount();
+
+  // Rebuilds the cabinet convolver when a change came while
+  // the previous new one was not exchanged yet, called
+  // periodically from the GUI thread
+  void rebuildPendingConvolvers();
+
   QVector<float> getPreampImpulse();
   QVector<float> getLeftImpulse();
   QVector<float> getRightImpulse();
@@ -152,12 +230,12 @@ public:
 private:
   Convproc *preamp_convproc;
   Convproc *preamp_correction_convproc;
-  Convproc *convproc;
+  MultirateConvolver *cabinet_convolver;
   Convproc *correction_convproc;
 
   Convproc *new_preamp_convproc;
   Convproc *new_preamp_correction_convproc;
-  Convproc *new_convproc;
+  MultirateConvolver *new_cabinet_convolver;
   Convproc *new_correction_convproc;
 
   QVector<float> preamp_impulse;
@@ -171,6 +249,17 @@ private:
   bool preampCorrectionEnabled;
   bool cabinetCorrectionEnabled;
 
+  bool cabinetMultirateEnabled;
+  float cabinetMultirateHeadLength;
+  double cabinetMultirateErrorDb;
+
+  std::atomic<int> qualityTier;
+  std::atomic<unsigned int> changesCount;
+
+  // Cabinet convolver rebuild requested while
+  // the previous new one was not exchanged yet
+  bool cabinetRebuildPending;
+
   ConvolverDeleteThread *convolverDeleteThread;
 
   QString currentProfileFile;
@@ -180,12 +269,18 @@ private:
 
   QString profileFileName;
 
+  void exchangeAmpConvolvers();
+  void processAmpFragment(float *out, const float *in);
+
   void freeConvolver(Convproc *convolver);
+  void freeConvolver(MultirateConvolver *convolver);
   int checkProfileFile(const char *path);
 
   QVector<float> getFrequencyResponse(QVector<float> freqs, QVector<float> impulse);
   Convproc* createMonoConvolver(QVector<float> impulse);
   Convproc* createStereoConvolver(QVector<float> left_impulse, QVector<float> right_impulse);
+  MultirateConvolver* createCabinetConvolver();
+  void rebuildCabinetConvolver();
 };
 
 #endif //PROCESSOR_H
@@ -22,17 +22,31 @@
 #include <sndfile.h>
 #include <cmath>
 #include <cfloat>
-#include <QMessageBox>
+#include <atomic>
 #include <QDir>
 #include <QApplication>
+#include <QDataStream>
+#include <QCryptographicHash>
 
 #include "profiler.h"
 #include "math_functions.h"
+#include "profiler_cache.h"
 
 #define EXPER_POINTS_NUM 15
 #define TEST_SIGNAL_LENGTH_SEC 3.0
 #define TEST_SIGNAL_PAUSE_LENGTH_SEC 0.1
 #define RESPONSE_OVERSAMPLING_COEFF 16
+#define TEST_SIGNAL_V1_SAMPLERATE 44100
+// Samples taken around each oversampled window
+// so that resampler edge effects stay outside of it
+#define RESPONSE_OVERSAMPLING_GUARD 256
+// Silence at the beginning of the response, not analyzed
+#define RESPONSE_SKIP_SEC 1
+#define SWEEP_RESPONSE_LENGTH_SEC 11
+// Exponential sweep of the test signal
+#define SWEEP_LENGTH_SEC 10.0
+#define SWEEP_START_FREQUENCY 20.0
+#define SWEEP_AMPLITUDE 0.01
 
 // Frequencies used to generate test signal
 // to get preamp amplitude response, in rad/s
@@ -45,18 +59,68 @@ int calibration_freqs[] = {200,600,1500,2000,2500,3000,3500,
 double freq_weights[] = {1.0,0.8,0.75,0.6,0.55,0.5,0.5,
   0.4,0.35,0.3,0.25,0.2,0.35,0.75,1.0};
 
-Profiler::Profiler(Processor *prc, Player *plr)
+static QDataStream &operator<<(QDataStream &stream, const stCrunchPoint &point)
+{
+  return stream << point.max << point.rmsAtMax << point.maxtime << point.isBad;
+}
+
+static QDataStream &operator>>(QDataStream &stream, stCrunchPoint &point)
+{
+  return stream >> point.max >> point.rmsAtMax >> point.maxtime >> point.isBad;
+}
+
+// Stage results for the profiler cache,
+// vectors are shared with the cache without copying
+static ProfilerCacheEntry stage_entry(const QVector<float> &a, const QVector<float> &b)
+{
+  ProfilerCacheEntry entry;
+  entry.samples << a << b;
+
+  return entry;
+}
+
+static bool read_stage_entry(const ProfilerCacheEntry &entry, QVector<float> &a, QVector<float> &b)
+{
+  if (entry.samples.size() != 2)
+  {
+    return false;
+  }
+
+  a = entry.samples[0];
+  b = entry.samples[1];
+
+  return true;
+}
+
+Profiler::Profiler(Processor *prc, ProfilerAudio *plr)
 {
   processor = prc;
   player = plr;
 
-  connect(this, &Profiler::warningMessageNeeded, this,
-          &Profiler::warningMessageNeededSlot);
+  quality.badPointsCount = 0;
+  quality.desiredGain = 0.0;
+  quality.autoEqResidualDb = 0.0;
 }
 
-void Profiler::loadResponseFile(QString fileName)
+bool Profiler::loadResponseFile(QString fileName)
 {
   responseData.resize(0);
+  responseFileName = fileName;
+
+  // Decoded file is kept only in memory,
+  // on disk it would be a copy of the file itself
+  QByteArray responseKey = profiler_cache_key(fileName, "response", QByteArray());
+  ProfilerCacheEntry responseCache;
+
+  if (profiler_cache_find(responseKey, responseCache) &&
+      (responseCache.samples.size() == 1))
+  {
+    QDataStream stream(responseCache.values);
+    stream >> responseDataSamplerate >> responseDataChannels;
+
+    responseData = responseCache.samples[0];
+    return true;
+  }
 
   SF_INFO sfinfo;
   sfinfo.format = 0;
@@ -68,14 +132,59 @@ void Profiler::loadResponseFile(QString fileName)
     responseDataChannels = sfinfo.channels;
 
     responseData.resize(sfinfo.frames * sfinfo.channels);
-    sf_readf_float(responseSndFile, responseData.data(), sfinfo.frames);
+
+    // Samples are hashed while decoding for the cache keys,
+    // so the file is read only once
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+
+    QByteArray format;
+    QDataStream formatStream(&format, QIODevice::WriteOnly);
+    formatStream << responseDataSamplerate << responseDataChannels;
+    hash.addData(format);
+
+    sf_count_t frames = 0;
+    while (frames < sfinfo.frames)
+    {
+      float *chunk = responseData.data() + frames * sfinfo.channels;
+      sf_count_t n_read = sf_readf_float(responseSndFile, chunk,
+                                         qMin((sf_count_t)PROFILER_CACHE_HASH_CHUNK,
+                                              sfinfo.frames - frames));
+      if (n_read <= 0)
+      {
+        break;
+      }
+
+      hash.addData((const char *)chunk, n_read * sfinfo.channels * sizeof(float));
+      frames += n_read;
+    }
 
     sf_close(responseSndFile);
+
+    // Truncated file is not cached
+    if (frames < sfinfo.frames)
+    {
+      return true;
+    }
+
+    profiler_cache_set_content_hash(fileName, hash.result());
+    responseKey = profiler_cache_key(fileName, "response", QByteArray());
+
+    // Cache shares the decoded samples
+    QDataStream stream(&responseCache.values, QIODevice::WriteOnly);
+    stream << responseDataSamplerate << responseDataChannels;
+
+    responseCache.samples << responseData;
+
+    profiler_cache_insert(responseKey, responseCache, false);
+
+    return true;
   }
+
+  return false;
 }
 
 // Real test file contains DI from guitar
-QVector<float> Profiler::loadRealTestFile(QVector<float> testSignal, float sampleRate)
+void Profiler::loadRealTestFile(QVector<float> &testSignal, float sampleRate)
 {
   SF_INFO sfinfo;
   sfinfo.format = 0;
@@ -118,13 +227,83 @@ QVector<float> Profiler::loadRealTestFile(QVector<float> testSignal, float sampl
 
     sf_close(realTestSndFile);
   }
-  return testSignal;
+}
+
+// Takes the signal from start_frame to start_frame + n_frames
+// and oversamples it by RESPONSE_OVERSAMPLING_COEFF
+static QVector<float> oversample_window(SampleSpan signal,
+                                        int start_frame,
+                                        int n_frames,
+                                        int samplerate)
+{
+  int guard = RESPONSE_OVERSAMPLING_GUARD;
+  QVector<float> window(n_frames + 2 * guard);
+
+  for (int i = 0; i < window.size(); i++)
+  {
+    int frame = start_frame - guard + i;
+
+    if ((frame >= 0) && (frame < signal.size()))
+    {
+      window[i] = signal[frame];
+    }
+    else
+    {
+      window[i] = 0.0;
+    }
+  }
+
+  QVector<float> windowOversampled = resample_vector(window,
+                                                     samplerate,
+                                                     samplerate *
+                                                     RESPONSE_OVERSAMPLING_COEFF);
+
+  return windowOversampled.mid(guard * RESPONSE_OVERSAMPLING_COEFF,
+                               n_frames * RESPONSE_OVERSAMPLING_COEFF);
+}
+
+// Right side of the response: the first channel for mono files,
+// otherwise average of all channels except the first one.
+// Averaged samples are stored in mixBuffer.
+static SampleSpan response_right_channel(const QVector<float> &interleaved,
+                                         int channels,
+                                         int start_frame,
+                                         int n_frames,
+                                         QVector<float> &mixBuffer)
+{
+  SampleSpan first = SampleSpan::channel(interleaved, channels, 0).mid(start_frame,
+                                                                       n_frames);
+
+  if (channels == 1)
+  {
+    return first;
+  }
+
+  mixBuffer.fill(0.0, first.size());
+
+  for (int j = 1; j < channels; j++)
+  {
+    SampleSpan channel = SampleSpan::channel(interleaved, channels, j).mid(start_frame,
+                                                                           first.size());
+
+    for (int i = 0; i < channel.size(); i++)
+    {
+      mixBuffer[i] += channel[i];
+    }
+  }
+
+  for (int i = 0; i < mixBuffer.size(); i++)
+  {
+    mixBuffer[i] /= (channels - 1.0);
+  }
+
+  return SampleSpan(mixBuffer);
 }
 
 // Calculates amplitude of the test signal
 // at which profiled amplifier starts to clip
 stCrunchPoint Profiler::findCrunchPoint(int freqIndex,
-                                          QVector<float> data,
+                                          SampleSpan data,
                                           int samplerate)
 {
     int periodInSamples = samplerate /
@@ -135,19 +314,31 @@ stCrunchPoint Profiler::findCrunchPoint(int freqIndex,
       (double)TEST_SIGNAL_LENGTH_SEC /
       periodInSamples;
 
+    // Periods must fit into the data
+    periodsNum = qMin(periodsNum, data.size() / periodInSamples + 1);
+
+    // Prefix sum of squares, RMS of any period
+    // is a difference of two elements
+    int prefixSize = qMax(0, (periodsNum - 2) * periodInSamples);
+    QVector<double> squaresPrefixSum(prefixSize + 1);
+
+    squaresPrefixSum[0] = 0.0;
+    for (int i = 0; i < prefixSize; i++)
+    {
+      squaresPrefixSum[i + 1] = squaresPrefixSum[i] + (double)data[i] * data[i];
+    }
+
     // Calculate RMS values of each period
     // of the test signal
     QVector<sPike> pikeArray;
+    pikeArray.reserve(qMax(0, periodsNum - 2));
 
     for (int j = 0; j < periodsNum - 2; j++)
     {
-      double rmsSum = 0.0;
-      for (int i = 0; i < periodInSamples; i++)
-      {
-        rmsSum += pow(data[i + j * periodInSamples], 2);
-      }
+      double rmsSum = squaresPrefixSum[(j + 1) * periodInSamples] -
+        squaresPrefixSum[j * periodInSamples];
 
-      double rms = sqrt(sqrt(rmsSum / periodInSamples));
+      double rms = sqrt(sqrt(qMax(0.0, rmsSum) / periodInSamples));
 
       sPike pikeElement;
       pikeElement.value = rms;
@@ -205,26 +396,149 @@ stCrunchPoint Profiler::findCrunchPoint(int freqIndex,
     return crunchPoint;
 }
 
+// Start of the sweep response in frames,
+// counted from the end of skipped silence
+static int sweep_start_frame(int samplerate)
+{
+  return ((TEST_SIGNAL_LENGTH_SEC + TEST_SIGNAL_PAUSE_LENGTH_SEC) *
+    EXPER_POINTS_NUM + 1) * samplerate;
+}
+
+// First channel of the response without skipped silence
+SampleSpan Profiler::responseFirstChannel()
+{
+  return SampleSpan::channel(responseData,
+                             responseDataChannels,
+                             0).mid(RESPONSE_SKIP_SEC * responseDataSamplerate);
+}
+
 // Caclulates all tubeAmp profile components
-// by analyzing response signal from profiled amplifier
-void Profiler::analyze(ProfilerPresetType preset)
+// by analyzing response signal from profiled amplifier.
+// Audio may be nullptr, then real test data
+// is not sent to it.
+bool Profiler::analyze(ProfilerPresetType preset)
 {
   emit stopPlaybackNeeded();
 
   if (responseData.size() < (int)((3285485.0 * (double)responseDataSamplerate) / 44100.0 + 1))
   {
-    QMessageBox::critical(nullptr, QObject::tr("Error!"),
-                         tr("Response file is too short!"),
-                         QMessageBox::Ok,
-                         QMessageBox::Ok);
-    return;
+    emit errorMessageNeeded(tr("Response file is too short!"));
+    return false;
   }
 
-  // Remove first 1 second from response signal.
-  responseData.remove(0, 1 * responseDataSamplerate * responseDataChannels);
+  analyzeCrunchTest(preset);
+  analyzeSweep();
+  analyzeRealTest(preset);
+
+  return true;
+}
 
-  QVector<float> preamp_impulse(0.1 * processor->getSamplingRate());
-  double desiredGain;
+// Plays the test signal through the profiled amplifier
+// and analyzes each part of the response
+// as soon as it is captured
+bool Profiler::analyzeLive(ProfilerPresetType preset)
+{
+  QVector<float> testSignal = resample_vector(createTestSignal_v1(),
+                                              TEST_SIGNAL_V1_SAMPLERATE,
+                                              player->getSampleRate());
+
+  // Live response is not a file, stages are not cached
+  responseFileName.clear();
+  responseDataSamplerate = player->getSampleRate();
+  responseDataChannels = 1;
+  responseData.clear();
+  responseData.reserve(testSignal.size());
+
+  int crunchTestEnd = RESPONSE_SKIP_SEC * responseDataSamplerate +
+    sweep_start_frame(responseDataSamplerate);
+  int sweepEnd = crunchTestEnd + SWEEP_RESPONSE_LENGTH_SEC * responseDataSamplerate;
+
+  bool isCrunchTestAnalyzed = false;
+  bool isSweepAnalyzed = false;
+
+  // Captured samples delayed by the audio interface
+  // and amplifier chain are dropped
+  int latencyFrames = player->getRoundTripLatency();
+
+  player->startProfiling(testSignal);
+
+  QVector<float> captureBuffer(4096);
+
+  while (responseData.size() < testSignal.size())
+  {
+    if (!player->isProfiling())
+    {
+      emit errorMessageNeeded(tr("Profiling was interrupted!"));
+      return false;
+    }
+
+    if (player->isCaptureOverflow())
+    {
+      player->stopProfiling();
+      emit errorMessageNeeded(tr("Capture buffer overflow, profiling was interrupted!"));
+      return false;
+    }
+
+    int n_read = player->readCapture(captureBuffer.data(), captureBuffer.size());
+
+    if (n_read == 0)
+    {
+      QThread::msleep(20);
+      continue;
+    }
+
+    int start = qMin(latencyFrames, n_read);
+    latencyFrames -= start;
+
+    int n_append = qMin(n_read - start, testSignal.size() - responseData.size());
+    responseData.append(captureBuffer.mid(start, n_append));
+
+    // Capture progress fills the gaps between analysis stages
+    if (!isCrunchTestAnalyzed)
+    {
+      emit progressChanged(20 * (qint64)responseData.size() / crunchTestEnd);
+    }
+    else if (!isSweepAnalyzed)
+    {
+      emit progressChanged(50 + 25 * (qint64)(responseData.size() - crunchTestEnd) /
+                           (sweepEnd - crunchTestEnd));
+    }
+    else
+    {
+      emit progressChanged(75 + 10 * (qint64)(responseData.size() - sweepEnd) /
+                           (testSignal.size() - sweepEnd));
+    }
+
+    if ((!isCrunchTestAnalyzed) && (responseData.size() >= crunchTestEnd))
+    {
+      analyzeCrunchTest(preset);
+      isCrunchTestAnalyzed = true;
+    }
+
+    if ((!isSweepAnalyzed) && (responseData.size() >= sweepEnd))
+    {
+      analyzeSweep();
+      isSweepAnalyzed = true;
+    }
+  }
+
+  player->stopProfiling();
+
+  analyzeRealTest(preset);
+
+  return true;
+}
+
+// 1. Process "crunch" test part of the response singal.
+//    This part contains 14 test signals with different frequencies.
+//    For each frequency we will caclulate amplitudes of input signal
+//    at which profiled amplifier starts to clip.
+//    As a result we will get amplitude response of the preamp.
+void Profiler::analyzeCrunchTest(ProfilerPresetType preset)
+{
+  SampleSpan responseL = responseFirstChannel();
+
+  preamp_impulse = QVector<float>(0.1 * processor->getSamplingRate());
 
   if (preset == CRYSTALCLEAN_PRESET)
   {
@@ -263,6 +577,7 @@ void Profiler::analyze(ProfilerPresetType preset)
                                             processor->getSamplingRate());
 
     desiredGain = 0.0005;
+    quality.desiredGain = desiredGain;
 
     emit progressChanged(50);
   }
@@ -273,33 +588,53 @@ void Profiler::analyze(ProfilerPresetType preset)
 
     //int responseDataSamplerateOversampled = 44100.0 * RESPONSE_OVERSAMPLING_COEFF;
 
-    int crunchTestSize = ((TEST_SIGNAL_LENGTH_SEC + TEST_SIGNAL_PAUSE_LENGTH_SEC) *
-      EXPER_POINTS_NUM + 1) * responseDataSamplerate * responseDataChannels;
+    // Calculate amplitude response of the preamp
+    QVector<double> Aexper(EXPER_POINTS_NUM);
+    QVector<double> wexper(EXPER_POINTS_NUM);
+
+    QVector<stCrunchPoint> crunchPoints(EXPER_POINTS_NUM);
 
-    QVector<float> tempResponseData;
-    for (int i = 0; i < crunchTestSize; i += responseDataChannels)
+    // Crunch points do not depend on the preset
+    QByteArray crunchKey = profiler_cache_key(responseFileName, "crunch",
+                                              QByteArray::number(RESPONSE_OVERSAMPLING_COEFF));
+    ProfilerCacheEntry crunchCache;
+
+    if (profiler_cache_find(crunchKey, crunchCache))
     {
-      tempResponseData.append(responseData[i]);
+      QDataStream stream(crunchCache.values);
+      stream >> crunchPoints;
     }
+    else
+    {
+      // Frequencies are independent, analyze them in parallel,
+      // each job writes only its own slot
+      std::atomic<int> crunchPointsDone(0);
 
-    // 1. Process "crunch" test part of the response singal.
-    //    This part contains 14 test signals with different frequencies.
-    //    For each frequency we will caclulate amplitudes of input signal
-    //    at which profiled amplifier starts to clip.
-    //    As a result we will get amplitude response of the preamp.
+      int segmentSize = responseDataSamplerate * TEST_SIGNAL_LENGTH_SEC;
+      int segmentStep = responseDataSamplerate * (TEST_SIGNAL_LENGTH_SEC +
+        TEST_SIGNAL_PAUSE_LENGTH_SEC);
 
-    // Oversample crunch test part for better accuracy
-    QVector<float> responseDataOversampled = resample_vector(tempResponseData,
-                                                      responseDataSamplerate,
-                                                      responseDataSamplerateOversampled);
+      parallel_for(EXPER_POINTS_NUM, [&](int j)
+      {
+        // Oversample only analyzed test signal for better accuracy,
+        // pauses between test signals are skipped
+        QVector<float> segmentOversampled = oversample_window(responseL,
+                                                              j * segmentStep,
+                                                              segmentSize,
+                                                              responseDataSamplerate);
 
-    emit progressChanged(20);
+        crunchPoints[j] = findCrunchPoint(j,
+                                          segmentOversampled,
+                                          responseDataSamplerateOversampled);
 
-    stCrunchPoint crunchPoint;
+        emit progressChanged(20 + 30 * (++crunchPointsDone) / EXPER_POINTS_NUM);
+      });
 
-    // Calculate amplitude response of the preamp
-    QVector<double> Aexper(EXPER_POINTS_NUM);
-    QVector<double> wexper(EXPER_POINTS_NUM);
+      QDataStream stream(&crunchCache.values, QIODevice::WriteOnly);
+      stream << crunchPoints;
+
+      profiler_cache_insert(crunchKey, crunchCache, true);
+    }
 
     // Holds maximum amplitude value of the response
     // for normalization
@@ -309,19 +644,7 @@ void Profiler::analyze(ProfilerPresetType preset)
 
     for (int j = 0; j < EXPER_POINTS_NUM; j++)
     {
-      QVector<float> A(responseDataOversampled.size());
-
-      for (int i = 0; i < responseDataSamplerateOversampled *
-        TEST_SIGNAL_LENGTH_SEC - 1; i++)
-      {
-        A[i] = responseDataOversampled[i +
-          j * (responseDataSamplerateOversampled *
-          TEST_SIGNAL_LENGTH_SEC +
-          responseDataSamplerateOversampled *
-          TEST_SIGNAL_PAUSE_LENGTH_SEC)];
-      }
-
-      crunchPoint = findCrunchPoint(j, A, responseDataSamplerateOversampled);
+      const stCrunchPoint &crunchPoint = crunchPoints[j];
       if (crunchPoint.isBad)
       {
         badPointsCounter++;
@@ -342,6 +665,9 @@ void Profiler::analyze(ProfilerPresetType preset)
     // Calculate Gain level of profiled amplifier
     desiredGain = Amax / responseDataSamplerate * 7.0;
 
+    quality.desiredGain = desiredGain;
+    quality.badPointsCount = badPointsCounter;
+
     // Check if the gain is within a reasonable range
     if (desiredGain < 0.0001)
     {
@@ -404,133 +730,142 @@ void Profiler::analyze(ProfilerPresetType preset)
 
     emit progressChanged(50);
   }
+}
 
-  // 2. Calculate frequency response of the part after clipping
-  //    (mainly cabinet) by deconvolution
+// 2. Calculate frequency response of the part after clipping
+//    (mainly cabinet) by deconvolution
+void Profiler::analyzeSweep()
+{
+  SampleSpan responseL = responseFirstChannel();
 
-  // Get test sweep signal
-  QVector<float> sweepSignal(processor->getSamplingRate() * 10);
-  generate_logarithmic_sweep(10.0, processor->getSamplingRate(),
-                             20.0, 44100.0 / 2.0,
-                             0.01,
-                             sweepSignal.data());
+  int sweepStart = sweep_start_frame(responseDataSamplerate);
+  int sweepLength = responseDataSamplerate * SWEEP_RESPONSE_LENGTH_SEC;
 
-  // Get test signal after preamp - convolve test sweep
-  // with preamp impulse response
-  fft_convolver(sweepSignal.data(), sweepSignal.size(), preamp_impulse.data(),
-                preamp_impulse.size());
+  // Calculate cabinet impulse response by deconvolution
+  // with test signal after preamp
+  cabinet_impulseL = QVector<float>(processor->getSamplingRate());
+  cabinet_impulseR = QVector<float>(processor->getSamplingRate());
 
-  // Get sweep response from profiled amplifier
-  QVector<float> sweepResponseL;
-  QVector<float> sweepResponseR;
+  // Deconvolution depends on the preset only through preamp impulse
+  QByteArray deconvolutionParams;
+  {
+    QDataStream stream(&deconvolutionParams, QIODevice::WriteOnly);
+    stream.setFloatingPointPrecision(QDataStream::SinglePrecision);
+    stream << QString("inverse-sweep") << processor->getSamplingRate() << preamp_impulse;
+  }
 
-  int sweepStart = ((TEST_SIGNAL_LENGTH_SEC + TEST_SIGNAL_PAUSE_LENGTH_SEC) *
-    EXPER_POINTS_NUM + 1) * responseDataSamplerate * responseDataChannels;
+  QByteArray deconvolutionKey = profiler_cache_key(responseFileName, "deconvolution",
+                                                   deconvolutionParams);
+  ProfilerCacheEntry deconvolutionCache;
 
-  for (int i = 0;
-       i < (responseDataSamplerate * 11 * responseDataChannels);
-       i += responseDataChannels)
+  if (!profiler_cache_find(deconvolutionKey, deconvolutionCache) ||
+      !read_stage_entry(deconvolutionCache, cabinet_impulseL, cabinet_impulseR))
   {
-    sweepResponseL.append(responseData[sweepStart + i]);
-    if (responseDataChannels > 1)
-    {
-      float sum = 0.0;
-      for (int j = 1; j < responseDataChannels; j++)
-      {
-        sum += responseData[sweepStart + i + j];
-      }
-      sum /= (responseDataChannels - 1);
-      sweepResponseR.append(sum);
-    }
-    else
-    {
-      sweepResponseR.append(responseData[sweepStart + i]);
-    }
+    // Get sweep response from profiled amplifier
+    QVector<float> sweepResponseMixR;
+
+    SampleSpan sweepResponseL = responseL.mid(sweepStart, sweepLength);
+    SampleSpan sweepResponseR = response_right_channel(responseData,
+                                                       responseDataChannels,
+                                                       RESPONSE_SKIP_SEC *
+                                                       responseDataSamplerate + sweepStart,
+                                                       sweepLength,
+                                                       sweepResponseMixR);
+
+    // Resample to processor sampling rate
+    QVector<float> sweepResponseResampledL = resample_vector(
+      sweepResponseL,
+      responseDataSamplerate,
+      processor->getSamplingRate()
+    );
+
+    QVector<float> sweepResponseResampledR = resample_vector(
+      sweepResponseR,
+      responseDataSamplerate,
+      processor->getSamplingRate()
+    );
+
+    // Sweep passes the preamp before the cabinet,
+    // preamp impulse response is divided out of the result.
+    // Test signal v1 sweeps up to the Nyquist frequency of its sample rate
+    sweep_deconvolver(SWEEP_LENGTH_SEC,
+                      processor->getSamplingRate(),
+                      SWEEP_START_FREQUENCY,
+                      TEST_SIGNAL_V1_SAMPLERATE / 2.0,
+                      SWEEP_AMPLITUDE,
+                      sweepResponseResampledL.data(),
+                      sweepResponseResampledL.size(),
+                      cabinet_impulseL.data(),
+                      cabinet_impulseL.size(),
+                      preamp_impulse.data(),
+                      preamp_impulse.size());
+
+    sweep_deconvolver(SWEEP_LENGTH_SEC,
+                      processor->getSamplingRate(),
+                      SWEEP_START_FREQUENCY,
+                      TEST_SIGNAL_V1_SAMPLERATE / 2.0,
+                      SWEEP_AMPLITUDE,
+                      sweepResponseResampledR.data(),
+                      sweepResponseResampledR.size(),
+                      cabinet_impulseR.data(),
+                      cabinet_impulseR.size(),
+                      preamp_impulse.data(),
+                      preamp_impulse.size());
+
+    profiler_cache_insert(deconvolutionKey,
+                          stage_entry(cabinet_impulseL, cabinet_impulseR),
+                          true);
   }
 
-  // Resample to processor sampling rate
-  QVector<float> sweepResponseResampledL = resample_vector(
-    sweepResponseL,
-    responseDataSamplerate,
-    processor->getSamplingRate()
-  );
+  emit progressChanged(75);
+}
 
-  QVector<float> sweepResponseResampledR = resample_vector(
-    sweepResponseR,
-    responseDataSamplerate,
-    processor->getSamplingRate()
-  );
+// 4. Correct cabinet impulse response
+//    by auto-equalization based on the "real" test.
+//    Real test signal is recorded DI from guitar.
+void Profiler::analyzeRealTest(ProfilerPresetType preset)
+{
+  QVector<float> realTestResponseResampledL;
+  QVector<float> realTestResponseResampledR;
 
-  // Calculate cabinet impulse response by deconvolution
-  // with test signal after preamp
-  QVector<float> cabinet_impulseL(processor->getSamplingRate());
-  QVector<float> cabinet_impulseR(processor->getSamplingRate());
-
-  fft_deconvolver(sweepSignal.data(),
-                     sweepSignal.size(),
-                     sweepResponseResampledL.data(),
-                     sweepResponseResampledL.size(),
-                     cabinet_impulseL.data(),
-                     cabinet_impulseL.size(),
-                     30.0 / processor->getSamplingRate(),
-                     10000.0 / processor->getSamplingRate(),
-                     -32.0
-                 );
-
-  fft_deconvolver(sweepSignal.data(),
-                     sweepSignal.size(),
-                     sweepResponseResampledR.data(),
-                     sweepResponseResampledR.size(),
-                     cabinet_impulseR.data(),
-                     cabinet_impulseR.size(),
-                     30.0 / processor->getSamplingRate(),
-                     10000.0 / processor->getSamplingRate(),
-                     -32.0
-                 );
+  QByteArray realTestKey = profiler_cache_key(responseFileName, "realtest",
+                                              QByteArray::number(processor->getSamplingRate()));
+  ProfilerCacheEntry realTestCache;
 
-  emit progressChanged(75);
+  if (!profiler_cache_find(realTestKey, realTestCache) ||
+      !read_stage_entry(realTestCache, realTestResponseResampledL,
+                        realTestResponseResampledR))
+  {
+    // Get response on real test signal from profiled amplifier
+    int realTestStart = sweep_start_frame(responseDataSamplerate) +
+      responseDataSamplerate * SWEEP_RESPONSE_LENGTH_SEC;
 
-  // 4. Correct cabinet impulse response
-  //    by auto-equalization based on the "real" test.
-  //    Real test signal is recorded DI from guitar.
+    SampleSpan responseL = responseFirstChannel();
 
-  // Get response on real test signal from profiled amplifier
-  QVector<float> realTestResponseL;
-  QVector<float> realTestResponseR;
+    QVector<float> realTestResponseMixR;
 
-  int realTestStart = ((TEST_SIGNAL_LENGTH_SEC + TEST_SIGNAL_PAUSE_LENGTH_SEC) *
-    EXPER_POINTS_NUM + 1) * responseDataSamplerate * responseDataChannels +
-    responseDataSamplerate * responseDataChannels * 11;
+    SampleSpan realTestResponseL = responseL.mid(realTestStart);
+    SampleSpan realTestResponseR = response_right_channel(responseData,
+                                                          responseDataChannels,
+                                                          RESPONSE_SKIP_SEC *
+                                                          responseDataSamplerate + realTestStart,
+                                                          realTestResponseL.size(),
+                                                          realTestResponseMixR);
 
-  for (int i = 0;
-         i < (responseData.size() - realTestStart);
-         i += responseDataChannels)
-  {
-    realTestResponseL.append(responseData[realTestStart + i]);
-    float sum = 0.0;
-    if (responseDataChannels > 1)
-    {
-      for (int j = 1; j < responseDataChannels; j++)
-      {
-        sum += responseData[realTestStart + i + j];
-      }
-      sum /= (responseDataChannels - 1.0);
-      realTestResponseR.append(sum);
-    }
-    else
-    {
-      realTestResponseR.append(responseData[realTestStart + i]);
-    }
-  }
+    realTestResponseResampledL = resample_vector(realTestResponseL,
+      responseDataSamplerate, processor->getSamplingRate());
 
-  QVector<float> realTestResponseResampledL = resample_vector(realTestResponseL,
-    responseDataSamplerate, processor->getSamplingRate());
+    realTestResponseResampledR = resample_vector(realTestResponseR,
+      responseDataSamplerate, processor->getSamplingRate());
 
-  QVector<float> realTestResponseResampledR = resample_vector(realTestResponseR,
-    responseDataSamplerate, processor->getSamplingRate());
+    profiler_cache_insert(realTestKey,
+                          stage_entry(realTestResponseResampledL,
+                                      realTestResponseResampledR),
+                          true);
+  }
 
   QVector<float> realTestSignal;
-  realTestSignal = loadRealTestFile(realTestSignal, processor->getSamplingRate());
+  loadRealTestFile(realTestSignal, processor->getSamplingRate());
 
   float realTestSignalRMS = 0.0;
   for (int i = 0; i<realTestSignal.size(); i++)
@@ -562,18 +897,9 @@ void Profiler::analyze(ProfilerPresetType preset)
     preamp_impulse[i] *= 0.04 / preampImpulseNormalizeTempBufferRMS;
   }
 
-  QVector<float> processedDataL(realTestSignal.size());
-  QVector<float> processedDataR(realTestSignal.size());
-
-  // Create background Processor with previously adjusted profile
-  QSharedPointer<Processor> backProcessor
-    = QSharedPointer<Processor>(new Processor(processor->getSamplingRate()));
-  backProcessor->loadProfile(processor->getProfileFileName());
-
   stControls ctrls = processor->getControls();
   ctrls.drive = 100.0;
   ctrls.mastergain = 100.0;
-  backProcessor->setControls(ctrls);
   processor->setControls(ctrls);
 
   st_profile profile = processor->getProfile();
@@ -694,158 +1020,204 @@ void Profiler::analyze(ProfilerPresetType preset)
   processor->setPreampImpulse(preamp_impulse);
   processor->setCabinetImpulse(cabinet_impulseL, cabinet_impulseR);
 
-  backProcessor->setProfile(profile);
+  // Create background Processor with previously adjusted profile
+  QSharedPointer<Processor> backProcessor
+    = QSharedPointer<Processor>(processor->clone());
+
+  // Cut signals up to multiple of FRAGM (64 samples)
+  int sizeToFragm = floor(realTestSignal.size() / (double)fragm) * fragm;
+
+  realTestSignal.resize(sizeToFragm);
+  realTestResponseResampledL.resize(sizeToFragm);
+  realTestResponseResampledR.resize(sizeToFragm);
 
-  // DIRTY HACK!!!
-  // Run Auto-Equalizer 4 times to improve accuracy.
-  // TODO: correct AutoEqualizer code so that one run is enough
-  for (int i = 0; i < 4; i++)
+  // Auto-equalizer changes only the linear cabinet stage,
+  // so render preamp and tubeAmp model once
+  // and apply cabinet with correction to the cached output
+  QVector<float> ampOutput(sizeToFragm);
+  backProcessor->processAmp(ampOutput.data(), realTestSignal.data(), sizeToFragm);
+
+  emit progressChanged(85);
+
+  // Both cabinet channels get the same mono signal,
+  // so mono sum of the output is convolution with mono sum of impulses
+  QVector<float> cabinetImpulseMono(cabinet_impulseL.size());
+
+  for (int i = 0; i < cabinetImpulseMono.size(); i++)
   {
-    backProcessor->setPreampImpulse(processor->getPreampImpulse());
-    backProcessor->setCabinetImpulse(processor->getLeftImpulse(), processor->getRightImpulse());
+    cabinetImpulseMono[i] = (cabinet_impulseL[i] + cabinet_impulseR[i]) / 2.0;
+  }
 
-    // Cut signals up to multiple of FRAGM (64 samples)
-    int sizeToFragm = floor(realTestSignal.size() / (double)fragm) * fragm;
+  QVector<float> realTestResponseResampledMono(sizeToFragm);
 
-    realTestSignal.resize(sizeToFragm);
-    processedDataL.resize(sizeToFragm);
-    processedDataR.resize(sizeToFragm);
-    realTestResponseResampledL.resize(sizeToFragm);
-    realTestResponseResampledR.resize(sizeToFragm);
+  for (int i = 0; i < realTestResponseResampledMono.size(); i++)
+  {
+    realTestResponseResampledMono[i] = (realTestResponseResampledL[i] +
+    realTestResponseResampledR[i]) / 2.0;
+  }
 
-    // Get real test response from previously adjusted Processor
-    backProcessor->process(processedDataL.data(),
-                           processedDataR.data(),
-                           realTestSignal.data(),
-                           realTestSignal.size());
+  int averageSpectrumSize = 4096;
+  int autoEqualazierPointsNum = 40;
 
-    emit progressChanged(85);
+  QVector<double> fLogValues(autoEqualazierPointsNum);
+  QVector<double> w(autoEqualazierPointsNum);
 
-    QVector<double> processedDataDouble(processedDataL.size());
+  fLogValues[0] = log10(10.0);
 
-    for (int i = 0; i < processedDataL.size(); i++)
-    {
-      processedDataDouble[i] = (processedDataL[i] + processedDataR[i]) / 2.0;
-    }
+  for (int i = 0; i < autoEqualazierPointsNum - 1; i++)
+  {
+    fLogValues[i + 1] = (log10(20000.0) - log10(10.0)) *
+    (double)(i + 1) / (autoEqualazierPointsNum - 1) + log10(10.0);
+  }
 
-    QVector<double> realTestResponseResampledDouble(realTestResponseResampledL.size());
+  for (int i = 0; i < w.size(); i++)
+  {
+    w[i] = 2.0 * M_PI * pow(10.0, fLogValues[i]);
+  }
 
-    for (int i = 0; i < realTestResponseResampledL.size(); i++)
+  // Accumulated correction, residual and best result so far
+  QVector<double> correctionDb(autoEqualazierPointsNum, 0.0);
+  QVector<double> residualDb(autoEqualazierPointsNum);
+  QVector<double> bestCorrectionDb(correctionDb);
+  double bestResidualSpread = DBL_MAX;
+
+  const int maxIterations = 8;
+  const double residualToleranceDb = 0.5;
+
+  for (int iteration = 0; iteration < maxIterations; iteration++)
+  {
+    // Cabinet with current correction, truncated to cabinet length
+    // the same way as Processor::applyCabinetSumCorrection does
+    QVector<double> A(autoEqualazierPointsNum);
+
+    for (int i = 0; i < A.size(); i++)
     {
-      realTestResponseResampledDouble[i] = (realTestResponseResampledL[i] +
-      realTestResponseResampledR[i]) / 2.0;
+      A[i] = pow(10.0, correctionDb[i] / 20.0);
     }
 
-    // Calculate auto-equalizer correction
-    // between real test responses from Processor
-    // and from profiled amplifier
-    int averageSpectrumSize = 4096;
-    int autoEqualazierPointsNum = 40;
+    QVector<float> correctionImpulse(cabinetImpulseMono.size());
+
+    frequency_response_to_impulse_response(w.data(),
+                                           A.data(),
+                                           w.size(),
+                                           correctionImpulse.data(),
+                                           correctionImpulse.size(),
+                                           backProcessor->getSamplingRate());
 
-    processor->correctionEqualizerFLogValues.resize(autoEqualazierPointsNum);
-    processor->correctionEqualizerDbValues.resize(autoEqualazierPointsNum);
+    QVector<float> correctedCabinetImpulse(cabinetImpulseMono);
 
-    processor->correctionEqualizerFLogValues[0] = log10(10.0);
+    fft_convolver(correctedCabinetImpulse.data(), correctedCabinetImpulse.size(),
+                  correctionImpulse.data(), correctionImpulse.size());
 
-    for (int i = 0; i < autoEqualazierPointsNum - 1; i++)
-    {
-      processor->correctionEqualizerFLogValues[i + 1] = (log10(20000.0) - log10(10.0)) *
-      (double)(i + 1) / (processor->correctionEqualizerFLogValues.size() - 1) + log10(10.0);
-    }
+    // fft_convolver() is circular, zero padding by the impulse
+    // length keeps the cabinet tail from wrapping to the start
+    QVector<float> processedDataMono(ampOutput);
+    processedDataMono.resize(ampOutput.size() + correctedCabinetImpulse.size());
+
+    fft_convolver(processedDataMono.data(), processedDataMono.size(),
+                  correctedCabinetImpulse.data(), correctedCabinetImpulse.size(),
+                  FFT_PRECISION_FLOAT);
+
+    processedDataMono.resize(ampOutput.size());
 
+    // Residual between real test responses from corrected cabinet
+    // and from profiled amplifier
     calulate_autoeq_amplitude_response(averageSpectrumSize,
                                        backProcessor->getSamplingRate(),
-                                       processedDataDouble.data(),
-                                       processedDataDouble.size(),
-                                       realTestResponseResampledDouble.data(),
-                                       realTestResponseResampledDouble.size(),
-                                       processor->correctionEqualizerFLogValues.data(),
-                                       processor->correctionEqualizerDbValues.data(),
+                                       processedDataMono.data(),
+                                       processedDataMono.size(),
+                                       realTestResponseResampledMono.data(),
+                                       realTestResponseResampledMono.size(),
+                                       fLogValues.data(),
+                                       residualDb.data(),
                                        autoEqualazierPointsNum
     );
 
-    /*for (int i = 0; i < processor->correctionEqualizerFLogValues.size(); i++)
-     {                                                                               *
-     if (processor->correctionEqualizerDbValues[i] > 20.0)
-     {
-     processor->correctionEqualizerDbValues[i] = 20.0;
-  }
+    // Residual is normalized to 0 dB maximum,
+    // so its spread is the deviation from flat response
+    double residualSpread = 0.0;
 
-  if (processor->correctionEqualizerDbValues[i] < (-30.0))
-  {
-  processor->correctionEqualizerDbValues[i] = -30.0;
-  }
-  }*/
+    for (int i = 0; i < residualDb.size(); i++)
+    {
+      residualSpread = qMax(residualSpread, -residualDb[i]);
+    }
 
-    //processor->setPreampImpulse(preamp_impulse);
-    //processor->setCabinetImpulse(cabinet_impulseL, cabinet_impulseR);
+    if (residualSpread >= bestResidualSpread)
+    {
+      // Not converging any more, keep previous result
+      break;
+    }
 
-    QVector<double> w(processor->correctionEqualizerFLogValues.size());
-    QVector<double> A(processor->correctionEqualizerFLogValues.size());
+    bestResidualSpread = residualSpread;
+    bestCorrectionDb = correctionDb;
 
-    for (int i = 0; i < w.size(); i++)
+    if (residualSpread < residualToleranceDb)
     {
-      w[i] = 2.0 * M_PI * pow(10.0, processor->correctionEqualizerFLogValues[i]);
-      A[i] = pow(10.0, processor->correctionEqualizerDbValues[i] / 20.0);
+      break;
     }
 
-    // Set correction frequency response to the main Processor
-    processor->setCabinetSumCorrectionImpulseFromFrequencyResponse(w, A);
+    for (int i = 0; i < correctionDb.size(); i++)
+    {
+      correctionDb[i] += residualDb[i];
+    }
 
-    // Process dummy data to apply changes
-    QVector<float> dummyData(fragm);
-    processor->process(dummyData.data(),
-                       dummyData.data(),
-                       dummyData.data(),
-                       fragm);
+    emit progressChanged(85 + (iteration + 1) * 10 / maxIterations);
+  }
 
-    // Apply cabinet frequency response correction
-    // to cabinet impulse response
-    processor->applyCabinetSumCorrection();
-    processor->resetCabinetSumCorrection();
+  quality.autoEqResidualDb = bestResidualSpread;
 
-    processor->correctionEqualizerFLogValues.resize(4);
-    processor->correctionEqualizerDbValues.resize(4);
+  QVector<double> A(autoEqualazierPointsNum);
 
-    processor->correctionEqualizerFLogValues[0] = log10(10.0);
-    processor->correctionEqualizerFLogValues[1] = log10(1000.0);
-    processor->correctionEqualizerFLogValues[2] = log10(20000.0);
-    processor->correctionEqualizerFLogValues[3] = log10(22000.0);
+  for (int i = 0; i < A.size(); i++)
+  {
+    A[i] = pow(10.0, bestCorrectionDb[i] / 20.0);
+  }
 
-    processor->correctionEqualizerDbValues[0] = 0.0;
-    processor->correctionEqualizerDbValues[1] = 0.0;
-    processor->correctionEqualizerDbValues[2] = 0.0;
-    processor->correctionEqualizerDbValues[3] = 0.0;
+  processor->correctionEqualizerFLogValues = fLogValues;
+  processor->correctionEqualizerDbValues = bestCorrectionDb;
 
-    // Process dummy data to apply changes
-    processor->process(dummyData.data(), dummyData.data(), dummyData.data(), fragm);
-  }
+  // Set correction frequency response to the main Processor
+  processor->setCabinetSumCorrectionImpulseFromFrequencyResponse(w, A);
 
-  processor->setProfileFileName(":/profiles/British Crunch.tapf");
+  // Process dummy data to apply changes
+  QVector<float> dummyData(fragm);
+  processor->process(dummyData.data(),
+                     dummyData.data(),
+                     dummyData.data(),
+                     fragm);
 
-  // Send real test DI sound and real test response
-  // from profiled amplifier to the Player
-  player->setDiData(realTestSignal);
-  player->setRefData(realTestResponseResampledL, realTestResponseResampledR);
+  // Apply cabinet frequency response correction
+  // to cabinet impulse response
+  processor->applyCabinetSumCorrection();
+  processor->resetCabinetSumCorrection();
+
+  processor->correctionEqualizerFLogValues.resize(4);
+  processor->correctionEqualizerDbValues.resize(4);
+
+  processor->correctionEqualizerFLogValues[0] = log10(10.0);
+  processor->correctionEqualizerFLogValues[1] = log10(1000.0);
+  processor->correctionEqualizerFLogValues[2] = log10(20000.0);
+  processor->correctionEqualizerFLogValues[3] = log10(22000.0);
+
+  processor->correctionEqualizerDbValues[0] = 0.0;
+  processor->correctionEqualizerDbValues[1] = 0.0;
+  processor->correctionEqualizerDbValues[2] = 0.0;
+  processor->correctionEqualizerDbValues[3] = 0.0;
+
+  // Process dummy data to apply changes
+  processor->process(dummyData.data(), dummyData.data(), dummyData.data(), fragm);
+
+  processor->setProfileFileName(":/profiles/British Crunch.tapf");
 
   // Equalize RMS of the real test response from profiled amplifier
   // with sound from the Processor
   // Normalize cabinet impulse to -20 dB level
   {
-    QVector<float> processedDataL(player->diData.size());
-    QVector<float> processedDataR(player->diData.size());
+    QVector<float> processedDataL(realTestSignal.size());
+    QVector<float> processedDataR(realTestSignal.size());
 
     QSharedPointer<Processor> backProcessor
-    = QSharedPointer<Processor>(new Processor(processor->getSamplingRate()));
-
-    backProcessor->loadProfile(processor->getProfileFileName());
-
-    backProcessor->setControls(processor->getControls());
-    backProcessor->setProfile(processor->getProfile());
-
-    backProcessor->setPreampImpulse(processor->getPreampImpulse());
-    backProcessor->setCabinetImpulse(processor->getLeftImpulse(),
-                                     processor->getRightImpulse());
+    = QSharedPointer<Processor>(processor->clone());
 
     QVector<double> w(processor->correctionEqualizerFLogValues.size());
     QVector<double> A(processor->correctionEqualizerFLogValues.size());
@@ -875,14 +1247,14 @@ void Profiler::analyze(ProfilerPresetType preset)
       backProcessor->setPreampCorrectionImpulseFromFrequencyResponse(w, A);
     }
 
-    int sizeToFragm = floor(player->diData.size() / (double)fragm) * fragm;
+    int sizeToFragm = floor(realTestSignal.size() / (double)fragm) * fragm;
 
     processedDataL.resize(sizeToFragm);
     processedDataR.resize(sizeToFragm);
 
     backProcessor->process(processedDataL.data(),
                            processedDataR.data(),
-                           player->diData.data(),
+                           realTestSignal.data(),
                            sizeToFragm);
 
     double rmsProcessedData = 0.0;
@@ -909,20 +1281,34 @@ void Profiler::analyze(ProfilerPresetType preset)
     );
 
     double rmsRefData = 0.0;
-    for (int i = 0; i < player->refDataL.size(); i++)
+    for (int i = 0; i < realTestResponseResampledL.size(); i++)
     {
-      rmsRefData += pow((player->refDataL[i] + player->refDataR[i]) / 2.0, 2);
+      rmsRefData += pow((realTestResponseResampledL[i] +
+        realTestResponseResampledR[i]) / 2.0, 2);
     }
-    rmsRefData = sqrt(rmsRefData / player->refDataL.size());
+    rmsRefData = sqrt(rmsRefData / realTestResponseResampledL.size());
 
     double rmsRatio = rmsRefData / 0.1;
 
-    for (int i = 0; i < player->refDataL.size(); i++)
+    for (int i = 0; i < realTestResponseResampledL.size(); i++)
     {
-      player->refDataL[i] /= rmsRatio;
-      player->refDataR[i] /= rmsRatio;
+      realTestResponseResampledL[i] /= rmsRatio;
+      realTestResponseResampledR[i] /= rmsRatio;
     }
   }
+
+  // Send real test DI sound and real test response
+  // from profiled amplifier to the Player
+  if (player != nullptr)
+  {
+    player->setDiData(realTestSignal);
+    player->setRefData(realTestResponseResampledL, realTestResponseResampledR);
+  }
+}
+
+stProfilerQuality Profiler::getQuality()
+{
+  return quality;
 }
 
 void Profiler::createTestFile(QString fileName, int version)
@@ -935,10 +1321,11 @@ void Profiler::createTestFile(QString fileName, int version)
   }
 }
 
-void Profiler::createTestFile_v1(QString fileName)
+// Test signal v1 is always generated at TEST_SIGNAL_V1_SAMPLERATE
+QVector<float> Profiler::createTestSignal_v1()
 {
   // Define some variables for the sound
-  float sampleRate = 44100.0; // hertz
+  float sampleRate = TEST_SIGNAL_V1_SAMPLERATE; // hertz
 
   int nSamples_signal = (int)(TEST_SIGNAL_LENGTH_SEC * sampleRate);
   int nSamples_pause = (int)(TEST_SIGNAL_PAUSE_LENGTH_SEC * sampleRate);
@@ -991,10 +1378,11 @@ void Profiler::createTestFile_v1(QString fileName)
 
   // Create sweep signal
   int startSweep = testSignal.length();
-  testSignal.resize(testSignal.length() + sampleRate * 10);
+  testSignal.resize(testSignal.length() + sampleRate * SWEEP_LENGTH_SEC);
 
-  generate_logarithmic_sweep(10.0, sampleRate, 20.0, sampleRate / 2.0,
-                             0.01, &(testSignal.data()[startSweep]));
+  generate_logarithmic_sweep(SWEEP_LENGTH_SEC, sampleRate, SWEEP_START_FREQUENCY,
+                             sampleRate / 2.0, SWEEP_AMPLITUDE,
+                             &(testSignal.data()[startSweep]));
 
   int startBlank = testSignal.size();
   testSignal.resize(testSignal.size() + sampleRate * 1);
@@ -1005,12 +1393,19 @@ void Profiler::createTestFile_v1(QString fileName)
   }
 
   // Add "real" test signal from wav file
-  testSignal = loadRealTestFile(testSignal, sampleRate);
+  loadRealTestFile(testSignal, sampleRate);
+
+  return testSignal;
+}
+
+void Profiler::createTestFile_v1(QString fileName)
+{
+  QVector<float> testSignal = createTestSignal_v1();
 
   SF_INFO sfinfo;
   sfinfo.format = SF_FORMAT_WAV | SF_FORMAT_PCM_16;
   sfinfo.frames = testSignal.size();
-  sfinfo.samplerate = (int)sampleRate;
+  sfinfo.samplerate = TEST_SIGNAL_V1_SAMPLERATE;
   sfinfo.channels = 1;
   sfinfo.sections = 1;
   sfinfo.seekable = 1;
@@ -1027,13 +1422,12 @@ void Profiler::createTestFile_v1(QString fileName)
 
 void ProfilerThread::run()
 {
-  profiler->analyze(presetType);
-}
-
-void Profiler::warningMessageNeededSlot(QString message)
-{
-  QMessageBox::warning(nullptr, QObject::tr("Warning!"),
-                               message,
-                               QMessageBox::Ok,
-                               QMessageBox::Ok);
+  if (liveMode)
+  {
+    success = profiler->analyzeLive(presetType);
+  }
+  else
+  {
+    success = profiler->analyze(presetType);
+  }
 }
@@ -25,7 +25,8 @@
 #include <QThread>
 
 #include "processor.h"
-#include "player.h"
+#include "profiler_audio.h"
+#include "sample_span.h"
 
 enum ProfilerPresetType {CRYSTALCLEAN_PRESET, CLASSIC_PRESET, MASTERGAIN_PRESET};
 
@@ -43,34 +44,63 @@ struct sPike
   int time;
 };
 
+// Figures describing how well the response file
+// could be profiled
+struct stProfilerQuality
+{
+  // Calibration frequencies at which clipping was not reached
+  int badPointsCount;
+  // Gain of the profiled amplifier before limiting
+  double desiredGain;
+  // Deviation of the auto-equalized response from the reference
+  double autoEqResidualDb;
+};
+
 class Profiler : public QObject
 {
   Q_OBJECT
 
 public:
-  Profiler(Processor *prc, Player *plr);
-  void loadResponseFile(QString fileName);
+  // Audio may be nullptr, then only response files are analyzed
+  Profiler(Processor *prc, ProfilerAudio *plr);
+  bool loadResponseFile(QString fileName);
   void createTestFile(QString fileName, int version);
-  void analyze(ProfilerPresetType preset);
+  bool analyze(ProfilerPresetType preset);
+  bool analyzeLive(ProfilerPresetType preset);
+  stProfilerQuality getQuality();
 
 private:
   Processor *processor;
-  Player *player;
+  ProfilerAudio *player;
 
+  QString responseFileName;
   int responseDataSamplerate;
   int responseDataChannels;
   QVector<float> responseData;
 
-  stCrunchPoint findCrunchPoint(int freqIndex, QVector<float> data, int samplerate);
-  QVector<float> loadRealTestFile(QVector<float> testSignal, float sampleRate);
+  stProfilerQuality quality;
 
-  void createTestFile_v1(QString fileName);
+  // Results of analysis stages
+  QVector<float> preamp_impulse;
+  double desiredGain;
+  QVector<float> cabinet_impulseL;
+  QVector<float> cabinet_impulseR;
 
-private slots:
-  void warningMessageNeededSlot(QString message);
+  SampleSpan responseFirstChannel();
+
+  void analyzeCrunchTest(ProfilerPresetType preset);
+  void analyzeSweep();
+  void analyzeRealTest(ProfilerPresetType preset);
+
+  stCrunchPoint findCrunchPoint(int freqIndex, SampleSpan data, int samplerate);
+  void loadRealTestFile(QVector<float> &testSignal, float sampleRate);
+
+  QVector<float> createTestSignal_v1();
+  void createTestFile_v1(QString fileName);
 
 signals:
   void warningMessageNeeded(QString message);
+  void errorMessageNeeded(QString message);
   void progressChanged(int progress);
   void stopPlaybackNeeded();
 };
@@ -84,6 +114,8 @@ class ProfilerThread : public QThread
 public:
   Profiler *profiler;
   ProfilerPresetType presetType;
+  bool liveMode = false;
+  bool success;
 };
 
 #endif //PROFILER_H
@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2018-2020 Oleg Kapitonov
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * --------------------------------------------------------------------------
+ */
+
+#ifndef PROFILERAUDIO_H
+#define PROFILERAUDIO_H
+
+#include <QVector>
+
+// Audio side of the profiler: live capture of the
+// amplifier response and playback of the real test.
+// Implemented by Player, headless tools have none
+class ProfilerAudio
+{
+public:
+  virtual ~ProfilerAudio() {}
+
+  virtual int getSampleRate() = 0;
+  virtual int getRoundTripLatency() = 0;
+
+  // Test signal is played on the outputs,
+  // the input is captured until stopProfiling()
+  virtual void startProfiling(QVector<float> testSignal) = 0;
+  virtual void stopProfiling() = 0;
+  // False when profiling was stopped from outside
+  virtual bool isProfiling() = 0;
+  virtual bool isCaptureOverflow() = 0;
+  virtual int readCapture(float *data, int n_count) = 0;
+
+  // Real test DI and response for playback
+  virtual void setDiData(QVector<float> data) = 0;
+  virtual void setRefData(QVector<float> dataL, QVector<float> dataR) = 0;
+};
+
+#endif // PROFILERAUDIO_H
@@ -0,0 +1,241 @@
+/*
+ * Copyright (C) 2018-2020 Oleg Kapitonov
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * --------------------------------------------------------------------------
+ */
+
+
+#include <QMutex>
+#include <QCache>
+#include <QHash>
+#include <QDir>
+#include <QFile>
+#include <QSaveFile>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QDataStream>
+#include <QStandardPaths>
+#include <QCryptographicHash>
+
+#include "profiler_cache.h"
+
+static QMutex profilerCacheMutex;
+static QCache<QByteArray, ProfilerCacheEntry> profilerCache(PROFILER_CACHE_MAX_MEMORY);
+static bool profilerCacheDiskEnabled = false;
+
+// Content hashes of response files by path, size
+// and modification time, hashes are calculated
+// while the files are decoded, so each file is read once
+static QHash<QString, QByteArray> contentHashes;
+
+static QString cache_dirname()
+{
+  return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) +
+    "/profiler";
+}
+
+static QString cache_filename(QByteArray key)
+{
+  QString cacheDir = cache_dirname();
+  QDir().mkpath(cacheDir);
+
+  return cacheDir + "/" + QString::fromLatin1(key);
+}
+
+static int entry_cost(const ProfilerCacheEntry &entry)
+{
+  qint64 cost = entry.values.size();
+
+  for (const QVector<float> &samples : entry.samples)
+  {
+    cost += samples.size() * sizeof(float);
+  }
+
+  return qMin(cost, (qint64)PROFILER_CACHE_MAX_MEMORY + 1);
+}
+
+// Path, size and modification time of a file,
+// read without opening the file
+static QString file_identity(QString fileName)
+{
+  QFileInfo fileInfo(fileName);
+
+  return fileInfo.absoluteFilePath() + "|" +
+    QString::number(fileInfo.size()) + "|" +
+    QString::number(fileInfo.lastModified().toMSecsSinceEpoch());
+}
+
+// Hash stored when the file was decoded, empty
+// if the file was not decoded yet or was changed since
+static QByteArray content_hash(QString fileName)
+{
+  QString identity = file_identity(fileName);
+
+  QMutexLocker locker(&profilerCacheMutex);
+
+  return contentHashes.value(identity);
+}
+
+// Deletes least recently used files above the disk cache limit,
+// used files get the current modification time
+static void evict_disk_cache()
+{
+  QDir cacheDir(cache_dirname());
+  QFileInfoList cacheFiles = cacheDir.entryInfoList(QDir::Files, QDir::Time);
+
+  qint64 totalSize = 0;
+
+  for (const QFileInfo &cacheFile : cacheFiles)
+  {
+    totalSize += cacheFile.size();
+
+    if (totalSize > PROFILER_CACHE_MAX_DISK)
+    {
+      QFile::remove(cacheFile.absoluteFilePath());
+    }
+  }
+}
+
+QByteArray profiler_cache_key(QString responseFileName,
+                              QString stage,
+                              QByteArray params)
+{
+  // Responses not read from a file (live capture)
+  // and files not decoded yet are never cached
+  if (responseFileName.isEmpty())
+  {
+    return QByteArray();
+  }
+
+  QByteArray contentHash = content_hash(responseFileName);
+  if (contentHash.isEmpty())
+  {
+    return QByteArray();
+  }
+
+  QByteArray identity;
+  QDataStream stream(&identity, QIODevice::WriteOnly);
+
+  stream << contentHash
+         << stage
+         << params;
+
+  return QCryptographicHash::hash(identity, QCryptographicHash::Sha1).toHex();
+}
+
+bool profiler_cache_find(QByteArray key, ProfilerCacheEntry &entry)
+{
+  if (key.isEmpty())
+  {
+    return false;
+  }
+
+  QMutexLocker locker(&profilerCacheMutex);
+
+  ProfilerCacheEntry *cached = profilerCache.object(key);
+  if (cached != nullptr)
+  {
+    entry = *cached;
+    return true;
+  }
+
+  if (profilerCacheDiskEnabled)
+  {
+    QFile cacheFile(cache_filename(key));
+    if (cacheFile.open(QIODevice::ReadOnly))
+    {
+      // Samples are read straight into the vectors
+      QDataStream stream(&cacheFile);
+      stream.setFloatingPointPrecision(QDataStream::SinglePrecision);
+
+      ProfilerCacheEntry loaded;
+      stream >> loaded.values >> loaded.samples;
+
+      if (stream.status() != QDataStream::Ok)
+      {
+        return false;
+      }
+
+#if QT_VERSION >= QT_VERSION_CHECK(5, 10, 0)
+      cacheFile.setFileTime(QDateTime::currentDateTime(),
+                            QFileDevice::FileModificationTime);
+#endif
+
+      entry = loaded;
+      profilerCache.insert(key, new ProfilerCacheEntry(loaded), entry_cost(loaded));
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void profiler_cache_insert(QByteArray key, const ProfilerCacheEntry &entry,
+                           bool persistent)
+{
+  if (key.isEmpty())
+  {
+    return;
+  }
+
+  QMutexLocker locker(&profilerCacheMutex);
+
+  // QCache deletes objects larger than its capacity,
+  // sample vectors are shared with the caller
+  profilerCache.insert(key, new ProfilerCacheEntry(entry), entry_cost(entry));
+
+  if (persistent && profilerCacheDiskEnabled)
+  {
+    // QSaveFile replaces the file atomically,
+    // so readers never see partially written results.
+    // Samples are streamed to the file without
+    // an intermediate buffer
+    QSaveFile cacheFile(cache_filename(key));
+    if (cacheFile.open(QIODevice::WriteOnly))
+    {
+      QDataStream stream(&cacheFile);
+      stream.setFloatingPointPrecision(QDataStream::SinglePrecision);
+
+      stream << entry.values << entry.samples;
+
+      cacheFile.commit();
+    }
+
+    evict_disk_cache();
+  }
+}
+
+void profiler_cache_set_content_hash(QString responseFileName,
+                                     QByteArray contentHash)
+{
+  QString identity = file_identity(responseFileName);
+
+  QMutexLocker locker(&profilerCacheMutex);
+  contentHashes.insert(identity, contentHash);
+}
+
+void profiler_cache_set_disk_enabled(bool enabled)
+{
+  QMutexLocker locker(&profilerCacheMutex);
+  profilerCacheDiskEnabled = enabled;
+}
+
+void profiler_cache_clear()
+{
+  QMutexLocker locker(&profilerCacheMutex);
+  profilerCache.clear();
+  contentHashes.clear();
+}
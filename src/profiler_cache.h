@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2018-2020 Oleg Kapitonov
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * --------------------------------------------------------------------------
+ */
+
+
+#ifndef PROFILERCACHE_H
+#define PROFILERCACHE_H
+
+#include <QString>
+#include <QByteArray>
+#include <QVector>
+
+// Cache of intermediate profiler results shared by
+// all Profiler instances. Each stage result is stored
+// under a key made from the hash of the decoded response
+// samples and the stage parameters, so running the profiler
+// again on the same file with another preset
+// reuses the stages that do not depend on the preset.
+// Results are kept in memory and, if enabled,
+// in the user cache directory.
+
+// Upper limit of memory used by cached results
+#define PROFILER_CACHE_MAX_MEMORY (256 * 1024 * 1024)
+// Upper limit of the disk cache, least recently
+// used results are deleted above it
+#define PROFILER_CACHE_MAX_DISK (1024 * 1024 * 1024)
+// Response files are decoded and hashed
+// in chunks of this number of frames
+#define PROFILER_CACHE_HASH_CHUNK (64 * 1024)
+
+// Stage result, sample vectors are shared with
+// the memory cache without copying, small values
+// are serialized separately
+struct ProfilerCacheEntry
+{
+  QByteArray values;
+  QVector<QVector<float>> samples;
+};
+
+QByteArray profiler_cache_key(QString responseFileName,
+                              QString stage,
+                              QByteArray params);
+
+// Hash of the samples and format of a response file,
+// calculated by the caller while decoding the file.
+// Keys of the file are made from it while the file
+// path, size and modification time stay the same
+void profiler_cache_set_content_hash(QString responseFileName,
+                                     QByteArray contentHash);
+
+bool profiler_cache_find(QByteArray key, ProfilerCacheEntry &entry);
+
+// Persistent results are also written to disk
+// when disk cache is enabled
+void profiler_cache_insert(QByteArray key, const ProfilerCacheEntry &entry,
+                           bool persistent);
+
+void profiler_cache_set_disk_enabled(bool enabled);
+
+void profiler_cache_clear();
+
+#endif //PROFILERCACHE_H
@@ -21,8 +21,10 @@
 #include <QVBoxLayout>
 #include <QLabel>
 #include <QFileDialog>
+#include <QSettings>
 
 #include "profiler_dialog.h"
+#include "profiler_cache.h"
 
 ProfilerDialog::ProfilerDialog(Processor *prc, Player *plr, PlayerPanel *pnl, QWidget *parent) : QDialog(parent)
 {
@@ -77,14 +79,25 @@ ProfilerDialog::ProfilerDialog(Processor *prc, Player *plr, PlayerPanel *pnl, QW
 
   classicPresetRadioButton->setChecked(true);
 
+  diskCacheCheckBox = new QCheckBox(tr("Keep analysis results on disk"), this);
+  QSettings settings;
+  diskCacheCheckBox->setChecked(settings.value("profilerDialog/diskCache", false).toBool());
+  lay->addWidget(diskCacheCheckBox, 3, 0, 1, 3);
+
+  liveProfilingButton = new QPushButton(tr("Live Profiling"), this);
+  lay->addWidget(liveProfilingButton, 4, 0, 1, 1);
+
+  connect(liveProfilingButton, &QPushButton::clicked, this,
+          &ProfilerDialog::liveProfilingButtonClick);
+
   analyzeButton = new QPushButton(tr("Analyze"), this);
   analyzeButton->setEnabled(false);
-  lay->addWidget(analyzeButton, 3, 1, 1, 1);
+  lay->addWidget(analyzeButton, 4, 1, 1, 1);
 
   connect(analyzeButton, &QPushButton::clicked, this, &ProfilerDialog::analyzeButtonClick);
 
   cancelButton = new QPushButton(tr("Cancel"), this);
-  lay->addWidget(cancelButton, 3, 2, 1, 1);
+  lay->addWidget(cancelButton, 4, 2, 1, 1);
 
   connect(cancelButton, &QPushButton::clicked, this, &ProfilerDialog::cancelButtonClick);
 
@@ -100,40 +113,84 @@ void ProfilerDialog::analyzeButtonClick()
 {
   if (!responseFileEdit->text().isEmpty())
   {
-    profiler = new Profiler(processor, player);
+    startProfiler(false);
+  }
+}
 
-    connect(profiler, &Profiler::progressChanged, this,
-      &ProfilerDialog::profilerProgressChanged);
+void ProfilerDialog::liveProfilingButtonClick()
+{
+  QMessageBox::StandardButton answer = QMessageBox::question(this,
+    tr("Live Profiling"),
+    tr("Test signal will be played on the outputs,\n"
+       "connect them to the amplifier input\n"
+       "and the amplifier output to the input.\n"
+       "Start profiling?"));
+
+  if (answer == QMessageBox::Yes)
+  {
+    // Profiler takes the Player over,
+    // stop playback before it starts
+    playerPanel->stopPlayback();
+    startProfiler(true);
+  }
+}
 
-    connect(profiler, &Profiler::stopPlaybackNeeded, playerPanel, &PlayerPanel::stopPlayback);
+void ProfilerDialog::startProfiler(bool liveMode)
+{
+  profiler = new Profiler(processor, player);
+
+  connect(profiler, &Profiler::progressChanged, this,
+    &ProfilerDialog::profilerProgressChanged);
+
+  connect(profiler, &Profiler::stopPlaybackNeeded, playerPanel, &PlayerPanel::stopPlayback);
+
+  connect(profiler, &Profiler::warningMessageNeeded, this,
+    &ProfilerDialog::profilerWarningMessage);
 
+  connect(profiler, &Profiler::errorMessageNeeded, this,
+    &ProfilerDialog::profilerErrorMessage);
+
+  QSettings settings;
+  settings.setValue("profilerDialog/diskCache", diskCacheCheckBox->isChecked());
+  profiler_cache_set_disk_enabled(diskCacheCheckBox->isChecked());
+
+  if (!liveMode)
+  {
     profiler->loadResponseFile(responseFileEdit->text());
+  }
 
-    profilerThread->profiler = profiler;
+  profilerThread->profiler = profiler;
+  profilerThread->liveMode = liveMode;
 
-    if (crystalcleanPresetRadioButton->isChecked())
-    {
-      profilerThread->presetType = CRYSTALCLEAN_PRESET;
-    }
+  if (crystalcleanPresetRadioButton->isChecked())
+  {
+    profilerThread->presetType = CRYSTALCLEAN_PRESET;
+  }
 
-    if (classicPresetRadioButton->isChecked())
-    {
-      profilerThread->presetType = CLASSIC_PRESET;
-    }
+  if (classicPresetRadioButton->isChecked())
+  {
+    profilerThread->presetType = CLASSIC_PRESET;
+  }
 
-    if (mastergainPresetRadioButton->isChecked())
-    {
-      profilerThread->presetType = MASTERGAIN_PRESET;
-    }
+  if (mastergainPresetRadioButton->isChecked())
+  {
+    profilerThread->presetType = MASTERGAIN_PRESET;
+  }
 
+  if (liveMode)
+  {
+    msg->setMessage(tr("Profiling..."));
+  }
+  else
+  {
     msg->setMessage(tr("Analyzing..."));
-    msg->setTitle(tr("Please Wait!"));
-    msg->setProgressValue(0);
+  }
+  msg->setTitle(tr("Please Wait!"));
+  msg->setProgressValue(0);
 
-    msg->open();
+  msg->open();
 
-    profilerThread->start();
-  }
+  profilerThread->start();
 }
 
 void ProfilerDialog::responseFileOpenButtonClick()
@@ -187,3 +244,19 @@ void ProfilerDialog::profilerProgressChanged(int progress)
 {
   msg->setProgressValue(progress);
 }
+
+void ProfilerDialog::profilerWarningMessage(QString message)
+{
+  QMessageBox::warning(nullptr, QObject::tr("Warning!"),
+                               message,
+                               QMessageBox::Ok,
+                               QMessageBox::Ok);
+}
+
+void ProfilerDialog::profilerErrorMessage(QString message)
+{
+  QMessageBox::critical(nullptr, QObject::tr("Error!"),
+                        message,
+                        QMessageBox::Ok,
+                        QMessageBox::Ok);
+}
@@ -26,6 +26,7 @@
 #include <QLineEdit>
 #include <QGroupBox>
 #include <QRadioButton>
+#include <QCheckBox>
 #include <QMessageBox>
 
 #include "processor.h"
@@ -56,6 +57,9 @@ private:
   QRadioButton *mastergainPresetRadioButton;
   QRadioButton *crystalcleanPresetRadioButton;
 
+  QCheckBox *diskCacheCheckBox;
+
+  QPushButton *liveProfilingButton;
   QPushButton *analyzeButton;
   QPushButton *cancelButton;
 
@@ -66,13 +70,18 @@ private:
 
   MessageWidget *msg;
 
+  void startProfiler(bool liveMode);
+
 private slots:
   void analyzeButtonClick();
+  void liveProfilingButtonClick();
   void responseFileOpenButtonClick();
   void cancelButtonClick();
   void createTestSignalWavButtonClick();
   void profilerThreadFinished();
   void profilerProgressChanged(int progress);
+  void profilerWarningMessage(QString message);
+  void profilerErrorMessage(QString message);
 };
 
 #endif //PROFILER_DIALOG_H
@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2018-2020 Oleg Kapitonov
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * --------------------------------------------------------------------------
+ */
+
+
+#ifndef SAMPLESPAN_H
+#define SAMPLESPAN_H
+
+#include <QVector>
+
+// Non-owning view of a sequence of samples,
+// usually one channel of interleaved audio.
+// The viewed buffer must outlive the span.
+class SampleSpan
+{
+public:
+  SampleSpan() : ptr(nullptr), count(0), step(1) {}
+
+  SampleSpan(const float *data, int n_count, int stride = 1)
+    : ptr(data), count(n_count), step(stride) {}
+
+  SampleSpan(const QVector<float> &data)
+    : ptr(data.constData()), count(data.size()), step(1) {}
+
+  // View of one channel of interleaved buffer
+  static SampleSpan channel(const QVector<float> &interleaved,
+                            int channels, int channel)
+  {
+    return SampleSpan(interleaved.constData() + channel,
+                      (interleaved.size() - channel + channels - 1) / channels,
+                      channels);
+  }
+
+  float operator[](int i) const
+  {
+    return ptr[(qint64)i * step];
+  }
+
+  int size() const { return count; }
+  int stride() const { return step; }
+  bool isEmpty() const { return count == 0; }
+
+  // Sub-view, clipped to the span bounds
+  SampleSpan mid(int pos, int n_count = -1) const
+  {
+    pos = qBound(0, pos, count);
+
+    if ((n_count < 0) || (n_count > count - pos))
+    {
+      n_count = count - pos;
+    }
+
+    return SampleSpan(ptr + (qint64)pos * step, n_count, step);
+  }
+
+  void copyTo(float *dest) const
+  {
+    for (int i = 0; i < count; i++)
+    {
+      dest[i] = ptr[(qint64)i * step];
+    }
+  }
+
+  QVector<float> toVector() const
+  {
+    QVector<float> result(count);
+    copyTo(result.data());
+    return result;
+  }
+
+private:
+  const float *ptr;
+  int count;
+  int step;
+};
+
+#endif //SAMPLESPAN_H
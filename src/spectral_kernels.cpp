@@ -0,0 +1,763 @@
+/*
+ * Copyright (C) 2018-2020 Oleg Kapitonov
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * --------------------------------------------------------------------------
+ */
+
+#include <cmath>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SPECTRAL_KERNELS_AVX2
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define SPECTRAL_KERNELS_NEON
+#endif
+
+#include "spectral_kernels.h"
+
+// Scalar versions, used without SIMD support
+// and for the remaining tail of the buffers
+
+template <typename Complex>
+static void mul_scalar(const Complex a[], const Complex b[],
+                       Complex result[], int begin, int n_count)
+{
+  for (int i = begin; i < n_count; i++)
+  {
+    auto real = a[i].real * b[i].real - a[i].imagine * b[i].imagine;
+    auto imagine = a[i].real * b[i].imagine + a[i].imagine * b[i].real;
+
+    result[i].real = real;
+    result[i].imagine = imagine;
+  }
+}
+
+template <typename Complex>
+static void mul_conj_scalar(const Complex a[], const Complex b[],
+                            Complex result[], int begin, int n_count)
+{
+  for (int i = begin; i < n_count; i++)
+  {
+    auto real = a[i].real * b[i].real + a[i].imagine * b[i].imagine;
+    auto imagine = a[i].imagine * b[i].real - a[i].real * b[i].imagine;
+
+    result[i].real = real;
+    result[i].imagine = imagine;
+  }
+}
+
+template <typename Complex, typename Real>
+static void regularized_div_scalar(const Complex a[], const Complex b[],
+                                   Complex result[], Real epsilon,
+                                   int begin, int n_count)
+{
+  for (int i = begin; i < n_count; i++)
+  {
+    Real denominator = b[i].real * b[i].real + b[i].imagine * b[i].imagine + epsilon;
+
+    Real real = (a[i].real * b[i].real + a[i].imagine * b[i].imagine) / denominator;
+    Real imagine = (a[i].imagine * b[i].real - a[i].real * b[i].imagine) / denominator;
+
+    result[i].real = real;
+    result[i].imagine = imagine;
+  }
+}
+
+template <typename Complex, typename Real>
+static void regularized_div_profile_scalar(const Complex a[], const Complex b[],
+                                           Complex result[], const Real epsilon[],
+                                           int begin, int n_count)
+{
+  for (int i = begin; i < n_count; i++)
+  {
+    Real denominator = b[i].real * b[i].real + b[i].imagine * b[i].imagine + epsilon[i];
+
+    Real real = (a[i].real * b[i].real + a[i].imagine * b[i].imagine) / denominator;
+    Real imagine = (a[i].imagine * b[i].real - a[i].real * b[i].imagine) / denominator;
+
+    result[i].real = real;
+    result[i].imagine = imagine;
+  }
+}
+
+template <typename Complex, typename Real>
+static void magnitude_scalar(const Complex a[], Real result[],
+                             int begin, int n_count)
+{
+  for (int i = begin; i < n_count; i++)
+  {
+    result[i] = sqrt(a[i].real * a[i].real + a[i].imagine * a[i].imagine);
+  }
+}
+
+// SIMD versions process as many elements as fit
+// into whole vectors and return number of processed elements
+
+#ifdef SPECTRAL_KERNELS_AVX2
+
+static bool has_avx2()
+{
+  static const bool supported = __builtin_cpu_supports("avx2") &&
+    __builtin_cpu_supports("fma");
+
+  return supported;
+}
+
+// Two double complex numbers in one vector:
+// [re0 im0 re1 im1]
+
+__attribute__((target("avx2,fma")))
+static int mul_avx2(const s_fftw_complex a[], const s_fftw_complex b[],
+                    s_fftw_complex result[], int n_count)
+{
+  int i = 0;
+  for (; i + 2 <= n_count; i += 2)
+  {
+    __m256d va = _mm256_loadu_pd(&a[i].real);
+    __m256d vb = _mm256_loadu_pd(&b[i].real);
+
+    __m256d b_real = _mm256_movedup_pd(vb);
+    __m256d b_imagine = _mm256_permute_pd(vb, 0xF);
+    __m256d a_swapped = _mm256_permute_pd(va, 0x5);
+
+    _mm256_storeu_pd(&result[i].real, _mm256_fmaddsub_pd(va, b_real,
+      _mm256_mul_pd(a_swapped, b_imagine)));
+  }
+
+  return i;
+}
+
+__attribute__((target("avx2,fma")))
+static int mul_conj_avx2(const s_fftw_complex a[], const s_fftw_complex b[],
+                         s_fftw_complex result[], int n_count)
+{
+  int i = 0;
+  for (; i + 2 <= n_count; i += 2)
+  {
+    __m256d va = _mm256_loadu_pd(&a[i].real);
+    __m256d vb = _mm256_loadu_pd(&b[i].real);
+
+    __m256d b_real = _mm256_movedup_pd(vb);
+    __m256d b_imagine = _mm256_permute_pd(vb, 0xF);
+    __m256d a_swapped = _mm256_permute_pd(va, 0x5);
+
+    _mm256_storeu_pd(&result[i].real, _mm256_fmsubadd_pd(va, b_real,
+      _mm256_mul_pd(a_swapped, b_imagine)));
+  }
+
+  return i;
+}
+
+__attribute__((target("avx2,fma")))
+static int regularized_div_avx2(const s_fftw_complex a[], const s_fftw_complex b[],
+                                s_fftw_complex result[], double epsilon,
+                                int n_count)
+{
+  __m256d veps = _mm256_set1_pd(epsilon);
+
+  int i = 0;
+  for (; i + 2 <= n_count; i += 2)
+  {
+    __m256d va = _mm256_loadu_pd(&a[i].real);
+    __m256d vb = _mm256_loadu_pd(&b[i].real);
+
+    __m256d b_real = _mm256_movedup_pd(vb);
+    __m256d b_imagine = _mm256_permute_pd(vb, 0xF);
+    __m256d a_swapped = _mm256_permute_pd(va, 0x5);
+
+    // a * conj(b)
+    __m256d numerator = _mm256_fmsubadd_pd(va, b_real,
+      _mm256_mul_pd(a_swapped, b_imagine));
+
+    // |b|^2 + epsilon in both halves of each complex
+    __m256d b_squared = _mm256_mul_pd(vb, vb);
+    __m256d denominator = _mm256_add_pd(_mm256_add_pd(b_squared,
+      _mm256_permute_pd(b_squared, 0x5)), veps);
+
+    _mm256_storeu_pd(&result[i].real, _mm256_div_pd(numerator, denominator));
+  }
+
+  return i;
+}
+
+// Per-bin epsilon is duplicated into both halves
+// of each complex: [eps0 eps0 eps1 eps1]
+__attribute__((target("avx2,fma")))
+static int regularized_div_profile_avx2(const s_fftw_complex a[], const s_fftw_complex b[],
+                                        s_fftw_complex result[], const double epsilon[],
+                                        int n_count)
+{
+  int i = 0;
+  for (; i + 2 <= n_count; i += 2)
+  {
+    __m256d va = _mm256_loadu_pd(&a[i].real);
+    __m256d vb = _mm256_loadu_pd(&b[i].real);
+    __m256d veps = _mm256_permute4x64_pd(
+      _mm256_castpd128_pd256(_mm_loadu_pd(epsilon + i)), 0x50);
+
+    __m256d b_real = _mm256_movedup_pd(vb);
+    __m256d b_imagine = _mm256_permute_pd(vb, 0xF);
+    __m256d a_swapped = _mm256_permute_pd(va, 0x5);
+
+    __m256d numerator = _mm256_fmsubadd_pd(va, b_real,
+      _mm256_mul_pd(a_swapped, b_imagine));
+
+    __m256d b_squared = _mm256_mul_pd(vb, vb);
+    __m256d denominator = _mm256_add_pd(_mm256_add_pd(b_squared,
+      _mm256_permute_pd(b_squared, 0x5)), veps);
+
+    _mm256_storeu_pd(&result[i].real, _mm256_div_pd(numerator, denominator));
+  }
+
+  return i;
+}
+
+__attribute__((target("avx2,fma")))
+static int magnitude_avx2(const s_fftw_complex a[], double result[], int n_count)
+{
+  int i = 0;
+  for (; i + 4 <= n_count; i += 4)
+  {
+    __m256d v0 = _mm256_loadu_pd(&a[i].real);
+    __m256d v1 = _mm256_loadu_pd(&a[i + 2].real);
+
+    // hadd gives [|a0|^2 |a2|^2 |a1|^2 |a3|^2]
+    __m256d squared = _mm256_hadd_pd(_mm256_mul_pd(v0, v0),
+      _mm256_mul_pd(v1, v1));
+    squared = _mm256_permute4x64_pd(squared, 0xD8);
+
+    _mm256_storeu_pd(result + i, _mm256_sqrt_pd(squared));
+  }
+
+  return i;
+}
+
+// Four float complex numbers in one vector
+
+__attribute__((target("avx2,fma")))
+static int mul_avx2(const s_fftwf_complex a[], const s_fftwf_complex b[],
+                    s_fftwf_complex result[], int n_count)
+{
+  int i = 0;
+  for (; i + 4 <= n_count; i += 4)
+  {
+    __m256 va = _mm256_loadu_ps(&a[i].real);
+    __m256 vb = _mm256_loadu_ps(&b[i].real);
+
+    __m256 b_real = _mm256_moveldup_ps(vb);
+    __m256 b_imagine = _mm256_movehdup_ps(vb);
+    __m256 a_swapped = _mm256_permute_ps(va, 0xB1);
+
+    _mm256_storeu_ps(&result[i].real, _mm256_fmaddsub_ps(va, b_real,
+      _mm256_mul_ps(a_swapped, b_imagine)));
+  }
+
+  return i;
+}
+
+__attribute__((target("avx2,fma")))
+static int mul_conj_avx2(const s_fftwf_complex a[], const s_fftwf_complex b[],
+                         s_fftwf_complex result[], int n_count)
+{
+  int i = 0;
+  for (; i + 4 <= n_count; i += 4)
+  {
+    __m256 va = _mm256_loadu_ps(&a[i].real);
+    __m256 vb = _mm256_loadu_ps(&b[i].real);
+
+    __m256 b_real = _mm256_moveldup_ps(vb);
+    __m256 b_imagine = _mm256_movehdup_ps(vb);
+    __m256 a_swapped = _mm256_permute_ps(va, 0xB1);
+
+    _mm256_storeu_ps(&result[i].real, _mm256_fmsubadd_ps(va, b_real,
+      _mm256_mul_ps(a_swapped, b_imagine)));
+  }
+
+  return i;
+}
+
+__attribute__((target("avx2,fma")))
+static int regularized_div_avx2(const s_fftwf_complex a[], const s_fftwf_complex b[],
+                                s_fftwf_complex result[], float epsilon,
+                                int n_count)
+{
+  __m256 veps = _mm256_set1_ps(epsilon);
+
+  int i = 0;
+  for (; i + 4 <= n_count; i += 4)
+  {
+    __m256 va = _mm256_loadu_ps(&a[i].real);
+    __m256 vb = _mm256_loadu_ps(&b[i].real);
+
+    __m256 b_real = _mm256_moveldup_ps(vb);
+    __m256 b_imagine = _mm256_movehdup_ps(vb);
+    __m256 a_swapped = _mm256_permute_ps(va, 0xB1);
+
+    __m256 numerator = _mm256_fmsubadd_ps(va, b_real,
+      _mm256_mul_ps(a_swapped, b_imagine));
+
+    __m256 b_squared = _mm256_mul_ps(vb, vb);
+    __m256 denominator = _mm256_add_ps(_mm256_add_ps(b_squared,
+      _mm256_permute_ps(b_squared, 0xB1)), veps);
+
+    _mm256_storeu_ps(&result[i].real, _mm256_div_ps(numerator, denominator));
+  }
+
+  return i;
+}
+
+__attribute__((target("avx2,fma")))
+static int regularized_div_profile_avx2(const s_fftwf_complex a[], const s_fftwf_complex b[],
+                                        s_fftwf_complex result[], const float epsilon[],
+                                        int n_count)
+{
+  __m256i duplicate = _mm256_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3);
+
+  int i = 0;
+  for (; i + 4 <= n_count; i += 4)
+  {
+    __m256 va = _mm256_loadu_ps(&a[i].real);
+    __m256 vb = _mm256_loadu_ps(&b[i].real);
+    __m256 veps = _mm256_permutevar8x32_ps(
+      _mm256_castps128_ps256(_mm_loadu_ps(epsilon + i)), duplicate);
+
+    __m256 b_real = _mm256_moveldup_ps(vb);
+    __m256 b_imagine = _mm256_movehdup_ps(vb);
+    __m256 a_swapped = _mm256_permute_ps(va, 0xB1);
+
+    __m256 numerator = _mm256_fmsubadd_ps(va, b_real,
+      _mm256_mul_ps(a_swapped, b_imagine));
+
+    __m256 b_squared = _mm256_mul_ps(vb, vb);
+    __m256 denominator = _mm256_add_ps(_mm256_add_ps(b_squared,
+      _mm256_permute_ps(b_squared, 0xB1)), veps);
+
+    _mm256_storeu_ps(&result[i].real, _mm256_div_ps(numerator, denominator));
+  }
+
+  return i;
+}
+
+__attribute__((target("avx2,fma")))
+static int magnitude_avx2(const s_fftwf_complex a[], float result[], int n_count)
+{
+  int i = 0;
+  for (; i + 8 <= n_count; i += 8)
+  {
+    __m256 v0 = _mm256_loadu_ps(&a[i].real);
+    __m256 v1 = _mm256_loadu_ps(&a[i + 4].real);
+
+    // hadd gives pairs in order [0 1 4 5 2 3 6 7]
+    __m256 squared = _mm256_hadd_ps(_mm256_mul_ps(v0, v0),
+      _mm256_mul_ps(v1, v1));
+    squared = _mm256_castpd_ps(_mm256_permute4x64_pd(
+      _mm256_castps_pd(squared), 0xD8));
+
+    _mm256_storeu_ps(result + i, _mm256_sqrt_ps(squared));
+  }
+
+  return i;
+}
+
+#endif //SPECTRAL_KERNELS_AVX2
+
+#ifdef SPECTRAL_KERNELS_NEON
+
+// vld2 loads complex numbers deinterleaved:
+// val[0] - real parts, val[1] - imaginary parts
+
+static int mul_neon(const s_fftw_complex a[], const s_fftw_complex b[],
+                    s_fftw_complex result[], int n_count)
+{
+  int i = 0;
+  for (; i + 2 <= n_count; i += 2)
+  {
+    float64x2x2_t va = vld2q_f64(&a[i].real);
+    float64x2x2_t vb = vld2q_f64(&b[i].real);
+    float64x2x2_t vr;
+
+    vr.val[0] = vfmsq_f64(vmulq_f64(va.val[0], vb.val[0]), va.val[1], vb.val[1]);
+    vr.val[1] = vfmaq_f64(vmulq_f64(va.val[0], vb.val[1]), va.val[1], vb.val[0]);
+
+    vst2q_f64(&result[i].real, vr);
+  }
+
+  return i;
+}
+
+static int mul_conj_neon(const s_fftw_complex a[], const s_fftw_complex b[],
+                         s_fftw_complex result[], int n_count)
+{
+  int i = 0;
+  for (; i + 2 <= n_count; i += 2)
+  {
+    float64x2x2_t va = vld2q_f64(&a[i].real);
+    float64x2x2_t vb = vld2q_f64(&b[i].real);
+    float64x2x2_t vr;
+
+    vr.val[0] = vfmaq_f64(vmulq_f64(va.val[0], vb.val[0]), va.val[1], vb.val[1]);
+    vr.val[1] = vfmsq_f64(vmulq_f64(va.val[1], vb.val[0]), va.val[0], vb.val[1]);
+
+    vst2q_f64(&result[i].real, vr);
+  }
+
+  return i;
+}
+
+static int regularized_div_neon(const s_fftw_complex a[], const s_fftw_complex b[],
+                                s_fftw_complex result[], double epsilon,
+                                int n_count)
+{
+  float64x2_t veps = vdupq_n_f64(epsilon);
+
+  int i = 0;
+  for (; i + 2 <= n_count; i += 2)
+  {
+    float64x2x2_t va = vld2q_f64(&a[i].real);
+    float64x2x2_t vb = vld2q_f64(&b[i].real);
+    float64x2x2_t vr;
+
+    float64x2_t denominator = vfmaq_f64(vfmaq_f64(veps, vb.val[0], vb.val[0]),
+      vb.val[1], vb.val[1]);
+
+    vr.val[0] = vfmaq_f64(vmulq_f64(va.val[0], vb.val[0]), va.val[1], vb.val[1]);
+    vr.val[1] = vfmsq_f64(vmulq_f64(va.val[1], vb.val[0]), va.val[0], vb.val[1]);
+
+    vr.val[0] = vdivq_f64(vr.val[0], denominator);
+    vr.val[1] = vdivq_f64(vr.val[1], denominator);
+
+    vst2q_f64(&result[i].real, vr);
+  }
+
+  return i;
+}
+
+static int regularized_div_profile_neon(const s_fftw_complex a[], const s_fftw_complex b[],
+                                        s_fftw_complex result[], const double epsilon[],
+                                        int n_count)
+{
+  int i = 0;
+  for (; i + 2 <= n_count; i += 2)
+  {
+    float64x2x2_t va = vld2q_f64(&a[i].real);
+    float64x2x2_t vb = vld2q_f64(&b[i].real);
+    float64x2x2_t vr;
+
+    float64x2_t denominator = vfmaq_f64(vfmaq_f64(vld1q_f64(epsilon + i),
+      vb.val[0], vb.val[0]), vb.val[1], vb.val[1]);
+
+    vr.val[0] = vfmaq_f64(vmulq_f64(va.val[0], vb.val[0]), va.val[1], vb.val[1]);
+    vr.val[1] = vfmsq_f64(vmulq_f64(va.val[1], vb.val[0]), va.val[0], vb.val[1]);
+
+    vr.val[0] = vdivq_f64(vr.val[0], denominator);
+    vr.val[1] = vdivq_f64(vr.val[1], denominator);
+
+    vst2q_f64(&result[i].real, vr);
+  }
+
+  return i;
+}
+
+static int magnitude_neon(const s_fftw_complex a[], double result[], int n_count)
+{
+  int i = 0;
+  for (; i + 2 <= n_count; i += 2)
+  {
+    float64x2x2_t va = vld2q_f64(&a[i].real);
+
+    vst1q_f64(result + i, vsqrtq_f64(vfmaq_f64(vmulq_f64(va.val[0], va.val[0]),
+      va.val[1], va.val[1])));
+  }
+
+  return i;
+}
+
+static int mul_neon(const s_fftwf_complex a[], const s_fftwf_complex b[],
+                    s_fftwf_complex result[], int n_count)
+{
+  int i = 0;
+  for (; i + 4 <= n_count; i += 4)
+  {
+    float32x4x2_t va = vld2q_f32(&a[i].real);
+    float32x4x2_t vb = vld2q_f32(&b[i].real);
+    float32x4x2_t vr;
+
+    vr.val[0] = vfmsq_f32(vmulq_f32(va.val[0], vb.val[0]), va.val[1], vb.val[1]);
+    vr.val[1] = vfmaq_f32(vmulq_f32(va.val[0], vb.val[1]), va.val[1], vb.val[0]);
+
+    vst2q_f32(&result[i].real, vr);
+  }
+
+  return i;
+}
+
+static int mul_conj_neon(const s_fftwf_complex a[], const s_fftwf_complex b[],
+                         s_fftwf_complex result[], int n_count)
+{
+  int i = 0;
+  for (; i + 4 <= n_count; i += 4)
+  {
+    float32x4x2_t va = vld2q_f32(&a[i].real);
+    float32x4x2_t vb = vld2q_f32(&b[i].real);
+    float32x4x2_t vr;
+
+    vr.val[0] = vfmaq_f32(vmulq_f32(va.val[0], vb.val[0]), va.val[1], vb.val[1]);
+    vr.val[1] = vfmsq_f32(vmulq_f32(va.val[1], vb.val[0]), va.val[0], vb.val[1]);
+
+    vst2q_f32(&result[i].real, vr);
+  }
+
+  return i;
+}
+
+static int regularized_div_neon(const s_fftwf_complex a[], const s_fftwf_complex b[],
+                                s_fftwf_complex result[], float epsilon,
+                                int n_count)
+{
+  float32x4_t veps = vdupq_n_f32(epsilon);
+
+  int i = 0;
+  for (; i + 4 <= n_count; i += 4)
+  {
+    float32x4x2_t va = vld2q_f32(&a[i].real);
+    float32x4x2_t vb = vld2q_f32(&b[i].real);
+    float32x4x2_t vr;
+
+    float32x4_t denominator = vfmaq_f32(vfmaq_f32(veps, vb.val[0], vb.val[0]),
+      vb.val[1], vb.val[1]);
+
+    vr.val[0] = vfmaq_f32(vmulq_f32(va.val[0], vb.val[0]), va.val[1], vb.val[1]);
+    vr.val[1] = vfmsq_f32(vmulq_f32(va.val[1], vb.val[0]), va.val[0], vb.val[1]);
+
+    vr.val[0] = vdivq_f32(vr.val[0], denominator);
+    vr.val[1] = vdivq_f32(vr.val[1], denominator);
+
+    vst2q_f32(&result[i].real, vr);
+  }
+
+  return i;
+}
+
+static int regularized_div_profile_neon(const s_fftwf_complex a[], const s_fftwf_complex b[],
+                                        s_fftwf_complex result[], const float epsilon[],
+                                        int n_count)
+{
+  int i = 0;
+  for (; i + 4 <= n_count; i += 4)
+  {
+    float32x4x2_t va = vld2q_f32(&a[i].real);
+    float32x4x2_t vb = vld2q_f32(&b[i].real);
+    float32x4x2_t vr;
+
+    float32x4_t denominator = vfmaq_f32(vfmaq_f32(vld1q_f32(epsilon + i),
+      vb.val[0], vb.val[0]), vb.val[1], vb.val[1]);
+
+    vr.val[0] = vfmaq_f32(vmulq_f32(va.val[0], vb.val[0]), va.val[1], vb.val[1]);
+    vr.val[1] = vfmsq_f32(vmulq_f32(va.val[1], vb.val[0]), va.val[0], vb.val[1]);
+
+    vr.val[0] = vdivq_f32(vr.val[0], denominator);
+    vr.val[1] = vdivq_f32(vr.val[1], denominator);
+
+    vst2q_f32(&result[i].real, vr);
+  }
+
+  return i;
+}
+
+static int magnitude_neon(const s_fftwf_complex a[], float result[], int n_count)
+{
+  int i = 0;
+  for (; i + 4 <= n_count; i += 4)
+  {
+    float32x4x2_t va = vld2q_f32(&a[i].real);
+
+    vst1q_f32(result + i, vsqrtq_f32(vfmaq_f32(vmulq_f32(va.val[0], va.val[0]),
+      va.val[1], va.val[1])));
+  }
+
+  return i;
+}
+
+#endif //SPECTRAL_KERNELS_NEON
+
+// Public functions dispatch to the best available
+// implementation, scalar code finishes the tail
+
+template <typename Complex>
+static void spectrum_mul_dispatch(const Complex a[], const Complex b[],
+                                  Complex result[], int n_count)
+{
+  int i = 0;
+
+#if defined(SPECTRAL_KERNELS_AVX2)
+  if (has_avx2())
+  {
+    i = mul_avx2(a, b, result, n_count);
+  }
+#elif defined(SPECTRAL_KERNELS_NEON)
+  i = mul_neon(a, b, result, n_count);
+#endif
+
+  mul_scalar(a, b, result, i, n_count);
+}
+
+template <typename Complex>
+static void spectrum_mul_conj_dispatch(const Complex a[], const Complex b[],
+                                       Complex result[], int n_count)
+{
+  int i = 0;
+
+#if defined(SPECTRAL_KERNELS_AVX2)
+  if (has_avx2())
+  {
+    i = mul_conj_avx2(a, b, result, n_count);
+  }
+#elif defined(SPECTRAL_KERNELS_NEON)
+  i = mul_conj_neon(a, b, result, n_count);
+#endif
+
+  mul_conj_scalar(a, b, result, i, n_count);
+}
+
+template <typename Complex, typename Real>
+static void spectrum_regularized_div_dispatch(const Complex a[], const Complex b[],
+                                              Complex result[], Real epsilon,
+                                              int n_count)
+{
+  int i = 0;
+
+#if defined(SPECTRAL_KERNELS_AVX2)
+  if (has_avx2())
+  {
+    i = regularized_div_avx2(a, b, result, epsilon, n_count);
+  }
+#elif defined(SPECTRAL_KERNELS_NEON)
+  i = regularized_div_neon(a, b, result, epsilon, n_count);
+#endif
+
+  regularized_div_scalar(a, b, result, epsilon, i, n_count);
+}
+
+template <typename Complex, typename Real>
+static void spectrum_regularized_div_profile_dispatch(const Complex a[], const Complex b[],
+                                                      Complex result[], const Real epsilon[],
+                                                      int n_count)
+{
+  int i = 0;
+
+#if defined(SPECTRAL_KERNELS_AVX2)
+  if (has_avx2())
+  {
+    i = regularized_div_profile_avx2(a, b, result, epsilon, n_count);
+  }
+#elif defined(SPECTRAL_KERNELS_NEON)
+  i = regularized_div_profile_neon(a, b, result, epsilon, n_count);
+#endif
+
+  regularized_div_profile_scalar(a, b, result, epsilon, i, n_count);
+}
+
+template <typename Complex, typename Real>
+static void spectrum_magnitude_dispatch(const Complex a[], Real result[], int n_count)
+{
+  int i = 0;
+
+#if defined(SPECTRAL_KERNELS_AVX2)
+  if (has_avx2())
+  {
+    i = magnitude_avx2(a, result, n_count);
+  }
+#elif defined(SPECTRAL_KERNELS_NEON)
+  i = magnitude_neon(a, result, n_count);
+#endif
+
+  magnitude_scalar(a, result, i, n_count);
+}
+
+void spectrum_mul(const s_fftw_complex a[], const s_fftw_complex b[],
+                  s_fftw_complex result[], int n_count)
+{
+  spectrum_mul_dispatch(a, b, result, n_count);
+}
+
+void spectrum_mul(const s_fftwf_complex a[], const s_fftwf_complex b[],
+                  s_fftwf_complex result[], int n_count)
+{
+  spectrum_mul_dispatch(a, b, result, n_count);
+}
+
+void spectrum_mul_conj(const s_fftw_complex a[], const s_fftw_complex b[],
+                       s_fftw_complex result[], int n_count)
+{
+  spectrum_mul_conj_dispatch(a, b, result, n_count);
+}
+
+void spectrum_mul_conj(const s_fftwf_complex a[], const s_fftwf_complex b[],
+                       s_fftwf_complex result[], int n_count)
+{
+  spectrum_mul_conj_dispatch(a, b, result, n_count);
+}
+
+void spectrum_div(const s_fftw_complex a[], const s_fftw_complex b[],
+                  s_fftw_complex result[], int n_count)
+{
+  spectrum_regularized_div_dispatch(a, b, result, 0.0, n_count);
+}
+
+void spectrum_div(const s_fftwf_complex a[], const s_fftwf_complex b[],
+                  s_fftwf_complex result[], int n_count)
+{
+  spectrum_regularized_div_dispatch(a, b, result, 0.0f, n_count);
+}
+
+void spectrum_regularized_div(const s_fftw_complex a[], const s_fftw_complex b[],
+                              s_fftw_complex result[], double epsilon,
+                              int n_count)
+{
+  spectrum_regularized_div_dispatch(a, b, result, epsilon, n_count);
+}
+
+void spectrum_regularized_div(const s_fftwf_complex a[], const s_fftwf_complex b[],
+                              s_fftwf_complex result[], float epsilon,
+                              int n_count)
+{
+  spectrum_regularized_div_dispatch(a, b, result, epsilon, n_count);
+}
+
+void spectrum_regularized_div(const s_fftw_complex a[], const s_fftw_complex b[],
+                              s_fftw_complex result[], const double epsilon[],
+                              int n_count)
+{
+  spectrum_regularized_div_profile_dispatch(a, b, result, epsilon, n_count);
+}
+
+void spectrum_regularized_div(const s_fftwf_complex a[], const s_fftwf_complex b[],
+                              s_fftwf_complex result[], const float epsilon[],
+                              int n_count)
+{
+  spectrum_regularized_div_profile_dispatch(a, b, result, epsilon, n_count);
+}
+
+void spectrum_magnitude(const s_fftw_complex a[], double result[], int n_count)
+{
+  spectrum_magnitude_dispatch(a, result, n_count);
+}
+
+void spectrum_magnitude(const s_fftwf_complex a[], float result[], int n_count)
+{
+  spectrum_magnitude_dispatch(a, result, n_count);
+}
@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2018-2020 Oleg Kapitonov
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * --------------------------------------------------------------------------
+ */
+
+#ifndef SPECTRALKERNELS_H
+#define SPECTRALKERNELS_H
+
+#include "math_functions.h"
+
+// Element-wise operations on interleaved complex
+// spectra (FFTW output buffers).
+// Vectorized with AVX2/FMA (selected at runtime) or NEON,
+// result may point to one of the input buffers.
+
+// result = a * b
+void spectrum_mul(const s_fftw_complex a[], const s_fftw_complex b[],
+                  s_fftw_complex result[], int n_count);
+void spectrum_mul(const s_fftwf_complex a[], const s_fftwf_complex b[],
+                  s_fftwf_complex result[], int n_count);
+
+// result = a * conj(b), cross-correlation spectrum
+void spectrum_mul_conj(const s_fftw_complex a[], const s_fftw_complex b[],
+                       s_fftw_complex result[], int n_count);
+void spectrum_mul_conj(const s_fftwf_complex a[], const s_fftwf_complex b[],
+                       s_fftwf_complex result[], int n_count);
+
+// result = a / b
+void spectrum_div(const s_fftw_complex a[], const s_fftw_complex b[],
+                  s_fftw_complex result[], int n_count);
+void spectrum_div(const s_fftwf_complex a[], const s_fftwf_complex b[],
+                  s_fftwf_complex result[], int n_count);
+
+// result = a * conj(b) / (|b|^2 + epsilon)
+void spectrum_regularized_div(const s_fftw_complex a[], const s_fftw_complex b[],
+                              s_fftw_complex result[], double epsilon,
+                              int n_count);
+void spectrum_regularized_div(const s_fftwf_complex a[], const s_fftwf_complex b[],
+                              s_fftwf_complex result[], float epsilon,
+                              int n_count);
+
+// result = a * conj(b) / (|b|^2 + epsilon[i]),
+// frequency-dependent regularization
+void spectrum_regularized_div(const s_fftw_complex a[], const s_fftw_complex b[],
+                              s_fftw_complex result[], const double epsilon[],
+                              int n_count);
+void spectrum_regularized_div(const s_fftwf_complex a[], const s_fftwf_complex b[],
+                              s_fftwf_complex result[], const float epsilon[],
+                              int n_count);
+
+// result = |a|
+void spectrum_magnitude(const s_fftw_complex a[], double result[], int n_count);
+void spectrum_magnitude(const s_fftwf_complex a[], float result[], int n_count);
+
+#endif //SPECTRALKERNELS_H
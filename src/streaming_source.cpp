@@ -0,0 +1,513 @@
+/*
+ * Copyright (C) 2018-2020 Oleg Kapitonov
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * --------------------------------------------------------------------------
+ */
+
+#include <QMutexLocker>
+
+#include <cmath>
+#include <cstring>
+
+#include "streaming_source.h"
+
+StreamingSource::StreamingSource(int channelsCount, int samplingRate)
+{
+  channels = channelsCount;
+  this->samplingRate = samplingRate;
+
+  // Frame size is a power of 2 and so is the ringbuffer size,
+  // frames never wrap around the end of the ringbuffer
+  frameSize = channels * sizeof(float);
+  ringbuffer = jack_ringbuffer_create(frameSize * samplingRate *
+                                      STREAMING_RINGBUFFER_SEC);
+
+  requestedFile = nullptr;
+  requestedFrame = 0;
+  dataRequested = false;
+  requestsCount = 0;
+
+  flushRequest = 0;
+  flushDone = 0;
+  flushPosition = 0;
+
+  length = 0;
+  position = 0;
+  lateFrames = 0;
+
+  sndFile = nullptr;
+  resampling = false;
+  ratio = 1.0;
+  pendingZeros = 0;
+
+  inMemory = false;
+  dataPos = 0;
+
+  sourceBuffer.resize(STREAMING_CHUNK_FRAMES * channels);
+}
+
+StreamingSource::~StreamingSource()
+{
+  requestInterruption();
+  wait();
+
+  if (sndFile != nullptr)
+  {
+    sf_close(sndFile);
+  }
+
+  if (requestedFile != nullptr)
+  {
+    sf_close(requestedFile);
+  }
+
+  jack_ringbuffer_free(ringbuffer);
+}
+
+bool StreamingSource::open(QString filename)
+{
+  SF_INFO info;
+  info.format = 0;
+
+  SNDFILE *file = sf_open(filename.toUtf8().constData(), SFM_READ, &info);
+  if (file == NULL)
+  {
+    return false;
+  }
+
+  QMutexLocker locker(&requestMutex);
+
+  if (requestedFile != nullptr)
+  {
+    sf_close(requestedFile);
+  }
+
+  requestedFile = file;
+  requestedInfo = info;
+  requestedFrame = 0;
+
+  dataRequested = false;
+  requestedDataL.clear();
+  requestedDataR.clear();
+
+  length = info.frames * (double)samplingRate / info.samplerate;
+  requestsCount++;
+
+  return true;
+}
+
+void StreamingSource::openData(QVector<float> left, QVector<float> right)
+{
+  QMutexLocker locker(&requestMutex);
+
+  if (requestedFile != nullptr)
+  {
+    sf_close(requestedFile);
+    requestedFile = nullptr;
+  }
+
+  dataRequested = true;
+  requestedDataL = left;
+  requestedDataR = (right.size() == left.size()) ? right : left;
+  requestedFrame = 0;
+
+  length = left.size();
+  requestsCount++;
+}
+
+void StreamingSource::seek(qint64 frame)
+{
+  QMutexLocker locker(&requestMutex);
+
+  requestedFrame = frame;
+  requestsCount++;
+}
+
+bool StreamingSource::isOpen()
+{
+  return length > 0;
+}
+
+qint64 StreamingSource::getLength()
+{
+  return length;
+}
+
+// File is looped, position wraps around its length
+qint64 StreamingSource::getPosition()
+{
+  qint64 sourceLength = length;
+
+  if (sourceLength == 0)
+  {
+    return 0;
+  }
+
+  return position % sourceLength;
+}
+
+void StreamingSource::flush()
+{
+  int request = flushRequest;
+
+  if (request != flushDone)
+  {
+    jack_ringbuffer_read_advance(ringbuffer, jack_ringbuffer_read_space(ringbuffer));
+
+    position = flushPosition.load();
+    lateFrames = 0;
+    flushDone = request;
+  }
+}
+
+void StreamingSource::dropLateFrames()
+{
+  if (lateFrames > 0)
+  {
+    int available = jack_ringbuffer_read_space(ringbuffer) / frameSize;
+    int n_drop = qMin(available, lateFrames);
+
+    jack_ringbuffer_read_advance(ringbuffer, n_drop * frameSize);
+    lateFrames -= n_drop;
+  }
+}
+
+int StreamingSource::read(float *left, float *right, int n_count)
+{
+  dropLateFrames();
+
+  jack_ringbuffer_data_t vector[2];
+  jack_ringbuffer_get_read_vector(ringbuffer, vector);
+
+  int available = (vector[0].len + vector[1].len) / frameSize;
+  int n_read = qMin(available, n_count);
+
+  int i = 0;
+  for (int part = 0; part < 2; part++)
+  {
+    const float *data = (const float *)vector[part].buf;
+    int partFrames = qMin((int)(vector[part].len / frameSize), n_read - i);
+
+    if (channels == 1)
+    {
+      memcpy(left + i, data, partFrames * sizeof(float));
+    }
+    else
+    {
+      for (int j = 0; j < partFrames; j++)
+      {
+        left[i + j] = data[2 * j];
+        right[i + j] = data[2 * j + 1];
+      }
+    }
+
+    i += partFrames;
+  }
+
+  jack_ringbuffer_read_advance(ringbuffer, n_read * frameSize);
+
+  // Underrun, disk thread did not keep up
+  if (n_read < n_count)
+  {
+    memset(left + n_read, 0, (n_count - n_read) * sizeof(float));
+
+    if (channels > 1)
+    {
+      memset(right + n_read, 0, (n_count - n_read) * sizeof(float));
+    }
+  }
+
+  // Position always advances with playback,
+  // frames that were late are dropped later
+  position += n_count;
+  lateFrames += n_count - n_read;
+
+  return n_read;
+}
+
+int StreamingSource::getReadSpace()
+{
+  int available = jack_ringbuffer_read_space(ringbuffer) / frameSize;
+
+  return qMax(available - lateFrames, 0);
+}
+
+void StreamingSource::skip(int n_count)
+{
+  dropLateFrames();
+
+  int available = jack_ringbuffer_read_space(ringbuffer) / frameSize;
+  int n_skip = qMin(available, n_count);
+
+  jack_ringbuffer_read_advance(ringbuffer, n_skip * frameSize);
+
+  position += n_count;
+  lateFrames += n_count - n_skip;
+}
+
+void StreamingSource::run()
+{
+  int handledRequests = 0;
+
+  while (!isInterruptionRequested())
+  {
+    if (requestsCount != handledRequests)
+    {
+      QMutexLocker locker(&requestMutex);
+
+      handledRequests = requestsCount;
+
+      if (requestedFile != nullptr)
+      {
+        if (sndFile != nullptr)
+        {
+          sf_close(sndFile);
+        }
+
+        sndFile = requestedFile;
+        sfinfo = requestedInfo;
+        requestedFile = nullptr;
+
+        resampling = (sfinfo.samplerate != samplingRate);
+        ratio = samplingRate / (double)sfinfo.samplerate;
+
+        if (resampling)
+        {
+          resampler.setup(sfinfo.samplerate, samplingRate, channels, 48);
+          resampledBuffer.resize((ceil(STREAMING_CHUNK_FRAMES * ratio) + 4) * channels);
+        }
+
+        decodeBuffer.resize(STREAMING_CHUNK_FRAMES * sfinfo.channels);
+
+        inMemory = false;
+        dataL.clear();
+        dataR.clear();
+      }
+      else if (dataRequested)
+      {
+        if (sndFile != nullptr)
+        {
+          sf_close(sndFile);
+          sndFile = nullptr;
+        }
+
+        dataL = requestedDataL;
+        dataR = requestedDataR;
+        requestedDataL.clear();
+        requestedDataR.clear();
+        dataRequested = false;
+
+        inMemory = true;
+        resampling = false;
+        ratio = 1.0;
+      }
+
+      startStream(requestedFrame);
+
+      // Stop writing until the process callback
+      // discards data of the previous position
+      flushPosition = requestedFrame;
+      flushRequest++;
+    }
+
+    if (((sndFile != nullptr) || inMemory) && (flushDone == flushRequest))
+    {
+      while (decodeChunk())
+      {
+      }
+    }
+
+    msleep(STREAMING_THREAD_INTERVAL_MS);
+  }
+}
+
+void StreamingSource::startStream(qint64 frame)
+{
+  if (inMemory)
+  {
+    dataPos = ((frame >= 0) && (frame < dataL.size())) ? frame : 0;
+    return;
+  }
+
+  sf_count_t sourceFrame = frame / ratio;
+
+  if ((sourceFrame < 0) || (sourceFrame >= sfinfo.frames))
+  {
+    sourceFrame = 0;
+  }
+
+  sf_seek(sndFile, sourceFrame, SEEK_SET);
+
+  // Leading zeros align resampler output
+  // with the source, the same as in resample_vector()
+  if (resampling)
+  {
+    resampler.reset();
+    pendingZeros = resampler.inpsize() / 2 - 1;
+  }
+}
+
+// Reads n_count downmixed frames, file is looped
+int StreamingSource::readSource(float *out, int n_count)
+{
+  if (inMemory)
+  {
+    readData(out, n_count);
+    return n_count;
+  }
+
+  int pos = 0;
+
+  for (; (pendingZeros > 0) && (pos < n_count); pendingZeros--, pos++)
+  {
+    for (int c = 0; c < channels; c++)
+    {
+      out[pos * channels + c] = 0.0;
+    }
+  }
+
+  bool rewound = false;
+
+  while (pos < n_count)
+  {
+    sf_count_t got = sf_readf_float(sndFile, decodeBuffer.data(), n_count - pos);
+
+    if (got <= 0)
+    {
+      // Empty or unreadable file plays silence
+      if (rewound)
+      {
+        memset(out + pos * channels, 0, (n_count - pos) * frameSize);
+        break;
+      }
+
+      sf_seek(sndFile, 0, SEEK_SET);
+      rewound = true;
+      continue;
+    }
+
+    rewound = false;
+
+    for (int i = 0; i < got; i++)
+    {
+      const float *frame = decodeBuffer.constData() + i * sfinfo.channels;
+      float *outFrame = out + (pos + i) * channels;
+
+      if (channels == 1)
+      {
+        float sumFrame = 0.0;
+        for (int j = 0; j < sfinfo.channels; j++)
+        {
+          sumFrame += frame[j];
+        }
+
+        outFrame[0] = sumFrame / sfinfo.channels;
+      }
+      else if (sfinfo.channels > 1)
+      {
+        float sumFrame = 0.0;
+        for (int j = 1; j < sfinfo.channels; j++)
+        {
+          sumFrame += frame[j];
+        }
+
+        outFrame[0] = frame[0];
+        outFrame[1] = sumFrame / (sfinfo.channels - 1);
+      }
+      else
+      {
+        outFrame[0] = frame[0];
+        outFrame[1] = frame[0];
+      }
+    }
+
+    pos += got;
+  }
+
+  return n_count;
+}
+
+// Reads n_count frames of the memory source, data is looped
+void StreamingSource::readData(float *out, int n_count)
+{
+  if (dataL.size() == 0)
+  {
+    memset(out, 0, n_count * frameSize);
+    return;
+  }
+
+  for (int i = 0; i < n_count; i++)
+  {
+    out[i * channels] = dataL[dataPos];
+
+    if (channels > 1)
+    {
+      out[i * channels + 1] = dataR[dataPos];
+    }
+
+    dataPos++;
+
+    if (dataPos >= dataL.size())
+    {
+      dataPos = 0;
+    }
+  }
+}
+
+// Decodes one chunk if its output fits into the ringbuffer
+bool StreamingSource::decodeChunk()
+{
+  int maxOutput = STREAMING_CHUNK_FRAMES;
+
+  if (resampling)
+  {
+    maxOutput = resampledBuffer.size() / channels;
+  }
+
+  if (jack_ringbuffer_write_space(ringbuffer) < (size_t)(maxOutput * frameSize))
+  {
+    return false;
+  }
+
+  readSource(sourceBuffer.data(), STREAMING_CHUNK_FRAMES);
+
+  if (!resampling)
+  {
+    jack_ringbuffer_write(ringbuffer, (const char *)sourceBuffer.constData(),
+                          STREAMING_CHUNK_FRAMES * frameSize);
+    return true;
+  }
+
+  resampler.inp_count = STREAMING_CHUNK_FRAMES;
+  resampler.inp_data = sourceBuffer.data();
+  resampler.out_count = maxOutput;
+  resampler.out_data = resampledBuffer.data();
+
+  resampler.process();
+
+  int produced = maxOutput - resampler.out_count;
+
+  // The same gain as in resample_vector()
+  for (int i = 0; i < produced * channels; i++)
+  {
+    resampledBuffer[i] /= ratio;
+  }
+
+  jack_ringbuffer_write(ringbuffer, (const char *)resampledBuffer.constData(),
+                        produced * frameSize);
+
+  return true;
+}
@@ -0,0 +1,134 @@
+/*
+ * Copyright (C) 2018-2020 Oleg Kapitonov
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * --------------------------------------------------------------------------
+ */
+
+#ifndef STREAMINGSOURCE_H
+#define STREAMINGSOURCE_H
+
+#include <QThread>
+#include <QVector>
+#include <QString>
+#include <QMutex>
+
+#include <sndfile.h>
+#include <jack/ringbuffer.h>
+#include <zita-resampler/resampler.h>
+
+#include <atomic>
+
+// Decoded audio kept ahead of the playback position
+#define STREAMING_RINGBUFFER_SEC 4
+// Source frames decoded and resampled in one step
+#define STREAMING_CHUNK_FRAMES 4096
+#define STREAMING_THREAD_INTERVAL_MS 10
+
+// Plays a looped sound file from disk or data from memory.
+// Disk thread decodes, downmixes and resamples the file
+// chunk by chunk into a ringbuffer read by the process callback,
+// so memory use does not depend on the file length.
+// Open and seek are asynchronous: the disk thread stops writing
+// and the process callback discards stale data in flush()
+// before the new data is written.
+// Mono source downmixes all file channels, stereo source
+// takes the first channel as left and the rest as right
+class StreamingSource : public QThread
+{
+  Q_OBJECT
+
+  void run() override;
+
+public:
+  StreamingSource(int channelsCount, int samplingRate);
+  ~StreamingSource();
+
+  // GUI thread, returns false if the file can not be opened
+  bool open(QString filename);
+  // Data is already at the target sample rate,
+  // right is used only by stereo source
+  void openData(QVector<float> left, QVector<float> right);
+  void seek(qint64 frame);
+
+  bool isOpen();
+  // Length and position in frames at the target sample rate
+  qint64 getLength();
+  qint64 getPosition();
+
+  // Process callback only
+  void flush();
+  // Decoded frames ready to be read
+  int getReadSpace();
+  // Reads up to n_count frames, missing frames are zero,
+  // right is used only by stereo source
+  int read(float *left, float *right, int n_count);
+  void skip(int n_count);
+
+private:
+  int channels;
+  int samplingRate;
+  int frameSize;
+
+  jack_ringbuffer_t *ringbuffer;
+
+  // Pending request from the GUI thread
+  QMutex requestMutex;
+  SNDFILE *requestedFile;
+  SF_INFO requestedInfo;
+  qint64 requestedFrame;
+  bool dataRequested;
+  QVector<float> requestedDataL;
+  QVector<float> requestedDataR;
+  std::atomic<int> requestsCount;
+
+  // Flush handshake with the process callback
+  std::atomic<int> flushRequest;
+  std::atomic<int> flushDone;
+  std::atomic<qint64> flushPosition;
+
+  std::atomic<qint64> length;
+  std::atomic<qint64> position;
+
+  // Frames missed by the process callback after an underrun,
+  // they are dropped when decoded so position stays in sync
+  int lateFrames;
+
+  // Disk thread state
+  SNDFILE *sndFile;
+  SF_INFO sfinfo;
+  Resampler resampler;
+  bool resampling;
+  double ratio;
+  int pendingZeros;
+
+  // Memory source, shared with the GUI thread copy-on-write
+  bool inMemory;
+  QVector<float> dataL;
+  QVector<float> dataR;
+  qint64 dataPos;
+
+  QVector<float> decodeBuffer;
+  QVector<float> sourceBuffer;
+  QVector<float> resampledBuffer;
+
+  void startStream(qint64 frame);
+  int readSource(float *out, int n_count);
+  void readData(float *out, int n_count);
+  void dropLateFrames();
+  bool decodeChunk();
+};
+
+#endif // STREAMINGSOURCE_H
@@ -25,6 +25,7 @@
 TAMeter::TAMeter(QWidget *parent) : QWidget(parent)
 {
   value = -60.0;
+  peakValue = -60.0;
 }
 
 void TAMeter::paintEvent(QPaintEvent *)
@@ -52,14 +53,26 @@ void TAMeter::paintEvent(QPaintEvent *)
   barGrad.setColorAt(1, QColor(255, 0, 0));
 
   painter.fillRect(0, 0, barWidth, height(), barGrad);
+
+  if (peakValue > -60.0)
+  {
+    int peakPosition = (width() - 1) * (1.0 - (peakValue / (-60.0)));
+
+    painter.setPen(QColor(255, 255, 255));
+    painter.drawLine(peakPosition, 0, peakPosition, height() - 1);
+  }
 }
 
-void TAMeter::setValue(float v)
+void TAMeter::setValue(float v, float peak)
 {
   value = v;
+  peakValue = peak;
 
   if (value > 0.0) value = 0.0;
   if (value < -60.0) value = -60.0;
 
+  if (peakValue > 0.0) peakValue = 0.0;
+  if (peakValue < -60.0) peakValue = -60.0;
+
   repaint(0,0,-1,-1);
 }
@@ -30,10 +30,12 @@ class TAMeter : public QWidget
     Q_OBJECT
 public:
     TAMeter(QWidget *parent);
-    void setValue(float v);
+    // Bar shows v, peak is marked with a line
+    void setValue(float v, float peak = -60.0);
 
 private:
     float value;
+    float peakValue;
     void paintEvent(QPaintEvent *);
 };
 
@@ -120,14 +120,21 @@ TubeAmpPanel::TubeAmpPanel(QWidget *parent, Processor *prc, Player *plr) :
   inputMeter->setMaximumHeight(24);
   gbox->addWidget(inputMeter, 8, 0, 1, 2);
 
-  QLabel *outputMeterLabel = new QLabel(tr("Output Level"), scrollWidget);
+  QLabel *outputMeterLabel = new QLabel(tr("Output Loudness"), scrollWidget);
   outputMeterLabel->setMaximumHeight(24);
   gbox->addWidget(outputMeterLabel, 9, 0, 1, 2);
 
   outputMeter = new TAMeter(scrollWidget);
   outputMeter->setMaximumHeight(24);
+  outputMeter->setToolTip(tr("Momentary loudness, LUFS. "
+    "Line marks true peak, dBTP"));
   gbox->addWidget(outputMeter, 10, 0, 1, 2);
 
+  loudnessLabel = new QLabel(scrollWidget);
+  loudnessLabel->setMaximumHeight(24);
+  gbox->addWidget(loudnessLabel, 11, 0, 1, 2);
+  loudnessValueChanged(-INFINITY, -INFINITY, -INFINITY, -INFINITY);
+
   resetControls();
 }
 
@@ -204,10 +211,41 @@ void TubeAmpPanel::resetControls()
   levelDial->setValue(ctrls.volume * 100.0);
 }
 
-void TubeAmpPanel::peakRMSValueChanged(float inputValue, float outputValue)
+// Output is shown by the loudness meter
+void TubeAmpPanel::peakRMSValueChanged(float inputValue, float inputPeak)
 {
   float dbInputValue = 20.0 * log10(inputValue);
-  float dbOutputValue = 20.0 * log10(outputValue);
-  inputMeter->setValue(dbInputValue);
-  outputMeter->setValue(dbOutputValue);
+  inputMeter->setValue(dbInputValue, 20.0 * log10(inputPeak));
+}
+
+void TubeAmpPanel::loudnessValueChanged(float momentary, float shortTerm,
+                                        float integrated, float truePeak)
+{
+  outputMeter->setValue(momentary, truePeak);
+
+  // Loudness below the gate and true peak
+  // below the display floor are not shown
+  QString shortTermText = "--";
+  QString integratedText = "--";
+  QString truePeakText = "--";
+
+  if (shortTerm > LOUDNESS_ABSOLUTE_GATE)
+  {
+    shortTermText = QString::number(shortTerm, 'f', 1);
+  }
+
+  if (integrated > LOUDNESS_ABSOLUTE_GATE)
+  {
+    integratedText = QString::number(integrated, 'f', 1);
+  }
+
+  if (truePeak > TRUE_PEAK_DISPLAY_FLOOR)
+  {
+    truePeakText = QString::number(truePeak, 'f', 1);
+  }
+
+  loudnessLabel->setText(tr("S %1  I %2 LUFS  TP %3 dBTP")
+                         .arg(shortTermText)
+                         .arg(integratedText)
+                         .arg(truePeakText));
 }
@@ -22,6 +22,7 @@
 
 #include <QFrame>
 #include <QScrollArea>
+#include <QLabel>
 
 #include "tadial.h"
 #include "tameter.h"
@@ -48,6 +49,7 @@ private:
 
   TAMeter *inputMeter;
   TAMeter *outputMeter;
+  QLabel *loudnessLabel;
 
   Processor *processor;
   Player *player;
@@ -66,7 +68,9 @@ public slots:
   void volumeDialValueChanged(int newValue);
   void levelDialValueChanged(int newValue);
 
-  void peakRMSValueChanged(float inputValue, float outputValue);
+  void peakRMSValueChanged(float inputValue, float inputPeak);
+  void loudnessValueChanged(float momentary, float shortTerm,
+                            float integrated, float truePeak);
 
 signals:
   void dialValueChanged();
@@ -22,12 +22,17 @@ HEADERS += src/amp_nonlinear_edit_widget.h \
            src/deconvolver_dialog.h \
            src/equalizer_widget.h \
            src/faust-support.h \
+           src/fft_plan_cache.h \
            src/file_resampling_thread.h \
            src/freq_response_widget.h \
+           src/level_kernels.h \
            src/load_dialog.h \
+           src/lookahead_renderer.h \
+           src/loudness_meter.h \
            src/mainwindow.h \
            src/math_functions.h \
            src/message_widget.h \
+           src/multirate_convolver.h \
            src/nonlinear_widget.h \
            src/player.h \
            src/player_panel.h \
@@ -36,8 +41,13 @@ HEADERS += src/amp_nonlinear_edit_widget.h \
            src/processor.h \
            src/profile.h \
            src/profiler.h \
+           src/profiler_audio.h \
+           src/profiler_cache.h \
            src/profiler_dialog.h \
+           src/sample_span.h \
            src/slide_box_widget.h \
+           src/spectral_kernels.h \
+           src/streaming_source.h \
            src/tadial.h \
            src/tameter.h \
            src/tonestack_edit_widget.h \
@@ -50,13 +60,18 @@ SOURCES += src/amp_nonlinear_edit_widget.cpp \
            src/convolver_dialog.cpp \
            src/deconvolver_dialog.cpp \
            src/equalizer_widget.cpp \
+           src/fft_plan_cache.cpp \
            src/file_resampling_thread.cpp \
            src/freq_response_widget.cpp \
+           src/level_kernels.cpp \
            src/load_dialog.cpp \
+           src/lookahead_renderer.cpp \
+           src/loudness_meter.cpp \
            src/main.cpp \
            src/mainwindow.cpp \
            src/math_functions.cpp \
            src/message_widget.cpp \
+           src/multirate_convolver.cpp \
            src/nonlinear_widget.cpp \
            src/player.cpp \
            src/player_panel.cpp \
@@ -64,8 +79,11 @@ SOURCES += src/amp_nonlinear_edit_widget.cpp \
            src/preamp_nonlinear_edit_widget.cpp \
            src/processor.cpp \
            src/profiler.cpp \
+           src/profiler_cache.cpp \
            src/profiler_dialog.cpp \
            src/slide_box_widget.cpp \
+           src/spectral_kernels.cpp \
+           src/streaming_source.cpp \
            src/tadial.cpp \
            src/tameter.cpp \
            src/tonestack_edit_widget.cpp \
@@ -0,0 +1,282 @@
+/*
+ * Copyright (C) 2018-2020 Oleg Kapitonov
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ * --------------------------------------------------------------------------
+ */
+
+
+// Checks round-off error of double and single precision
+// FFT convolver and averaging against direct calculation,
+// and of single precision deconvolver against double one,
+// on fixed inputs
+
+#include <QVector>
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+#include "math_functions.h"
+
+#define SIGNAL_N_COUNT 4096
+#define IR_N_COUNT 1024
+#define SPECTRUM_N_COUNT 64
+#define MAX_ERROR_DB -100.0
+
+// Fixed pseudo-random sequence in [-1, 1)
+static QVector<float> noise(int n_count, unsigned int seed)
+{
+  QVector<float> data(n_count);
+
+  for (int i = 0; i < n_count; i++)
+  {
+    seed = seed * 1664525u + 1013904223u;
+    data[i] = (seed >> 8) / 8388608.0 - 1.0;
+  }
+
+  return data;
+}
+
+// Peak error relative to the reference peak
+static double error_db(const float *data, const long double *reference,
+                       int n_count)
+{
+  long double error = 0.0;
+  long double peak = 0.0;
+
+  for (int i = 0; i < n_count; i++)
+  {
+    error = fmaxl(error, fabsl(data[i] - reference[i]));
+    peak = fmaxl(peak, fabsl(reference[i]));
+  }
+
+  return 20.0 * log10((double)(error / peak) + 1e-30);
+}
+
+static double error_db(const double *data, const long double *reference,
+                       int n_count)
+{
+  QVector<float> values(n_count);
+
+  for (int i = 0; i < n_count; i++)
+  {
+    values[i] = data[i];
+  }
+
+  return error_db(values.data(), reference, n_count);
+}
+
+// Decaying noise without constant component
+static QVector<float> impulse_response()
+{
+  QVector<float> impulse = noise(IR_N_COUNT, 2);
+
+  double mean = 0.0;
+  for (int i = 0; i < IR_N_COUNT; i++)
+  {
+    impulse[i] *= exp(-5.0 * i / IR_N_COUNT);
+    mean += impulse[i];
+  }
+
+  mean /= IR_N_COUNT;
+
+  for (int i = 0; i < IR_N_COUNT; i++)
+  {
+    impulse[i] -= mean;
+  }
+
+  return impulse;
+}
+
+// fft_convolver() is circular over the signal length
+static QVector<long double> circular_convolution(const QVector<float> &signal,
+                                                 const QVector<float> &impulse)
+{
+  int n_count = signal.size();
+  QVector<long double> result(n_count);
+
+  for (int n = 0; n < n_count; n++)
+  {
+    for (int k = 0; k < impulse.size(); k++)
+    {
+      result[n] += (long double)impulse[k] * signal[(n - k + n_count) % n_count];
+    }
+  }
+
+  return result;
+}
+
+static double convolver_error_db(FFT_PRECISION precision)
+{
+  QVector<float> signal = noise(SIGNAL_N_COUNT, 1);
+  QVector<float> impulse = impulse_response();
+
+  QVector<long double> reference = circular_convolution(signal, impulse);
+
+  fft_convolver(signal.data(), signal.size(),
+                impulse.data(), impulse.size(), precision);
+
+  return error_db(signal.data(), reference.data(), SIGNAL_N_COUNT);
+}
+
+// Impulse response from response to a test signal
+// without spectrum nulls
+static QVector<float> deconvolve(FFT_PRECISION precision)
+{
+  QVector<float> test(SIGNAL_N_COUNT);
+  test[0] = 1.0;
+  test[1] = 0.5;
+
+  QVector<long double> response = circular_convolution(test, impulse_response());
+
+  QVector<float> signal(SIGNAL_N_COUNT);
+  for (int i = 0; i < SIGNAL_N_COUNT; i++)
+  {
+    signal[i] = response[i];
+  }
+
+  QVector<float> result(SIGNAL_N_COUNT);
+
+  fft_deconvolver(test.data(), test.size(), signal.data(), signal.size(),
+                  result.data(), result.size(), 0.001, 0.45, -200.0, precision);
+
+  return result;
+}
+
+// Deconvolver filters the response, so the result
+// is compared with the double precision path
+static double deconvolver_error_db(FFT_PRECISION precision)
+{
+  QVector<float> result = deconvolve(precision);
+  QVector<float> double_result = deconvolve(FFT_PRECISION_DOUBLE);
+
+  QVector<long double> reference(SIGNAL_N_COUNT);
+  for (int i = 0; i < SIGNAL_N_COUNT; i++)
+  {
+    reference[i] = double_result[i];
+  }
+
+  return error_db(result.data(), reference.data(), SIGNAL_N_COUNT);
+}
+
+// Welch average of Hann windowed slices with half overlap
+// by direct DFT
+static QVector<long double> welch_average(const QVector<float> &signal)
+{
+  int slice_size = 2 * SPECTRUM_N_COUNT;
+  int hop = slice_size / 2;
+  int n_slices = (signal.size() - slice_size) / hop + 1;
+
+  QVector<long double> window(slice_size);
+  long double window_sum = 0.0;
+
+  for (int i = 0; i < slice_size; i++)
+  {
+    window[i] = 0.5 - 0.5 * cosl(2.0 * M_PI * i / slice_size);
+    window_sum += window[i];
+  }
+
+  QVector<long double> average(SPECTRUM_N_COUNT);
+
+  for (int n = 0; n < n_slices; n++)
+  {
+    for (int k = 1; k <= SPECTRUM_N_COUNT; k++)
+    {
+      long double re = 0.0;
+      long double im = 0.0;
+
+      for (int i = 0; i < slice_size; i++)
+      {
+        long double x = signal[n * hop + i] * window[i];
+        re += x * cosl(2.0 * M_PI * k * i / slice_size);
+        im -= x * sinl(2.0 * M_PI * k * i / slice_size);
+      }
+
+      average[k - 1] += (re * re + im * im) / (window_sum * window_sum);
+    }
+  }
+
+  for (int k = 0; k < SPECTRUM_N_COUNT; k++)
+  {
+    average[k] = sqrtl(average[k] / n_slices);
+  }
+
+  return average;
+}
+
+static double average_error_db(FFT_PRECISION precision)
+{
+  QVector<float> signal = noise(SIGNAL_N_COUNT, 3);
+  QVector<long double> reference = welch_average(signal);
+
+  QVector<double> average(SPECTRUM_N_COUNT);
+
+  switch (precision)
+  {
+    case FFT_PRECISION_DOUBLE:
+    {
+      QVector<double> buffer(signal.size());
+      for (int i = 0; i < signal.size(); i++)
+      {
+        buffer[i] = signal[i];
+      }
+
+      fft_average(average.data(), buffer.data(), SPECTRUM_N_COUNT,
+                  buffer.size(), FFT_AVERAGE_MEAN);
+    }
+    break;
+    case FFT_PRECISION_FLOAT:
+      fft_average(average.data(), signal.data(), SPECTRUM_N_COUNT,
+                  signal.size(), FFT_AVERAGE_MEAN);
+    break;
+  }
+
+  return error_db(average.data(), reference.data(), SPECTRUM_N_COUNT);
+}
+
+// Failed checks are reported on stderr,
+// the result is returned by exit code
+static bool check(const char *name, FFT_PRECISION precision, double errorDb)
+{
+  if (errorDb < MAX_ERROR_DB)
+  {
+    return true;
+  }
+
+  fprintf(stderr, "%s %s: error %.1f dB above %.1f dB\n", name,
+          (precision == FFT_PRECISION_DOUBLE) ? "double" : "float",
+          errorDb, MAX_ERROR_DB);
+
+  return false;
+}
+
+int main()
+{
+  bool passed = true;
+
+  FFT_PRECISION precisions[2] = {FFT_PRECISION_DOUBLE, FFT_PRECISION_FLOAT};
+
+  for (FFT_PRECISION precision : precisions)
+  {
+    passed &= check("fft_convolver", precision, convolver_error_db(precision));
+    passed &= check("fft_average", precision, average_error_db(precision));
+  }
+
+  passed &= check("fft_deconvolver", FFT_PRECISION_FLOAT,
+                  deconvolver_error_db(FFT_PRECISION_FLOAT));
+
+  return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}